@@ -0,0 +1,43 @@
+// Scaling of the batch runner with the number of threads, running the mixed
+// workload on many independent machines.
+//
+//   cc -O2 -pthread bench/batch.c tiny6502*.c -o batch_bench
+
+#include "bench.h"
+
+#include <unistd.h>
+
+#include "../tiny6502_batch.h"
+
+#define BENCH_MACHINES 256
+#define BENCH_CYCLES (20ull * 1000 * 1000)
+
+int main(void) {
+  CPUBatch *batch = cpu_batch_create(BENCH_MACHINES);
+  if (!batch)
+    return 1;
+
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  double base = 0;
+  for (unsigned threads = 1; threads <= online; threads *= 2) {
+    for (size_t i = 0; i < BENCH_MACHINES; i++) {
+      CPUMachine *machine = cpu_batch_machine(batch, i);
+      bench_load(&machine->cpu, &machine->memory, &bench_mixed);
+    }
+
+    CPUBatchOptions options = {.cycle_budget = BENCH_CYCLES,
+                               .threads = threads};
+    double start = bench_now();
+    cpu_batch_run(batch, &options);
+    double seconds = bench_now() - start;
+    if (threads == 1)
+      base = seconds;
+
+    printf("%3u threads  %8.2f MHz total  %5.2fx\n", threads,
+           BENCH_MACHINES * (double)BENCH_CYCLES / seconds / 1e6,
+           base / seconds);
+  }
+
+  cpu_batch_destroy(batch);
+  return 0;
+}
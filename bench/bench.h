@@ -0,0 +1,256 @@
+#ifndef TINY6502_BENCH_H
+#define TINY6502_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_blocks.h"
+#include "../tiny6502_jit.h"
+#include "../tiny6502_scheduler.h"
+
+// A program that loops back to its origin forever.
+typedef struct {
+  const char *name;
+  const uint8_t *program;
+  size_t size;
+  uint16_t origin;
+} BenchWorkload;
+
+// LDA #1; ADC #3; TAX; INX; DEY; TAY; CLC; JMP $0200
+static const uint8_t bench_alu_loop[] = {0xA9, 0x01, 0x69, 0x03, 0xAA,
+                                         0xE8, 0x88, 0xA8, 0x18, 0x4C,
+                                         0x00, 0x02};
+
+// Fills a page, sums it through ($10),Y and calls a subroutine that shifts,
+// pushes and compares the result.
+static const uint8_t bench_mixed_loop[] = {
+    0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x03, 0xE8, 0xD0, 0xF9, 0xA9, 0x00, 0x85,
+    0x10, 0xA9, 0x03, 0x85, 0x11, 0xA0, 0x00, 0x18, 0xA9, 0x00, 0x71, 0x10,
+    0xC8, 0xD0, 0xFB, 0x85, 0x20, 0x20, 0x23, 0x02, 0x4C, 0x00, 0x02, 0xA5,
+    0x20, 0x0A, 0x26, 0x21, 0x49, 0x5A, 0x48, 0x68, 0xC9, 0x10, 0x90, 0x02,
+    0xC6, 0x22, 0x60,
+};
+
+// Straight-line loads, stores and read-modify-writes across the memory
+// addressing modes.
+static const uint8_t bench_modes_loop[] = {
+    0xA5, 0x10, 0x85, 0x11, 0xBD, 0x00, 0x03, 0x79, 0x00, 0x03, 0x9D, 0x00,
+    0x04, 0xB1, 0x20, 0x01, 0x30, 0x55, 0x12, 0x06, 0x40, 0x2A, 0xE6, 0x41,
+    0x2D, 0x02, 0x03, 0xC9, 0x10, 0x4C, 0x00, 0x02,
+};
+
+// Copies four pages from $1000 to $2000 through ($10),Y and ($12),Y.
+static const uint8_t bench_memcpy_loop[] = {
+    0xA9, 0x00, 0x85, 0x10, 0x85, 0x12, 0xA9, 0x10, 0x85, 0x11, 0xA9,
+    0x20, 0x85, 0x13, 0xA2, 0x04, 0xA0, 0x00, 0xB1, 0x10, 0x91, 0x12,
+    0xC8, 0xD0, 0xF9, 0xE6, 0x11, 0xE6, 0x13, 0xCA, 0xD0, 0xF2, 0x4C,
+    0x00, 0x02,
+};
+
+// Fills $0300-$033F with 63 down to 0 and bubble sorts it, passing over the
+// array until a pass makes no swap.
+static const uint8_t bench_sort_loop[] = {
+    0xA2, 0x3F, 0x8A, 0x49, 0x3F, 0x9D, 0x00, 0x03, 0xCA, 0x10, 0xF7,
+    0xA0, 0x00, 0xA2, 0x00, 0xBD, 0x00, 0x03, 0xDD, 0x01, 0x03, 0x90,
+    0x11, 0xF0, 0x0F, 0x85, 0x10, 0xBD, 0x01, 0x03, 0x9D, 0x00, 0x03,
+    0xA5, 0x10, 0x9D, 0x01, 0x03, 0xA0, 0x01, 0xE8, 0xE0, 0x3F, 0xD0,
+    0xE2, 0x88, 0xF0, 0xDB, 0x4C, 0x00, 0x02,
+};
+
+// CRC-16/XMODEM of its own page, $0200-$02FF, bit by bit into $10 and $11.
+static const uint8_t bench_crc_loop[] = {
+    0xA9, 0x00, 0x85, 0x10, 0x85, 0x11, 0xA0, 0x00, 0xB9, 0x00, 0x02,
+    0x45, 0x11, 0x85, 0x11, 0xA2, 0x08, 0x06, 0x10, 0x26, 0x11, 0x90,
+    0x0C, 0xA5, 0x10, 0x49, 0x21, 0x85, 0x10, 0xA5, 0x11, 0x49, 0x10,
+    0x85, 0x11, 0xCA, 0xD0, 0xEB, 0xC8, 0xD0, 0xDF, 0x4C, 0x00, 0x02,
+};
+
+static const BenchWorkload bench_alu = {"alu", bench_alu_loop,
+                                        sizeof(bench_alu_loop), 0x0200};
+static const BenchWorkload bench_mixed = {"mixed", bench_mixed_loop,
+                                          sizeof(bench_mixed_loop), 0x0200};
+static const BenchWorkload bench_modes = {"modes", bench_modes_loop,
+                                          sizeof(bench_modes_loop), 0x0200};
+static const BenchWorkload bench_memcpy = {"memcpy", bench_memcpy_loop,
+                                           sizeof(bench_memcpy_loop), 0x0200};
+static const BenchWorkload bench_sort = {"sort", bench_sort_loop,
+                                         sizeof(bench_sort_loop), 0x0200};
+static const BenchWorkload bench_crc = {"crc", bench_crc_loop,
+                                        sizeof(bench_crc_loop), 0x0200};
+
+static inline double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline void bench_load(CPU *cpu, Memory *mem,
+                              const BenchWorkload *workload) {
+  memset(*mem, 0, sizeof(Memory));
+  memcpy(&(*mem)[workload->origin], workload->program, workload->size);
+  (*mem)[0xFFFC] = workload->origin & 0xFF;
+  (*mem)[0xFFFD] = workload->origin >> 8;
+  cpu_init(cpu, mem);
+}
+
+// Steps once around the loop to learn how many instructions it retires per
+// emulated cycle, then reloads the workload.
+static inline double bench_calibrate(CPU *cpu, Memory *mem,
+                                     const BenchWorkload *workload) {
+  bench_load(cpu, mem, workload);
+  uint64_t instructions = 0, cycles = 0;
+  do {
+    cycles += cpu_step_instruction(cpu);
+    instructions++;
+  } while (cpu->PC != workload->origin);
+  bench_load(cpu, mem, workload);
+  return (double)instructions / cycles;
+}
+
+static inline void bench_report(const char *label,
+                                const BenchWorkload *workload,
+                                double instructions_per_cycle,
+                                uint64_t cycles, double seconds) {
+  double instructions = cycles * instructions_per_cycle;
+  printf("%-24s %-8s %10.2f MHz %12.0f instr/s %8.2f ns/instr\n", label,
+         workload->name, cycles / seconds / 1e6, instructions / seconds,
+         seconds * 1e9 / instructions);
+}
+
+// Runs the workload for the given number of emulated cycles using cpu_run().
+static inline uint64_t bench_run(CPU *cpu, uint64_t cycles, double *seconds) {
+  double start = bench_now();
+  uint64_t consumed = 0;
+  while (consumed < cycles)
+    consumed += cpu_run(cpu, 1 << 20);
+  *seconds = bench_now() - start;
+  return consumed;
+}
+
+// A timer raising IRQ every period cycles, released by reading $D000, with
+// a handler at $0300 that acknowledges it and counts interrupts in $10. The
+// interrupt workload clears I and counts in X while it waits.
+typedef struct {
+  CPUScheduler scheduler;
+  int event;
+  uint64_t period;
+} BenchTimer;
+
+// CLI; INX; JMP $0200
+static const uint8_t bench_interrupt_loop[] = {0x58, 0xE8, 0x4C, 0x00, 0x02};
+
+// PHA; LDA $D000; INC $10; PLA; RTI
+static const uint8_t bench_interrupt_handler[] = {0x48, 0xAD, 0x00, 0xD0,
+                                                  0xE6, 0x10, 0x68, 0x40};
+
+static const BenchWorkload bench_interrupt = {
+    "irq", bench_interrupt_loop, sizeof(bench_interrupt_loop), 0x0200};
+
+static inline void bench_timer_tick(CPU *cpu, void *data, uint64_t cycle) {
+  BenchTimer *timer = data;
+  cpu_set_irq(cpu, 0, true);
+  cpu_scheduler_at(&timer->scheduler, timer->event, cycle + timer->period);
+}
+
+static inline uint8_t bench_timer_read(CPU *cpu, void *data, uint16_t addr) {
+  (void)data;
+  (void)addr;
+  cpu_set_irq(cpu, 0, false);
+  return 0;
+}
+
+// Loads the interrupt workload with its handler and starts the timer.
+static inline void bench_timer_load(BenchTimer *timer, CPU *cpu, Memory *mem,
+                                    uint64_t period) {
+  bench_load(cpu, mem, &bench_interrupt);
+  memcpy(&(*mem)[0x0300], bench_interrupt_handler,
+         sizeof(bench_interrupt_handler));
+  (*mem)[0xFFFE] = 0x00;
+  (*mem)[0xFFFF] = 0x03;
+  cpu_map_io(cpu, 0xD000, 0x100, bench_timer_read, NULL, timer);
+
+  cpu_scheduler_init(&timer->scheduler, cpu);
+  timer->event = cpu_scheduler_add(&timer->scheduler, bench_timer_tick, timer);
+  timer->period = period;
+  cpu_scheduler_at(&timer->scheduler, timer->event, period);
+}
+
+// Loads a memory image at $0000 and starts it at start, leaving the reset
+// vector alone. Returns false if the file cannot be read.
+static inline bool bench_load_image(CPU *cpu, Memory *mem, const char *path,
+                                    uint16_t start) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+  memset(*mem, 0, sizeof(Memory));
+  size_t size = fread(*mem, 1, sizeof(Memory), file);
+  fclose(file);
+  if (!size)
+    return false;
+  cpu_init(cpu, mem);
+  cpu->PC = start;
+  return true;
+}
+
+// True once the CPU sits on a JMP or branch to itself, which is how test
+// images such as Klaus Dormann's functional test stop on success or failure.
+static inline bool bench_trapped(CPU *cpu) {
+  uint16_t pc = cpu->PC;
+  uint8_t opcode = cpu_read(cpu, pc);
+  if (opcode == 0x4C)
+    return (cpu_read(cpu, pc + 1) | cpu_read(cpu, pc + 2) << 8) == pc;
+  return (opcode & 0x1F) == 0x10 && cpu_read(cpu, pc + 1) == 0xFE;
+}
+
+// The ways cpu_run can take a program, for the tests and benchmarks that
+// compare them: the interpreter, the block cache and the recompiler under
+// fast timing, then the interpreter under exact timing and the cycle engine.
+typedef enum {
+  ENGINE_TABLE,
+  ENGINE_BLOCKS,
+  ENGINE_JIT,
+  ENGINE_EXACT,
+  ENGINE_CYCLE,
+} BenchEngine;
+
+static const char *const bench_engines[] = {"table", "blocks", "jit", "exact",
+                                            "cycle"};
+
+// What an attached engine holds. Big enough to want static storage.
+typedef struct {
+  BenchEngine engine;
+  CPUBlockCache blocks;
+  CPUJit *jit;
+} BenchEngineState;
+
+// Puts the CPU on engine, setting the timing model for ENGINE_EXACT and
+// ENGINE_CYCLE and leaving it alone otherwise. Returns false if the engine is
+// not available here.
+static inline bool bench_engine_attach(BenchEngineState *state, CPU *cpu,
+                                       BenchEngine engine) {
+  state->engine = ENGINE_TABLE;
+  state->jit = NULL;
+  if (engine == ENGINE_EXACT)
+    cpu->timing = CPU_TIMING_EXACT;
+  if (engine == ENGINE_CYCLE)
+    cpu->timing = CPU_TIMING_CYCLE;
+  if (engine == ENGINE_BLOCKS && !cpu_blocks_attach(&state->blocks, cpu))
+    return false;
+  if (engine == ENGINE_JIT && !(state->jit = cpu_jit_create(cpu)))
+    return false;
+  state->engine = engine;
+  return true;
+}
+
+static inline void bench_engine_detach(BenchEngineState *state) {
+  if (state->engine == ENGINE_BLOCKS)
+    cpu_blocks_detach(&state->blocks);
+  cpu_jit_destroy(state->jit);
+  state->jit = NULL;
+}
+
+#endif // TINY6502_BENCH_H
@@ -0,0 +1,34 @@
+// Instruction throughput of the table and threaded dispatch loops on a
+// register-only loop, a straight-line run through the memory addressing
+// modes and a mixed workload with loops and subroutine calls.
+//
+//   cc -O2 bench/dispatch.c tiny6502*.c -o dispatch_bench
+
+#include "bench.h"
+
+#include "../tiny6502_ops.h"
+
+#define BENCH_CYCLES (500ull * 1000 * 1000)
+
+static Memory memory;
+
+static void bench_workload(const BenchWorkload *workload) {
+  CPU cpu;
+  double seconds;
+  double ipc = bench_calibrate(&cpu, &memory, workload);
+  uint64_t cycles = bench_run(&cpu, BENCH_CYCLES, &seconds);
+  bench_report("cpu_run", workload, ipc, cycles, seconds);
+
+  bench_load(&cpu, &memory, workload);
+  double start = bench_now();
+  for (cycles = 0; cycles < BENCH_CYCLES;)
+    cycles += cpu_run_threaded(&cpu, 1 << 20);
+  bench_report("cpu_run_threaded", workload, ipc, cycles, bench_now() - start);
+}
+
+int main(void) {
+  bench_workload(&bench_alu);
+  bench_workload(&bench_modes);
+  bench_workload(&bench_mixed);
+  return 0;
+}
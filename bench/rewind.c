@@ -0,0 +1,81 @@
+// What keeping rewind history costs: each workload through cpu_run and
+// through cpu_rewind_run with a keyframe every 100000 cycles, on the
+// interpreter and the recompiler, then how long jumping back and stepping
+// back take.
+//
+//   cc -O2 bench/rewind.c tiny6502*.c -o rewind_bench
+
+#include "bench.h"
+
+#include "../tiny6502_jit.h"
+#include "../tiny6502_rewind.h"
+
+#define BENCH_CYCLES (200ull * 1000 * 1000)
+#define BENCH_INTERVAL 100000
+#define BENCH_FRAMES 64
+#define BENCH_PAGES 4096
+
+static Memory memory;
+
+static uint64_t bench_rewind_run(CPURewind *rewind, uint64_t cycles,
+                                 double *seconds) {
+  double start = bench_now();
+  uint64_t consumed = 0;
+  while (consumed < cycles)
+    consumed += cpu_rewind_run(rewind, 1 << 20);
+  *seconds = bench_now() - start;
+  return consumed;
+}
+
+static void bench_workload(const BenchWorkload *workload, bool jit_on) {
+  CPU cpu;
+  double seconds, plain, kept;
+  double ipc = bench_calibrate(&cpu, &memory, workload);
+  CPUJit *jit = jit_on ? cpu_jit_create(&cpu) : NULL;
+  uint64_t cycles = bench_run(&cpu, BENCH_CYCLES, &seconds);
+  cpu_jit_destroy(jit);
+  plain = cycles / seconds;
+  bench_report(jit_on ? "cpu_run jit" : "cpu_run", workload, ipc, cycles,
+               seconds);
+
+  bench_load(&cpu, &memory, workload);
+  jit = jit_on ? cpu_jit_create(&cpu) : NULL;
+  CPURewind *rewind =
+      cpu_rewind_create(&cpu, BENCH_INTERVAL, BENCH_FRAMES, BENCH_PAGES);
+  if (!rewind) {
+    cpu_jit_destroy(jit);
+    return;
+  }
+  cycles = bench_rewind_run(rewind, BENCH_CYCLES, &seconds);
+  kept = cycles / seconds;
+  bench_report(jit_on ? "cpu_rewind_run jit" : "cpu_rewind_run", workload,
+               ipc, cycles, seconds);
+  printf("%-24s %-8s %10.1f %% slower\n", "", workload->name,
+         (plain / kept - 1) * 100);
+
+  if (!jit_on) {
+    uint64_t oldest = cpu_rewind_oldest(rewind);
+    double start = bench_now();
+    cpu_rewind_to(rewind, oldest + (cpu.cycles - oldest) / 2);
+    double jump = bench_now() - start;
+    start = bench_now();
+    for (int step = 0; step < 100; step++)
+      cpu_rewind_step_back(rewind);
+    double back = (bench_now() - start) / 100;
+    printf("%-24s %-8s %10.2f ms jump %8.2f ms step back\n", "",
+           workload->name, jump * 1e3, back * 1e3);
+  }
+  cpu_rewind_destroy(rewind);
+  cpu_jit_destroy(jit);
+}
+
+int main(void) {
+  static const BenchWorkload *const workloads[] = {
+      &bench_alu, &bench_modes, &bench_mixed,
+      &bench_memcpy, &bench_sort, &bench_crc,
+  };
+  for (int jit = 0; jit < 2; jit++)
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+      bench_workload(workloads[i], jit);
+  return 0;
+}
@@ -0,0 +1,90 @@
+// The standard workloads through cpu_run on the interpreter, the block cache
+// and the recompiler: the register, addressing mode and mixed loops, a page
+// copy, a bubble sort and a CRC, then an interrupt-heavy program against a
+// timer, and, given the path of Klaus Dormann's 6502 functional test image,
+// the whole test from $0400 to its final trap.
+//
+//   cc -O2 bench/suite.c tiny6502*.c -o suite_bench
+//   ./suite_bench [6502_functional_test.bin]
+
+#include "bench.h"
+
+#define BENCH_CYCLES (200ull * 1000 * 1000)
+#define BENCH_TIMER_PERIOD 64
+
+static const char *const bench_labels[] = {"cpu_run", "cpu_run blocks",
+                                           "cpu_run jit"};
+
+static Memory memory;
+static BenchEngineState engine_state;
+
+static void bench_workload(const BenchWorkload *workload, BenchEngine engine) {
+  CPU cpu;
+  double seconds;
+  double ipc = bench_calibrate(&cpu, &memory, workload);
+  if (!bench_engine_attach(&engine_state, &cpu, engine))
+    return;
+  uint64_t cycles = bench_run(&cpu, BENCH_CYCLES, &seconds);
+  bench_engine_detach(&engine_state);
+  bench_report(bench_labels[engine], workload, ipc, cycles, seconds);
+}
+
+// Interrupt entries count as instructions, so the rate is learned by stepping
+// the scheduler rather than from one pass around the loop.
+static void bench_interrupts(BenchEngine engine) {
+  CPU cpu;
+  BenchTimer timer;
+  bench_timer_load(&timer, &cpu, &memory, BENCH_TIMER_PERIOD);
+  uint64_t instructions = 0, cycles = 0;
+  while (cycles < 100000) {
+    cycles += cpu_scheduler_run(&timer.scheduler, 1);
+    instructions++;
+  }
+  double ipc = (double)instructions / cycles;
+
+  bench_timer_load(&timer, &cpu, &memory, BENCH_TIMER_PERIOD);
+  if (!bench_engine_attach(&engine_state, &cpu, engine))
+    return;
+  double start = bench_now();
+  cycles = cpu_scheduler_run(&timer.scheduler, BENCH_CYCLES / 4);
+  double seconds = bench_now() - start;
+  bench_engine_detach(&engine_state);
+  bench_report(bench_labels[engine], &bench_interrupt, ipc, cycles, seconds);
+}
+
+// Runs the image to its trap and reports where it stopped, which the test's
+// listing maps to success or to the failing check.
+static void bench_functional(const char *path, BenchEngine engine) {
+  CPU cpu;
+  if (!bench_load_image(&cpu, &memory, path, 0x0400)) {
+    printf("%s: cannot read\n", path);
+    return;
+  }
+  if (!bench_engine_attach(&engine_state, &cpu, engine))
+    return;
+  double start = bench_now();
+  uint64_t cycles = 0;
+  while (!bench_trapped(&cpu))
+    cycles += cpu_run(&cpu, 1 << 16);
+  double seconds = bench_now() - start;
+  bench_engine_detach(&engine_state);
+  printf("%-24s %-8s %10.2f MHz %12llu cycles   trap at $%04X\n",
+         bench_labels[engine], "dormann", cycles / seconds / 1e6,
+         (unsigned long long)cycles, cpu.PC);
+}
+
+int main(int argc, char **argv) {
+  static const BenchWorkload *const workloads[] = {
+      &bench_alu,    &bench_modes, &bench_mixed,
+      &bench_memcpy, &bench_sort,  &bench_crc,
+  };
+
+  for (BenchEngine engine = ENGINE_TABLE; engine <= ENGINE_JIT; engine++) {
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+      bench_workload(workloads[i], engine);
+    bench_interrupts(engine);
+    if (argc > 1)
+      bench_functional(argv[1], engine);
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+// Instruction throughput with tracing compiled out, recording into the ring
+// and decoding to text. Build once without and once with -DTINY6502_TRACE:
+//
+//   cc -O2 bench/trace.c tiny6502*.c -o trace_bench
+//   cc -O2 -DTINY6502_TRACE bench/trace.c tiny6502*.c -o trace_bench
+
+#include "bench.h"
+
+#include "../tiny6502_trace.h"
+
+#define BENCH_CYCLES (200ull * 1000 * 1000)
+
+static Memory memory;
+#ifdef TINY6502_TRACE
+static CPUTraceEntry entries[1 << 16];
+#endif
+
+int main(void) {
+  CPU cpu;
+  double seconds;
+  uint64_t cycles;
+
+  double ipc = bench_calibrate(&cpu, &memory, &bench_alu);
+  cycles = bench_run(&cpu, BENCH_CYCLES, &seconds);
+#ifdef TINY6502_TRACE
+  bench_report("trace compiled, off", &bench_alu, ipc, cycles, seconds);
+
+  CPUTrace trace;
+  cpu_trace_init(&trace, entries, sizeof(entries) / sizeof(entries[0]));
+  bench_load(&cpu, &memory, &bench_alu);
+  cpu_trace_attach(&cpu, &trace);
+  cycles = bench_run(&cpu, BENCH_CYCLES, &seconds);
+  bench_report("trace to ring", &bench_alu, ipc, cycles, seconds);
+
+  FILE *null = fopen("/dev/null", "w");
+  if (!null)
+    return 1;
+  trace.text = null;
+  bench_load(&cpu, &memory, &bench_alu);
+  cpu_trace_attach(&cpu, &trace);
+  cycles = bench_run(&cpu, BENCH_CYCLES / 20, &seconds);
+  bench_report("trace to text", &bench_alu, ipc, cycles, seconds);
+  fclose(null);
+#else
+  bench_report("trace compiled out", &bench_alu, ipc, cycles, seconds);
+#endif
+
+  return 0;
+}
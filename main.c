@@ -1,53 +1,444 @@
+// Command-line runner: loads images into a fresh machine, runs it until it
+// halts and prints the final state on one line, for scripts driving many
+// jobs.
+//
+//   tiny6502 [options] image[@addr]...
+//
+// Images ending in .hex or .ihex are Intel HEX and carry their own
+// addresses. Images ending in .prg start with a two-byte load address. Any
+// other image is raw binary loaded at addr, in hex, or $0000. Later images
+// overwrite earlier ones. Whole pages of raw and PRG images are mapped
+// straight from the file, copy-on-write, rather than copied in.
+//
+// Raw and PRG files given with -W are mapped as RAM that writes back to the
+// file, and with -R as ROM. They go on top of the images, -R last, and must
+// start on a page boundary.
+
 #include "tiny6502.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
 
-void cpu_print_state(CPU *cpu) {
-  printf("A: $%02X X: $%02X Y: $%02X SP: $%02X PC: $%04X P: %08b Cycles left: "
-         "%d \n",
-         cpu->A, cpu->X, cpu->Y, cpu->SP, cpu->PC, cpu->P.reg,
-         cpu->cycles_left);
-}
+#include "tiny6502_blocks.h"
+#include "tiny6502_debug.h"
+#include "tiny6502_file.h"
+#include "tiny6502_jit.h"
 
-int main(void) {
+#define RUNNER_SLICE (1u << 16)
+
+typedef struct {
   Memory memory;
+  CPU cpu;
+  CPUBlockCache blocks;
 
-  // a9 01 8d 00 02 a9 05 8d 01 02 a9 08 8d 02 02
-  memory[0x0200] = 0xA9;
-  memory[0x0201] = 0x01;
-  memory[0x0202] = 0x8D;
-  memory[0x0203] = 0x00;
-  memory[0x0204] = 0x02;
-  memory[0x0205] = 0xA9;
-  memory[0x0206] = 0x05;
-  memory[0x0207] = 0x8D;
-  memory[0x0208] = 0x01;
-  memory[0x0209] = 0x02;
-  memory[0x020A] = 0xA9;
-  memory[0x020B] = 0x08;
-  memory[0x020C] = 0x8D;
-  memory[0x020D] = 0x02;
-  memory[0x020E] = 0x02;
-
-  memory[0xFFFC] = 0x00;
-  memory[0xFFFD] = 0x02;
+  // Holds a breakpoint at each -u address.
+  CPUDebug debug;
 
-  CPU cpu;
-  cpu_init(&cpu, &memory);
-  cpu_print_state(&cpu);
+  // BRK is caught as it reads its vector, through a handler on page $FF
+  // that reads what was mapped there before.
+  const uint8_t *vectors;
+  bool brk;
+  uint16_t brk_at;
+
+  bool vector_loaded;
+} Runner;
+
+static Runner runner;
+
+static void runner_usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options] image[@addr]...\n"
+          "  -R file[@addr]  map file as ROM; may be repeated\n"
+          "  -W file[@addr]  map file as RAM that writes back; may be repeated\n"
+          "  -r addr    reset vector (default: the first image's address,\n"
+          "             unless an image covers $FFFC)\n"
+          "  -u addr    stop when the PC reaches addr; may be repeated\n"
+          "  -c cycles  stop after this many cycles\n"
+          "  -b         run BRK through its vector instead of stopping\n"
+          "  -t timing  fast, exact or cycle (default fast)\n"
+          "  -e engine  table, blocks or jit, for fast timing (default table)\n"
+          "  -s cycles  cycles between checks for a jump to itself\n"
+          "Stops at BRK, at a JMP or branch to itself, at an -u address or\n"
+          "at the -c limit, and prints the stop and the final registers.\n",
+          name);
+}
+
+static bool runner_parse_address(const char *text, uint16_t *addr) {
+  char *end;
+  if (*text == '$')
+    text++;
+  unsigned long value = strtoul(text, &end, 16);
+  if (!*text || *end || value > 0xFFFF)
+    return false;
+  *addr = value;
+  return true;
+}
+
+// Writes through whatever backs the page, so a later image overwrites one
+// mapped from a file as well as plain memory. ROM cannot be written.
+static bool runner_poke(uint16_t addr, uint8_t value) {
+  uint8_t *host = runner.cpu.pages.ram[addr >> 8];
+  if (!host)
+    return false;
+  host[addr & 0xFF] = value;
+  if (addr == 0xFFFC || addr == 0xFFFD)
+    runner.vector_loaded = true;
+  return true;
+}
+
+// Maps size bytes of file from offset at addr. A private image maps only
+// its whole pages and copies the rest, so a page it shares with another
+// image keeps that image's bytes.
+static bool runner_place(const char *path, CPUFile *file, CPUFileMode mode,
+                         uint16_t addr, size_t offset, size_t size) {
+  if (addr + size > 0x10000) {
+    fprintf(stderr, "%s: %zu bytes do not fit at $%04X\n", path, size, addr);
+    return false;
+  }
 
-  while (cpu.PC < 0x020F) {
-    getchar();
-    do
-      cpu_step_cycle(&cpu);
-    while (cpu.cycles_left > 0);
-    cpu_print_state(&cpu);
+  size_t mapped = size;
+  if (mode == CPU_FILE_PRIVATE)
+    mapped = addr & 0xFF ? 0 : size & ~(size_t)0xFF;
+  if (mapped && !cpu_map_file(&runner.cpu, addr, file, offset, mapped)) {
+    fprintf(stderr, "%s: $%04X is not on a page boundary\n", path, addr);
+    return false;
   }
+  if (mapped && addr + mapped > 0xFFFC)
+    runner.vector_loaded = true;
 
-  puts("Done! Memory:");
-  printf("At $0200: %02X\n", memory[0x0200]);
-  printf("At $0201: %02X\n", memory[0x0201]);
-  printf("At $0202: %02X\n", memory[0x0202]);
+  const uint8_t *data = cpu_file_data(file) + offset;
+  for (size_t i = mapped; i < size; i++) {
+    if (!runner_poke(addr + i, data[i])) {
+      fprintf(stderr, "%s: $%04X is ROM\n", path, (unsigned)(addr + i));
+      return false;
+    }
+  }
+  return true;
+}
+
+static int runner_hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+// Intel HEX: data records, with extended addresses accepted only while they
+// stay in the first 64 KiB, up to the end-of-file record. first is set to
+// the address of the first data record.
+static bool runner_load_ihex(const char *path, const char *text, size_t size,
+                             uint16_t *first) {
+  const char *end = text + size;
+  bool data = false;
+  unsigned line = 0;
+  uint32_t base = 0;
+  while (text < end) {
+    const char *eol = memchr(text, '\n', end - text);
+    if (!eol)
+      eol = end;
+    line++;
+
+    uint8_t record[256 + 5];
+    size_t length = 0;
+    const char *p = text;
+    while (p < eol && (*p == ' ' || *p == '\t'))
+      p++;
+    if (p < eol && *p != '\r') {
+      if (*p++ != ':')
+        goto bad;
+      for (; p + 1 < eol && length < sizeof(record); p += 2) {
+        int high = runner_hex_digit(p[0]), low = runner_hex_digit(p[1]);
+        if (high < 0 || low < 0)
+          break;
+        record[length++] = high << 4 | low;
+      }
+      uint8_t sum = 0;
+      for (size_t i = 0; i < length; i++)
+        sum += record[i];
+      if (length < 5 || length != record[0] + 5u || sum)
+        goto bad;
+
+      uint16_t offset = record[1] << 8 | record[2];
+      switch (record[3]) {
+      case 0x00:
+        for (unsigned i = 0; i < record[0]; i++) {
+          uint32_t addr = base + ((offset + i) & 0xFFFF);
+          if (addr > 0xFFFF) {
+            fprintf(stderr, "%s:%u: data above $FFFF\n", path, line);
+            return false;
+          }
+          if (!data)
+            *first = addr;
+          data = true;
+          if (!runner_poke(addr, record[4 + i])) {
+            fprintf(stderr, "%s:%u: $%04X is ROM\n", path, line, addr);
+            return false;
+          }
+        }
+        break;
+      case 0x01:
+        return true;
+      case 0x02:
+        base = (uint32_t)(record[4] << 8 | record[5]) << 4;
+        break;
+      case 0x04:
+        base = (uint32_t)(record[4] << 8 | record[5]) << 16;
+        break;
+      }
+    }
+    text = eol + 1;
+  }
+  return true;
 
+bad:
+  fprintf(stderr, "%s:%u: bad record\n", path, line);
+  return false;
+}
+
+static bool runner_has_suffix(const char *path, const char *suffix) {
+  size_t length = strlen(path), suffix_length = strlen(suffix);
+  return length >= suffix_length &&
+         !strcasecmp(path + length - suffix_length, suffix);
+}
+
+// Loads path[@addr]. Returns the address it was loaded at, or -1. Files stay
+// open, and mapped, for as long as the process runs.
+static int32_t runner_load(char *spec, CPUFileMode mode) {
+  uint16_t addr = 0;
+  char *at = strrchr(spec, '@');
+  if (at) {
+    *at = 0;
+    if (!runner_parse_address(at + 1, &addr)) {
+      fprintf(stderr, "%s: bad address %s\n", spec, at + 1);
+      return -1;
+    }
+  }
+
+  CPUFile *file = cpu_file_open(spec, mode, 0);
+  if (!file) {
+    fprintf(stderr, "%s: cannot map\n", spec);
+    return -1;
+  }
+  const uint8_t *data = cpu_file_data(file);
+  size_t size = cpu_file_size(file), offset = 0;
+
+  if (runner_has_suffix(spec, ".hex") || runner_has_suffix(spec, ".ihex")) {
+    bool loaded = mode == CPU_FILE_PRIVATE &&
+                  runner_load_ihex(spec, (const char *)data, size, &addr);
+    if (mode != CPU_FILE_PRIVATE)
+      fprintf(stderr, "%s: Intel HEX cannot be mapped\n", spec);
+    cpu_file_close(file);
+    return loaded ? addr : -1;
+  }
+  if (runner_has_suffix(spec, ".prg")) {
+    if (size < 2) {
+      fprintf(stderr, "%s: no load address\n", spec);
+      return -1;
+    }
+    addr = data[0] | data[1] << 8;
+    offset = 2;
+    size -= 2;
+  }
+  return runner_place(spec, file, mode, addr, offset, size) ? addr : -1;
+}
+
+// By the time BRK reads its vector it has pushed its return address, two
+// past the BRK, and P with B set.
+static uint8_t runner_read_vectors(CPU *cpu, void *data, uint16_t addr) {
+  (void)data;
+  uint8_t sp = cpu->SP;
+  if (addr == 0xFFFE && !runner.brk &&
+      cpu_read(cpu, 0x100 | (uint8_t)(sp + 1)) & 0x10) {
+    runner.brk = true;
+    runner.brk_at = (cpu_read(cpu, 0x100 | (uint8_t)(sp + 2)) |
+                     cpu_read(cpu, 0x100 | (uint8_t)(sp + 3)) << 8) -
+                    2;
+    cpu_stop_at(cpu, cpu->cycles);
+  }
+  return runner.vectors ? runner.vectors[addr & 0xFF] : 0xFF;
+}
+
+static bool runner_trapped(CPU *cpu) {
+  uint16_t pc = cpu->PC;
+  uint8_t opcode = cpu_read(cpu, pc);
+  if (opcode == 0x4C)
+    return (cpu_read(cpu, pc + 1) | cpu_read(cpu, pc + 2) << 8) == pc;
+  if ((opcode & 0x1F) != 0x10 || cpu_read(cpu, pc + 1) != 0xFE)
+    return false;
+  // A branch to itself only traps if it is taken. Bits 7-6 of the opcode
+  // pick the flag, N, V, C or Z, and bit 5 the value that takes it.
+  static const uint8_t flags[4] = {0x80, 0x40, 0x01, 0x02};
+  return !(cpu_flags(cpu) & flags[opcode >> 6]) == !(opcode & 0x20);
+}
+
+// Runs in slices of cpu_run, which BRK and the -u breakpoints cut short. A
+// jump to itself is noticed at the end of the slice it starts in.
+static const char *runner_run(uint64_t limit, uint64_t slice) {
+  CPU *cpu = &runner.cpu;
+  for (;;) {
+    uint64_t budget = slice;
+    if (limit && limit - cpu->cycles < budget)
+      budget = limit - cpu->cycles;
+    CPUStop stop = cpu_debug_run(&runner.debug, budget);
+    if (stop.reason == CPU_STOP_BREAK)
+      return "pc";
+    // Under CPU_TIMING_CYCLE the run can end inside an instruction.
+    while (cpu->cycle.cycle)
+      cpu_step_cycle(cpu);
+    if (runner.brk)
+      return "brk";
+    if (runner_trapped(cpu))
+      return "trap";
+    if (limit && cpu->cycles >= limit)
+      return "limit";
+  }
+}
+
+static double runner_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  uint16_t reset = 0;
+  bool reset_given = false, brk = true;
+  const char *engine = "table";
+  uint64_t limit = 0, slice = RUNNER_SLICE;
+  CPUTiming timing = CPU_TIMING_FAST;
+
+  char **roms = calloc(argc, sizeof(*roms));
+  char **rams = calloc(argc, sizeof(*rams));
+  uint16_t *until = calloc(argc, sizeof(*until));
+  int rom_count = 0, ram_count = 0, until_count = 0;
+  if (!roms || !rams || !until)
+    return 1;
+
+  int option;
+  uint16_t addr;
+  char *end;
+  while ((option = getopt(argc, argv, "R:W:r:u:c:bt:e:s:h")) != -1) {
+    switch (option) {
+    case 'R':
+      roms[rom_count++] = optarg;
+      break;
+    case 'W':
+      rams[ram_count++] = optarg;
+      break;
+    case 'r':
+      if (!runner_parse_address(optarg, &reset))
+        goto usage;
+      reset_given = true;
+      break;
+    case 'u':
+      if (!runner_parse_address(optarg, &addr))
+        goto usage;
+      until[until_count++] = addr;
+      break;
+    case 'c':
+      limit = strtoull(optarg, &end, 0);
+      if (*end || !*optarg)
+        goto usage;
+      break;
+    case 'b':
+      brk = false;
+      break;
+    case 't':
+      if (!strcmp(optarg, "fast"))
+        timing = CPU_TIMING_FAST;
+      else if (!strcmp(optarg, "exact"))
+        timing = CPU_TIMING_EXACT;
+      else if (!strcmp(optarg, "cycle"))
+        timing = CPU_TIMING_CYCLE;
+      else
+        goto usage;
+      break;
+    case 'e':
+      engine = optarg;
+      if (strcmp(engine, "table") && strcmp(engine, "blocks") &&
+          strcmp(engine, "jit"))
+        goto usage;
+      break;
+    case 's':
+      slice = strtoull(optarg, &end, 0);
+      if (*end || !slice)
+        goto usage;
+      break;
+    default:
+      goto usage;
+    }
+  }
+  if (optind == argc && !rom_count && !ram_count)
+    goto usage;
+
+  CPU *cpu = &runner.cpu;
+  cpu_init(cpu, &runner.memory);
+  cpu_debug_attach(&runner.debug, cpu);
+  for (int i = 0; i < until_count; i++)
+    cpu_debug_break(&runner.debug, until[i]);
+  int32_t first = -1;
+  for (int i = optind; i < argc; i++) {
+    int32_t loaded = runner_load(argv[i], CPU_FILE_PRIVATE);
+    if (loaded < 0)
+      return 1;
+    if (first < 0)
+      first = loaded;
+  }
+  for (int i = 0; i < ram_count + rom_count; i++) {
+    int32_t loaded = i < ram_count ? runner_load(rams[i], CPU_FILE_RAM)
+                                   : runner_load(roms[i - ram_count],
+                                                 CPU_FILE_ROM);
+    if (loaded < 0)
+      return 1;
+    if (first < 0)
+      first = loaded;
+  }
+
+  if (!reset_given && !runner.vector_loaded) {
+    reset = first;
+    reset_given = true;
+  }
+  if (reset_given &&
+      (!runner_poke(0xFFFC, reset & 0xFF) || !runner_poke(0xFFFD, reset >> 8))) {
+    fprintf(stderr, "the reset vector is in ROM\n");
+    return 1;
+  }
+  if (brk) {
+    runner.vectors = cpu->pages.read[0xFF];
+    cpu_map_io(cpu, 0xFF00, 0x100, runner_read_vectors, NULL, NULL);
+  }
+
+  // As the hardware leaves them after reset.
+  cpu_reset(cpu);
+  cpu->SP = 0xFD;
+  cpu->P.flags.I = 1;
+  cpu->timing = timing;
+  CPUJit *jit = NULL;
+  if (!strcmp(engine, "blocks"))
+    cpu_blocks_attach(&runner.blocks, cpu);
+  if (!strcmp(engine, "jit") && !(jit = cpu_jit_create(cpu)))
+    fprintf(stderr, "no recompiler on this host, using the table\n");
+
+  double start = runner_now();
+  const char *stop = runner_run(limit, slice);
+  double seconds = runner_now() - start;
+  cpu_jit_destroy(jit);
+
+  printf("stop=%s at=$%04X pc=$%04X a=$%02X x=$%02X y=$%02X sp=$%02X "
+         "p=$%02X cycles=%llu seconds=%.6f\n",
+         stop, runner.brk ? runner.brk_at : cpu->PC, cpu->PC, cpu->A, cpu->X,
+         cpu->Y, cpu->SP, cpu_flags(cpu), (unsigned long long)cpu->cycles,
+         seconds);
   return 0;
+
+usage:
+  runner_usage(argv[0]);
+  return 2;
 }
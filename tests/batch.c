@@ -0,0 +1,119 @@
+// Checks the batch runner: machines run on a pool end where the same
+// programs run one after another with cpu_run do, halted machines stop at
+// the end of the slice their condition first holds in, a second run carries
+// on from the first, and batches with fewer machines than threads, or none,
+// still run.
+//
+//   cc -O2 -pthread tests/batch.c tiny6502*.c -o batch_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_batch.h"
+
+//   $0200  LDA $F0        the machine's number
+//   $0202  CLC
+//   $0203  ADC #$07
+//   $0205  STA $0300,X
+//   $0208  INX
+//   $0209  JMP $0202
+static const uint8_t batch_program[] = {0xA5, 0xF0, 0x18, 0x69, 0x07, 0x9D,
+                                        0x00, 0x03, 0xE8, 0x4C, 0x02, 0x02};
+
+#define BATCH_MACHINES 37
+#define BATCH_BUDGET 20000
+#define BATCH_SLICE 500
+
+static Memory batch_memory;
+static CPU batch_cpu;
+
+static void batch_load(CPU *cpu, Memory *memory, size_t number) {
+  memset(*memory, 0, sizeof(Memory));
+  memcpy(&(*memory)[0x0200], batch_program, sizeof(batch_program));
+  (*memory)[0xF0] = number;
+  (*memory)[0xFFFC] = 0x00;
+  (*memory)[0xFFFD] = 0x02;
+  cpu_init(cpu, memory);
+  cpu_reset(cpu);
+}
+
+// Machine n halts once it has run 1000 * n cycles; even numbers never do.
+static uint64_t batch_limit(size_t number) {
+  return number % 2 ? 1000 * number : UINT64_MAX;
+}
+
+static bool batch_halt(CPUMachine *machine, void *data) {
+  (void)data;
+  return machine->cpu.cycles >= batch_limit(machine->memory[0xF0]);
+}
+
+// The machine's runs as cpu_batch_run describes them, on this thread.
+// Returns whether the last one halted.
+static bool batch_reference(size_t number, unsigned runs) {
+  batch_load(&batch_cpu, &batch_memory, number);
+  bool halted = false;
+  for (unsigned run = 0; run < runs; run++) {
+    uint64_t cycles = 0;
+    halted = false;
+    while (cycles < BATCH_BUDGET && !halted) {
+      uint64_t left = BATCH_BUDGET - cycles;
+      cycles += cpu_run(&batch_cpu, left < BATCH_SLICE ? left : BATCH_SLICE);
+      halted = batch_cpu.cycles >= batch_limit(number);
+    }
+  }
+  return halted;
+}
+
+static int batch_check(size_t count, unsigned threads, unsigned runs) {
+  CPUBatch *batch = cpu_batch_create(count);
+  if (!batch || cpu_batch_size(batch) != count) {
+    printf("%zu machines: not created\n", count);
+    return 1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    CPUMachine *machine = cpu_batch_machine(batch, i);
+    batch_load(&machine->cpu, &machine->memory, i);
+  }
+  CPUBatchOptions options = {.cycle_budget = BATCH_BUDGET,
+                             .slice = BATCH_SLICE,
+                             .halt = batch_halt,
+                             .threads = threads};
+  for (unsigned run = 0; run < runs; run++)
+    cpu_batch_run(batch, &options);
+
+  int failed = 0;
+  for (size_t i = 0; i < count && !failed; i++) {
+    const CPUMachine *machine = cpu_batch_machine(batch, i);
+    bool halted = batch_reference(i, runs);
+    const CPU *a = &machine->cpu, *b = &batch_cpu;
+    if (machine->halted != halted ||
+        memcmp(machine->memory, batch_memory, sizeof(Memory)) ||
+        a->cycles != b->cycles || a->PC != b->PC || a->A != b->A ||
+        a->X != b->X || cpu_flags(a) != cpu_flags(b)) {
+      printf("%zu machines, %u threads: machine %zu differs\n", count,
+             threads, i);
+      failed = 1;
+    } else if (halted && runs == 1 &&
+               (a->cycles < batch_limit(i) ||
+                a->cycles >= batch_limit(i) + BATCH_SLICE + 7)) {
+      printf("machine %zu halted at %llu, past its slice\n", i,
+             (unsigned long long)a->cycles);
+      failed = 1;
+    }
+  }
+  cpu_batch_destroy(batch);
+  return failed;
+}
+
+int main(void) {
+  int failed = 0;
+  failed |= batch_check(BATCH_MACHINES, 4, 1);
+  failed |= batch_check(BATCH_MACHINES, 0, 2);
+  failed |= batch_check(3, 8, 1);
+  failed |= batch_check(1, 0, 1);
+  failed |= batch_check(0, 4, 1);
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,170 @@
+// Checks the bus cycles of CPU_TIMING_CYCLE against the NMOS 6502's cycle
+// tables for a few instructions, and random programs against the
+// interpreter under exact timing, stepping both by instruction and by cycle.
+//
+//   cc -O2 tests/cycle.c tiny6502*.c -o cycle_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+
+typedef struct {
+  uint16_t addr;
+  bool write;
+} CycleAccess;
+
+typedef struct {
+  const char *name;
+  uint8_t code[3];
+  uint8_t X;
+  CycleAccess bus[8];
+  unsigned count;
+} CycleCase;
+
+#define R(addr) {addr, false}
+#define W(addr) {addr, true}
+
+// Code at $0200, SP at $F0, $10 points at $20F0.
+static const CycleCase cycle_cases[] = {
+    {"LDA abs,X", {0xBD, 0x10, 0x20}, 0x01,
+     {R(0x0200), R(0x0201), R(0x0202), R(0x2011)}, 4},
+    {"LDA abs,X crossing", {0xBD, 0x10, 0x20}, 0xF0,
+     {R(0x0200), R(0x0201), R(0x0202), R(0x2000), R(0x2100)}, 5},
+    {"STA abs,X", {0x9D, 0x10, 0x20}, 0x01,
+     {R(0x0200), R(0x0201), R(0x0202), R(0x2011), W(0x2011)}, 5},
+    {"INC abs,X crossing", {0xFE, 0x10, 0x20}, 0xF0,
+     {R(0x0200), R(0x0201), R(0x0202), R(0x2000), R(0x2100), W(0x2100),
+      W(0x2100)}, 7},
+    {"INC zp,X", {0xF6, 0xF8}, 0x10,
+     {R(0x0200), R(0x0201), R(0x00F8), R(0x0008), W(0x0008),
+      W(0x0008)}, 6},
+    {"LDA (zp,X)", {0xA1, 0x08}, 0x08,
+     {R(0x0200), R(0x0201), R(0x0008), R(0x0010), R(0x0011), R(0x20F0)}, 6},
+    {"LDA (zp),Y", {0xB1, 0x10}, 0,
+     {R(0x0200), R(0x0201), R(0x0010), R(0x0011), R(0x20F0)}, 5},
+    {"INX", {0xE8}, 0, {R(0x0200), R(0x0201)}, 2},
+    {"PHA", {0x48}, 0, {R(0x0200), R(0x0201), W(0x01F0)}, 3},
+    {"PLA", {0x68}, 0, {R(0x0200), R(0x0201), R(0x01F0), R(0x01F1)}, 4},
+    {"JSR", {0x20, 0x00, 0x30}, 0,
+     {R(0x0200), R(0x0201), R(0x01F0), W(0x01F0), W(0x01EF),
+      R(0x0202)}, 6},
+    {"RTS", {0x60}, 0,
+     {R(0x0200), R(0x0201), R(0x01F0), R(0x01F1), R(0x01F2), R(0x0000)}, 6},
+    {"JMP ($20FF)", {0x6C, 0xFF, 0x20}, 0,
+     {R(0x0200), R(0x0201), R(0x0202), R(0x20FF), R(0x2000)}, 5},
+    {"BNE taken crossing", {0xD0, 0x80}, 0,
+     {R(0x0200), R(0x0201), R(0x0202), R(0x0282)}, 4},
+    {"BRK", {0x00}, 0,
+     {R(0x0200), R(0x0201), W(0x01F0), W(0x01EF), W(0x01EE),
+      R(0xFFFE), R(0xFFFF)}, 7},
+};
+
+static Memory cycle_memory, reference_memory;
+static CPU cycle_cpu, reference_cpu;
+
+static CycleAccess cycle_seen[16];
+static unsigned cycle_seen_count;
+
+static void cycle_record(CPU *cpu, void *data, uint16_t addr, uint8_t value,
+                         bool write) {
+  (void)cpu, (void)data, (void)value;
+  if (cycle_seen_count < 16)
+    cycle_seen[cycle_seen_count] = (CycleAccess){addr, write};
+  cycle_seen_count++;
+}
+
+static int cycle_check_bus(const CycleCase *c) {
+  memset(cycle_memory, 0, sizeof(Memory));
+  memcpy(&cycle_memory[0x0200], c->code, sizeof(c->code));
+  cycle_memory[0x10] = 0xF0;
+  cycle_memory[0x11] = 0x20;
+  cpu_init(&cycle_cpu, &cycle_memory);
+  cycle_cpu.timing = CPU_TIMING_CYCLE;
+  cycle_cpu.on_cycle = (CPUCycleWatcher){cycle_record, NULL};
+  cycle_cpu.PC = 0x0200;
+  cycle_cpu.SP = 0xF0;
+  cycle_cpu.X = c->X;
+
+  cycle_seen_count = 0;
+  uint8_t cycles = cpu_step_instruction(&cycle_cpu);
+  bool same = cycles == c->count && cycle_seen_count == c->count &&
+              cycle_cpu.cycles == c->count;
+  for (unsigned i = 0; same && i < c->count; i++)
+    same = cycle_seen[i].addr == c->bus[i].addr &&
+           cycle_seen[i].write == c->bus[i].write;
+  if (!same) {
+    printf("%s:", c->name);
+    for (unsigned i = 0; i < cycle_seen_count && i < 16; i++)
+      printf(" %c$%04X", cycle_seen[i].write ? 'W' : 'R', cycle_seen[i].addr);
+    printf("\n");
+    return 1;
+  }
+  return 0;
+}
+
+static uint64_t cycle_rng = 88172645463325252ull;
+
+static uint8_t cycle_random(void) {
+  cycle_rng ^= cycle_rng << 13;
+  cycle_rng ^= cycle_rng >> 7;
+  cycle_rng ^= cycle_rng << 17;
+  return cycle_rng;
+}
+
+static int cycle_compare(int program, int step) {
+  CPU *a = &cycle_cpu, *b = &reference_cpu;
+  if (a->PC != b->PC || a->A != b->A || a->X != b->X || a->Y != b->Y ||
+      a->SP != b->SP || cpu_flags(a) != cpu_flags(b) ||
+      a->cycles != b->cycles || a->IRQ != b->IRQ ||
+      memcmp(cycle_memory, reference_memory, sizeof(Memory))) {
+    printf("program %d step %d: PC $%04X/$%04X cycles %llu/%llu\n", program,
+           step, a->PC, b->PC, (unsigned long long)a->cycles,
+           (unsigned long long)b->cycles);
+    return 1;
+  }
+  return 0;
+}
+
+// Random code from the same memory on both CPUs, with IRQ held now and then.
+// Odd programs step the cycle engine a cycle at a time.
+static int cycle_check_program(int program) {
+  for (int i = 0; i < 0x10000; i++)
+    cycle_memory[i] = cycle_random();
+  memcpy(reference_memory, cycle_memory, sizeof(Memory));
+  cpu_init(&cycle_cpu, &cycle_memory);
+  cpu_init(&reference_cpu, &reference_memory);
+  cycle_cpu.timing = CPU_TIMING_CYCLE;
+  reference_cpu.timing = CPU_TIMING_EXACT;
+
+  for (int step = 0; step < 2000; step++) {
+    if (step % 50 == 40 || step % 50 == 49) {
+      cpu_set_irq(&cycle_cpu, 0, step % 50 == 40);
+      cpu_set_irq(&reference_cpu, 0, step % 50 == 40);
+    }
+    uint8_t expected = cpu_step_instruction(&reference_cpu);
+    uint8_t cycles = 0;
+    if (program & 1) {
+      do {
+        cpu_step_cycle(&cycle_cpu);
+        cycles++;
+      } while (cycle_cpu.cycle.cycle);
+    } else {
+      cycles = cpu_step_instruction(&cycle_cpu);
+    }
+    if (cycles != expected || cycle_compare(program, step))
+      return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  for (unsigned i = 0; i < sizeof(cycle_cases) / sizeof(*cycle_cases); i++)
+    failed |= cycle_check_bus(&cycle_cases[i]);
+  for (int program = 0; program < 200 && !failed; program++)
+    failed |= cycle_check_program(program);
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
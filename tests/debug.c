@@ -0,0 +1,199 @@
+// Checks breakpoints, conditional breakpoints on X and on P, read and write
+// watchpoints on RAM and on a device page, and the stop reasons, on each
+// engine, that clearing everything gives the pages back their mappings, and
+// that a bank switch is not taken for a write to the pages it remaps.
+//
+//   cc -O2 tests/debug.c tiny6502*.c -o debug_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../bench/bench.h"
+#include "../tiny6502_debug.h"
+#include "../tiny6502_mapper.h"
+
+//   $0200  LDX #$00
+//   $0202  INX
+//   $0203  STX $0300
+//   $0206  LDA $0310
+//   $0209  LDA $D000
+//   $020C  JMP $0202
+static const uint8_t debug_program[] = {0xA2, 0x00, 0xE8, 0x8E, 0x00, 0x03,
+                                        0xAD, 0x10, 0x03, 0xAD, 0x00, 0xD0,
+                                        0x4C, 0x02, 0x02};
+
+//   $0400  LDA #$01
+//   $0402  STA $8000      selects bank 1 at $8000
+//   $0405  JMP $0405
+static const uint8_t debug_switch[] = {0xA9, 0x01, 0x8D, 0x00,
+                                       0x80, 0x4C, 0x05, 0x04};
+
+#define DEBUG_BUDGET 1000000
+
+static Memory debug_memory;
+static CPU debug_cpu;
+static CPUDebug debug;
+static BenchEngineState debug_engine;
+
+// Every byte of bank n is $80 + n.
+static uint8_t debug_rom[0x10000];
+
+// Counts its reads, and asks the run to stop at the 1000th.
+static unsigned debug_device_reads;
+
+static uint8_t debug_device(CPU *cpu, void *data, uint16_t addr) {
+  (void)data;
+  (void)addr;
+  if (++debug_device_reads == 1000)
+    cpu_stop_at(cpu, cpu->cycles);
+  return 0x80 + debug_device_reads;
+}
+
+static bool debug_expect(const char *engine, const char *what, CPUStop stop,
+                         CPUStopReason reason, uint16_t addr, uint16_t pc,
+                         uint8_t x) {
+  // Under CPU_TIMING_CYCLE a watchpoint stops right after the access.
+  while (debug_cpu.cycle.cycle)
+    cpu_step_cycle(&debug_cpu);
+  if (stop.reason != reason || stop.addr != addr || debug_cpu.PC != pc ||
+      debug_cpu.X != x) {
+    printf("%s, %s: stop %d at $%04X, PC $%04X, X $%02X\n", engine, what,
+           stop.reason, stop.addr, debug_cpu.PC, debug_cpu.X);
+    return false;
+  }
+  return true;
+}
+
+static bool debug_mapper_check(const char *name) {
+  CPUMapper mapper;
+  for (size_t i = 0; i < sizeof(debug_rom); i++)
+    debug_rom[i] = 0x80 + (i >> 12);
+  memcpy(&debug_memory[0x0400], debug_switch, sizeof(debug_switch));
+  if (!cpu_mapper_attach(&mapper, &debug_cpu, "bank4", debug_rom,
+                         sizeof(debug_rom)) ||
+      !cpu_debug_attach(&debug, &debug_cpu))
+    return false;
+
+  while (debug_cpu.cycle.cycle)
+    cpu_step_cycle(&debug_cpu);
+  bool ok = true;
+  cpu_debug_watch(&debug, 0x8100, 1, false, true);
+  debug_cpu.PC = 0x0400;
+  ok &= debug_expect(name, "bank switch", cpu_debug_run(&debug, 100),
+                     CPU_STOP_BUDGET, 0, 0x0405, debug_cpu.X);
+  cpu_debug_unwatch(&debug, 0x8100, 1, false, true);
+
+  cpu_debug_watch(&debug, 0x8000, 1, false, true);
+  debug_cpu.PC = 0x0400;
+  ok &= debug_expect(name, "bank register",
+                     cpu_debug_run(&debug, DEBUG_BUDGET), CPU_STOP_WRITE,
+                     0x8000, 0x0405, debug_cpu.X);
+  if (debug.stop.value != 1 || cpu_read(&debug_cpu, 0x8000) != 0x81) {
+    printf("%s, bank register: wrote $%02X, reads $%02X\n", name,
+           debug.stop.value, cpu_read(&debug_cpu, 0x8000));
+    ok = false;
+  }
+  cpu_debug_detach(&debug);
+  return ok;
+}
+
+static int debug_check(BenchEngine engine) {
+  const char *name = bench_engines[engine];
+  memset(debug_memory, 0, sizeof(Memory));
+  memcpy(&debug_memory[0x0200], debug_program, sizeof(debug_program));
+  debug_memory[0x0310] = 0x42;
+  debug_memory[0xFFFC] = 0x00;
+  debug_memory[0xFFFD] = 0x02;
+  cpu_init(&debug_cpu, &debug_memory);
+  cpu_map_io(&debug_cpu, 0xD000, 0x100, debug_device, NULL, NULL);
+  debug_device_reads = 0;
+  if (!bench_engine_attach(&debug_engine, &debug_cpu, engine))
+    return 0;
+  if (!cpu_debug_attach(&debug, &debug_cpu))
+    return 1;
+
+  bool ok = true;
+  cpu_debug_break(&debug, 0x0209);
+  ok &= debug_expect(name, "break", cpu_debug_run(&debug, DEBUG_BUDGET),
+                     CPU_STOP_BREAK, 0x0209, 0x0209, 1);
+  ok &= debug_expect(name, "break again", cpu_debug_run(&debug, DEBUG_BUDGET),
+                     CPU_STOP_BREAK, 0x0209, 0x0209, 2);
+  cpu_debug_clear(&debug, 0x0209);
+
+  cpu_debug_break_if(&debug, 0x0202, CPU_DEBUG_X, 0xFF, 5);
+  ok &= debug_expect(name, "X", cpu_debug_run(&debug, DEBUG_BUDGET),
+                     CPU_STOP_BREAK, 0x0202, 0x0202, 5);
+  cpu_debug_clear(&debug, 0x0202);
+
+  // Z from INX, once X wraps.
+  cpu_debug_break_if(&debug, 0x0203, CPU_DEBUG_P, 0x02, 0x02);
+  ok &= debug_expect(name, "Z", cpu_debug_run(&debug, DEBUG_BUDGET),
+                     CPU_STOP_BREAK, 0x0203, 0x0203, 0);
+  cpu_debug_clear(&debug, 0x0203);
+
+  cpu_debug_watch(&debug, 0x0300, 1, false, true);
+  ok &= debug_expect(name, "write", cpu_debug_run(&debug, DEBUG_BUDGET),
+                     CPU_STOP_WRITE, 0x0300, 0x0206, 0);
+  ok &= debug.stop.value == 0 && debug_memory[0x0300] == 0;
+  cpu_debug_unwatch(&debug, 0x0300, 1, false, true);
+
+  cpu_debug_watch(&debug, 0x0310, 1, true, false);
+  ok &= debug_expect(name, "read", cpu_debug_run(&debug, DEBUG_BUDGET),
+                     CPU_STOP_READ, 0x0310, 0x0209, 0);
+  ok &= debug.stop.value == 0x42 && debug_cpu.A == 0x42;
+  cpu_debug_unwatch(&debug, 0x0310, 1, true, false);
+
+  // Reads of a watched device page still reach the device, once each.
+  unsigned reads = debug_device_reads;
+  cpu_debug_watch(&debug, 0xD000, 0x100, true, true);
+  ok &= debug_expect(name, "device", cpu_debug_run(&debug, DEBUG_BUDGET),
+                     CPU_STOP_READ, 0xD000, 0x020C, 0);
+  ok &= debug_device_reads == reads + 1 &&
+        debug_cpu.A == (uint8_t)(0x80 + debug_device_reads);
+  cpu_debug_unwatch(&debug, 0, 0x10000, true, true);
+
+  ok &= debug_expect(name, "device stop", cpu_debug_run(&debug, DEBUG_BUDGET),
+                     CPU_STOP_REQUESTED, 0, 0x020C, 1000 & 0xFF);
+
+  // Remapping the page drops the read watchpoint; setting it again traps.
+  cpu_debug_watch(&debug, 0x0310, 1, true, false);
+  cpu_map_ram(&debug_cpu, 0x0300, 0x100, &debug_memory[0x0300]);
+  ok &= cpu_debug_run(&debug, 1000).reason == CPU_STOP_BUDGET;
+  cpu_debug_watch(&debug, 0x0310, 1, true, false);
+  CPUStop stop = cpu_debug_run(&debug, DEBUG_BUDGET);
+  ok &= debug_expect(name, "read after remap", stop, CPU_STOP_READ, 0x0310,
+                     0x0209, debug_cpu.X);
+  cpu_debug_unwatch(&debug, 0x0310, 1, true, false);
+
+  // Plain cpu_run starts from a clean stop reason.
+  cpu_run(&debug_cpu, 100);
+  if (debug.stop.reason != CPU_STOP_BUDGET) {
+    printf("%s: cpu_run kept stop %d\n", name, debug.stop.reason);
+    ok = false;
+  }
+
+  stop = cpu_debug_run(&debug, 1000);
+  ok &= stop.reason == CPU_STOP_BUDGET && stop.cycles >= 1000;
+
+  cpu_debug_detach(&debug);
+  if (debug_cpu.pages.read[0x03] != &debug_memory[0x0300] ||
+      debug_cpu.pages.read[0xD0] ||
+      debug_cpu.pages.handler[0xD0].read != debug_device ||
+      debug_cpu.debug) {
+    printf("%s: mappings not given back\n", name);
+    ok = false;
+  }
+  ok &= debug_mapper_check(name);
+
+  bench_engine_detach(&debug_engine);
+  return !ok;
+}
+
+int main(void) {
+  int failed = 0;
+  for (BenchEngine engine = ENGINE_TABLE; engine <= ENGINE_CYCLE; engine++)
+    failed |= debug_check(engine);
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
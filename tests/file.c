@@ -0,0 +1,147 @@
+// Checks file-backed memory: many CPUs running one ROM that is mapped once,
+// with writes to it dropped; a RAM file whose contents persist from one run
+// to the next; a private image whose writes stay out of the file; the zero
+// padding past the end of a file; and a mapping that starts mid-page.
+//
+//   cc -O2 tests/file.c tiny6502*.c -o file_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_file.h"
+
+//   $F000  LDA $8000
+//   $F003  CLC
+//   $F004  ADC #$01
+//   $F006  STA $8000
+//   $F009  STA $F100      dropped
+//   $F00C  LDX $F100
+//   $F00F  STX $10
+//   $F011  JMP $F011
+static const uint8_t file_program[] = {
+    0xAD, 0x00, 0x80, 0x18, 0x69, 0x01, 0x8D, 0x00, 0x80, 0x8D, 0x00,
+    0xF1, 0xAE, 0x00, 0xF1, 0x86, 0x10, 0x4C, 0x11, 0xF0};
+
+#define FILE_CPUS 64
+
+static Memory file_memory[FILE_CPUS];
+static CPU file_cpus[FILE_CPUS];
+static char file_rom[] = "/tmp/tiny6502_romXXXXXX";
+static char file_ram[] = "/tmp/tiny6502_ramXXXXXX";
+
+static bool file_write(char *path, const uint8_t *data, size_t size) {
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return false;
+  bool written = write(fd, data, size) == (ssize_t)size;
+  close(fd);
+  return written;
+}
+
+static uint8_t file_read_byte(const char *path) {
+  FILE *in = fopen(path, "rb");
+  int value = in ? fgetc(in) : EOF;
+  if (in)
+    fclose(in);
+  return value;
+}
+
+// Runs CPU i from the ROM with the RAM page at $8000 backed by ram.
+static void file_run(int i, CPUFile *rom, CPUFile *ram) {
+  cpu_init(&file_cpus[i], &file_memory[i]);
+  cpu_map_file(&file_cpus[i], 0xF000, rom, 0, 0x1000);
+  if (ram)
+    cpu_map_file(&file_cpus[i], 0x8000, ram, 0, 0x100);
+  cpu_reset(&file_cpus[i]);
+  cpu_run(&file_cpus[i], 100);
+}
+
+int main(void) {
+  static uint8_t image[0x1000];
+  memcpy(image, file_program, sizeof(file_program));
+  image[0x100] = 0x5A;
+  image[0xFFC] = 0x00;
+  image[0xFFD] = 0xF0;
+  int failed = 0;
+  if (!file_write(file_rom, image, sizeof(image)) ||
+      !file_write(file_ram, image, 0)) {
+    puts("cannot write temporary files");
+    return 1;
+  }
+
+  // Every CPU sees the one mapping, and none can write to it.
+  CPUFile *roms[FILE_CPUS];
+  for (int i = 0; i < FILE_CPUS; i++) {
+    roms[i] = cpu_file_open(file_rom, CPU_FILE_ROM, 0);
+    if (!roms[i] || cpu_file_data(roms[i]) != cpu_file_data(roms[0])) {
+      printf("ROM %d not shared\n", i);
+      return 1;
+    }
+    file_run(i, roms[i], NULL);
+    if (file_memory[i][0x10] != 0x5A || file_memory[i][0x8000] != 1 ||
+        file_cpus[i].PC != 0xF011) {
+      printf("CPU %d: $%02X at $10, PC $%04X\n", i, file_memory[i][0x10],
+             file_cpus[i].PC);
+      failed = 1;
+    }
+  }
+  if (cpu_file_data(roms[0])[0x100] != 0x5A) {
+    puts("ROM written");
+    failed = 1;
+  }
+
+  // Each run of a RAM file picks up where the last left off.
+  for (int run = 1; run <= 3; run++) {
+    CPUFile *ram = cpu_file_open(file_ram, CPU_FILE_RAM, 0x100);
+    if (!ram || cpu_file_size(ram) != 0x100) {
+      puts("cannot open RAM");
+      return 1;
+    }
+    file_run(0, roms[0], ram);
+    failed |= !cpu_file_sync(ram);
+    cpu_file_close(ram);
+    if (file_read_byte(file_ram) != run) {
+      printf("run %d: RAM file holds %u\n", run, file_read_byte(file_ram));
+      failed = 1;
+    }
+  }
+
+  CPUFile *image_file = cpu_file_open(file_ram, CPU_FILE_PRIVATE, 0);
+  file_run(0, roms[0], image_file);
+  if (cpu_read(&file_cpus[0], 0x8000) != 4 || file_read_byte(file_ram) != 3) {
+    puts("private image written through");
+    failed = 1;
+  }
+
+  // Past the end of the file, and off the end of the file or the address
+  // space.
+  if (!cpu_map_file(&file_cpus[0], 0x4000, roms[0], 0xF80, 0x80) ||
+      cpu_read(&file_cpus[0], 0x407D) != 0xF0 ||
+      cpu_read(&file_cpus[0], 0x40FF) != 0 ||
+      cpu_map_file(&file_cpus[0], 0x8000, image_file, 0, 0x101) ||
+      cpu_map_file(&file_cpus[0], 0xFF00, roms[0], 0, 0x200) ||
+      cpu_map_file(&file_cpus[0], 0x8010, roms[0], 0, 0x10)) {
+    puts("bad mapping accepted or padding not zero");
+    failed = 1;
+  }
+  cpu_file_close(image_file);
+
+  // An unaligned mapping reaches into the next page.
+  if (!cpu_map_file(&file_cpus[0], 0x10F0, roms[0], 0xF0, 0x20) ||
+      cpu_read(&file_cpus[0], 0x10F0) != image[0xF0] ||
+      cpu_read(&file_cpus[0], 0x1100) != 0x5A) {
+    puts("unaligned mapping cut short");
+    failed = 1;
+  }
+
+  for (int i = 0; i < FILE_CPUS; i++)
+    cpu_file_close(roms[i]);
+  unlink(file_rom);
+  unlink(file_ram);
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
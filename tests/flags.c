@@ -0,0 +1,347 @@
+// Checks the status register the core materialises from its lazily kept
+// flags against eager evaluation, for every flag-setting instruction over
+// every register, operand and incoming P value, and that branches taken
+// straight after each instruction agree with the materialised flags.
+//
+//   cc -O2 tests/flags.c tiny6502*.c -o flags_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+
+enum { FLAG_C = 0x01, FLAG_Z = 0x02, FLAG_V = 0x40, FLAG_N = 0x80 };
+
+// Where an instruction's second input comes from.
+enum {
+  INPUT_NONE,
+  INPUT_IMM,   // the operand byte
+  INPUT_ZP,    // $10
+  INPUT_STACK, // the byte the instruction pulls
+};
+
+typedef struct {
+  const char *name;
+  uint8_t opcode;
+  uint8_t input;
+} FlagsCase;
+
+static const FlagsCase flags_cases[] = {
+    {"LDA #", 0xA9, INPUT_IMM}, {"LDX #", 0xA2, INPUT_IMM},
+    {"LDY #", 0xA0, INPUT_IMM}, {"ADC #", 0x69, INPUT_IMM},
+    {"SBC #", 0xE9, INPUT_IMM}, {"AND #", 0x29, INPUT_IMM},
+    {"ORA #", 0x09, INPUT_IMM}, {"EOR #", 0x49, INPUT_IMM},
+    {"CMP #", 0xC9, INPUT_IMM}, {"CPX #", 0xE0, INPUT_IMM},
+    {"CPY #", 0xC0, INPUT_IMM}, {"BIT", 0x24, INPUT_ZP},
+    {"ASL", 0x06, INPUT_ZP},    {"LSR", 0x46, INPUT_ZP},
+    {"ROL", 0x26, INPUT_ZP},    {"ROR", 0x66, INPUT_ZP},
+    {"INC", 0xE6, INPUT_ZP},    {"DEC", 0xC6, INPUT_ZP},
+    {"ASL A", 0x0A, INPUT_NONE}, {"LSR A", 0x4A, INPUT_NONE},
+    {"ROL A", 0x2A, INPUT_NONE}, {"ROR A", 0x6A, INPUT_NONE},
+    {"INX", 0xE8, INPUT_NONE},  {"INY", 0xC8, INPUT_NONE},
+    {"DEX", 0xCA, INPUT_NONE},  {"DEY", 0x88, INPUT_NONE},
+    {"TAX", 0xAA, INPUT_NONE},  {"TAY", 0xA8, INPUT_NONE},
+    {"TXA", 0x8A, INPUT_NONE},  {"TYA", 0x98, INPUT_NONE},
+    {"TSX", 0xBA, INPUT_NONE},  {"CLC", 0x18, INPUT_NONE},
+    {"SEC", 0x38, INPUT_NONE},  {"CLV", 0xB8, INPUT_NONE},
+    {"CLI", 0x58, INPUT_NONE},  {"SEI", 0x78, INPUT_NONE},
+    {"CLD", 0xD8, INPUT_NONE},  {"SED", 0xF8, INPUT_NONE},
+    {"PLA", 0x68, INPUT_STACK}, {"PLP", 0x28, INPUT_STACK},
+    {"RTI", 0x40, INPUT_STACK},
+};
+
+static const uint8_t flags_branches[] = {0x10, 0x30, 0x50, 0x70,
+                                         0x90, 0xB0, 0xD0, 0xF0};
+
+typedef struct {
+  uint8_t A, X, Y, SP, P, M;
+} FlagsState;
+
+static uint8_t flags_nz(uint8_t p, uint8_t value) {
+  p &= ~(FLAG_N | FLAG_Z);
+  return p | (value & FLAG_N) | (value ? 0 : FLAG_Z);
+}
+
+static uint8_t flags_carry(uint8_t p, bool carry) {
+  return (p & ~FLAG_C) | carry;
+}
+
+static void flags_adc(FlagsState *s, uint8_t value) {
+  unsigned result = s->A + value + (s->P & FLAG_C);
+  bool overflow = (s->A ^ result) & (value ^ result) & 0x80;
+  s->P = flags_carry(s->P, result > 0xFF);
+  s->P = (s->P & ~FLAG_V) | (overflow ? FLAG_V : 0);
+  s->A = result;
+  s->P = flags_nz(s->P, s->A);
+}
+
+static void flags_compare(FlagsState *s, uint8_t reg) {
+  s->P = flags_carry(s->P, reg >= s->M);
+  s->P = flags_nz(s->P, reg - s->M);
+}
+
+// Shifts and rotates of value, eagerly.
+static uint8_t flags_shift(FlagsState *s, uint8_t opcode, uint8_t value) {
+  unsigned carry = s->P & FLAG_C;
+  uint8_t result;
+  switch (opcode & 0xE0) {
+  case 0x00: // ASL
+    result = value << 1;
+    carry = value >> 7;
+    break;
+  case 0x20: // ROL
+    result = (value << 1) | carry;
+    carry = value >> 7;
+    break;
+  case 0x40: // LSR
+    result = value >> 1;
+    carry = value & 1;
+    break;
+  default: // ROR
+    result = (value >> 1) | (carry << 7);
+    carry = value & 1;
+    break;
+  }
+  s->P = flags_nz(flags_carry(s->P, carry), result);
+  return result;
+}
+
+// The eager reference: what each instruction does to the registers, the
+// byte at $10 and P.
+static void flags_expect(uint8_t opcode, FlagsState *s) {
+  switch (opcode) {
+  case 0xA9:
+    s->P = flags_nz(s->P, s->A = s->M);
+    break;
+  case 0xA2:
+    s->P = flags_nz(s->P, s->X = s->M);
+    break;
+  case 0xA0:
+    s->P = flags_nz(s->P, s->Y = s->M);
+    break;
+  case 0x69:
+    flags_adc(s, s->M);
+    break;
+  case 0xE9:
+    flags_adc(s, ~s->M);
+    break;
+  case 0x29:
+    s->P = flags_nz(s->P, s->A &= s->M);
+    break;
+  case 0x09:
+    s->P = flags_nz(s->P, s->A |= s->M);
+    break;
+  case 0x49:
+    s->P = flags_nz(s->P, s->A ^= s->M);
+    break;
+  case 0xC9:
+    flags_compare(s, s->A);
+    break;
+  case 0xE0:
+    flags_compare(s, s->X);
+    break;
+  case 0xC0:
+    flags_compare(s, s->Y);
+    break;
+  case 0x24:
+    s->P &= ~(FLAG_N | FLAG_V | FLAG_Z);
+    s->P |= (s->M & (FLAG_N | FLAG_V)) | ((s->A & s->M) ? 0 : FLAG_Z);
+    break;
+  case 0x06:
+  case 0x26:
+  case 0x46:
+  case 0x66:
+    s->M = flags_shift(s, opcode, s->M);
+    break;
+  case 0x0A:
+  case 0x2A:
+  case 0x4A:
+  case 0x6A:
+    s->A = flags_shift(s, opcode, s->A);
+    break;
+  case 0xE6:
+    s->P = flags_nz(s->P, ++s->M);
+    break;
+  case 0xC6:
+    s->P = flags_nz(s->P, --s->M);
+    break;
+  case 0xE8:
+    s->P = flags_nz(s->P, ++s->X);
+    break;
+  case 0xC8:
+    s->P = flags_nz(s->P, ++s->Y);
+    break;
+  case 0xCA:
+    s->P = flags_nz(s->P, --s->X);
+    break;
+  case 0x88:
+    s->P = flags_nz(s->P, --s->Y);
+    break;
+  case 0xAA:
+    s->P = flags_nz(s->P, s->X = s->A);
+    break;
+  case 0xA8:
+    s->P = flags_nz(s->P, s->Y = s->A);
+    break;
+  case 0x8A:
+    s->P = flags_nz(s->P, s->A = s->X);
+    break;
+  case 0x98:
+    s->P = flags_nz(s->P, s->A = s->Y);
+    break;
+  case 0xBA:
+    s->P = flags_nz(s->P, s->X = s->SP);
+    break;
+  case 0x18:
+    s->P &= ~FLAG_C;
+    break;
+  case 0x38:
+    s->P |= FLAG_C;
+    break;
+  case 0xB8:
+    s->P &= ~FLAG_V;
+    break;
+  case 0x58:
+    s->P &= ~0x04;
+    break;
+  case 0x78:
+    s->P |= 0x04;
+    break;
+  case 0xD8:
+    s->P &= ~0x08;
+    break;
+  case 0xF8:
+    s->P |= 0x08;
+    break;
+  case 0x68:
+    s->P = flags_nz(s->P, s->A = s->M);
+    break;
+  case 0x28:
+  case 0x40:
+    s->P = s->M & 0xCF;
+    break;
+  }
+}
+
+static Memory flags_memory;
+static CPU flags_cpu;
+
+static bool flags_branch_taken(uint8_t opcode, uint8_t p) {
+  static const uint8_t flag[] = {FLAG_N, FLAG_V, FLAG_C, FLAG_Z};
+  bool set = p & flag[opcode >> 6];
+  return (opcode & 0x20) ? set : !set;
+}
+
+// Runs each branch from the CPU's current, possibly lazy, flag state.
+static int flags_check_branches(const FlagsCase *c, uint8_t p) {
+  CPU saved = flags_cpu;
+  for (unsigned i = 0; i < sizeof(flags_branches); i++) {
+    uint8_t opcode = flags_branches[i];
+    flags_cpu.P = saved.P;
+    flags_cpu.flag_n = saved.flag_n;
+    flags_cpu.flag_z = saved.flag_z;
+    flags_cpu.flag_v = saved.flag_v;
+    flags_cpu.flag_c = saved.flag_c;
+    flags_cpu.PC = 0x0300;
+    flags_memory[0x0300] = opcode;
+    cpu_step_instruction(&flags_cpu);
+    bool taken = flags_cpu.PC == 0x0312;
+    if (taken != flags_branch_taken(opcode, p)) {
+      printf("%s then branch $%02X with P $%02X: %s\n", c->name, opcode, p,
+             taken ? "taken" : "not taken");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int flags_check(const FlagsCase *c) {
+  flags_memory[0x0200] = c->opcode;
+  flags_memory[0x0201] = c->input == INPUT_ZP ? 0x10 : 0x00;
+  flags_memory[0x0301] = 0x10;
+
+  // Inputs the instruction does not read are held at one value. With two
+  // inputs, a spread of incoming P values is enough: the flags they do not
+  // set only pass through.
+  unsigned inputs = c->input == INPUT_NONE ? 1 : 0x100;
+  unsigned step = c->input == INPUT_NONE ? 1 : 7;
+  for (unsigned p = 0; p < 0x100; p += step) {
+    for (unsigned r = 0; r < 0x100; r++) {
+      for (unsigned m = 0; m < inputs; m++) {
+        FlagsState s = {r, r, r, r, p, m};
+        flags_cpu.A = flags_cpu.X = flags_cpu.Y = r;
+        flags_cpu.SP = c->input == INPUT_STACK ? 0xF0 : r;
+        s.SP = flags_cpu.SP;
+        cpu_set_flags(&flags_cpu, p);
+        flags_cpu.PC = 0x0200;
+        flags_cpu.NMI = flags_cpu.IRQ = false;
+        if (c->input == INPUT_IMM)
+          flags_memory[0x0201] = m;
+        flags_memory[0x0010] = m;
+        flags_memory[0x01F1] = m;
+
+        cpu_step_instruction(&flags_cpu);
+        flags_expect(c->opcode, &s);
+
+        uint8_t got = cpu_flags(&flags_cpu);
+        if (got != s.P || flags_cpu.A != s.A || flags_cpu.X != s.X ||
+            flags_cpu.Y != s.Y || flags_memory[0x0010] != (uint8_t)s.M) {
+          printf("%s with A/X/Y $%02X, input $%02X, P $%02X: P $%02X, "
+                 "expected $%02X\n",
+                 c->name, r, m, p, got, s.P);
+          return 1;
+        }
+        // Branch on a spread of cases.
+        if (((r + m + p) & 0x0F) == 0 && flags_check_branches(c, s.P))
+          return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// What PHP, BRK and interrupt entries push, for every P.
+static int flags_check_pushes(void) {
+  for (unsigned p = 0; p < 0x100; p++) {
+    static const struct {
+      const char *name;
+      uint8_t opcode;
+      bool nmi;
+      uint8_t set, clear;
+    } pushes[] = {{"PHP", 0x08, false, 0x30, 0x00},
+                  {"BRK", 0x00, false, 0x30, 0x00},
+                  {"NMI", 0xEA, true, 0x20, 0x10}};
+    for (unsigned i = 0; i < 3; i++) {
+      cpu_set_flags(&flags_cpu, p);
+      flags_cpu.SP = 0xF0;
+      flags_cpu.PC = 0x0200;
+      flags_cpu.NMI = pushes[i].nmi;
+      flags_memory[0x0200] = pushes[i].opcode;
+      cpu_step_instruction(&flags_cpu);
+      uint8_t pushed = flags_memory[0x0100 | (uint8_t)(flags_cpu.SP + 1)];
+      if (pushed != ((p & ~pushes[i].clear) | pushes[i].set)) {
+        printf("%s with P $%02X pushed $%02X\n", pushes[i].name, p, pushed);
+        return 1;
+      }
+    }
+
+    cpu_set_flags(&flags_cpu, p);
+    if (cpu_flags(&flags_cpu) != p) {
+      printf("P $%02X reads back as $%02X\n", p, cpu_flags(&flags_cpu));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  cpu_init(&flags_cpu, &flags_memory);
+
+  failed |= flags_check_pushes();
+  for (unsigned i = 0; i < sizeof(flags_cases) / sizeof(*flags_cases); i++)
+    failed |= flags_check(&flags_cases[i]);
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,62 @@
+// Runs Klaus Dormann's 6502 functional test image from $0400 until it traps
+// and checks it trapped at the success address. The core has no decimal
+// mode, so the image must be assembled with disable_decimal = 1, and the
+// success address comes from that build's listing.
+//
+//   cc -O2 tests/functional.c tiny6502*.c -o functional_test
+//   ./functional_test 6502_functional_test.bin 3469
+
+#include <stdlib.h>
+
+#include "../bench/bench.h"
+
+static Memory functional_memory;
+static CPU functional_cpu;
+static BenchEngineState functional_engine;
+
+// The trap, single stepping, so a failing check is reported where it is.
+static uint16_t functional_step(const char *path) {
+  if (!bench_load_image(&functional_cpu, &functional_memory, path, 0x0400))
+    return 0;
+  for (;;) {
+    uint16_t pc = functional_cpu.PC;
+    cpu_step_instruction(&functional_cpu);
+    if (functional_cpu.PC == pc)
+      return pc;
+  }
+}
+
+static uint16_t functional_run(const char *path, BenchEngine engine) {
+  if (!bench_load_image(&functional_cpu, &functional_memory, path, 0x0400) ||
+      !bench_engine_attach(&functional_engine, &functional_cpu, engine))
+    return 0;
+  while (!bench_trapped(&functional_cpu))
+    cpu_run(&functional_cpu, 1 << 16);
+  bench_engine_detach(&functional_engine);
+  return functional_cpu.PC;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s image success-address\n", argv[0]);
+    return 2;
+  }
+  uint16_t success = strtoul(argv[2], NULL, 16);
+
+  uint16_t traps[] = {
+      functional_step(argv[1]),
+      functional_run(argv[1], ENGINE_BLOCKS),
+      functional_run(argv[1], ENGINE_JIT),
+  };
+
+  int failed = 0;
+  for (int i = 0; i < 3; i++) {
+    if (traps[i] != success) {
+      printf("%s: trapped at $%04X\n", bench_engines[i], traps[i]);
+      failed = 1;
+    }
+  }
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,145 @@
+// Checks the interrupt lines: vectors and the pushed B flag for IRQ, NMI and
+// BRK, a level IRQ shared by two sources that keeps interrupting until both
+// release it, and an edge-triggered NMI that fires once per edge, on every
+// engine.
+//
+//   cc -O2 tests/interrupt.c tiny6502*.c -o interrupt_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../bench/bench.h"
+
+//   $0200  CLI
+//   $0201  NOP
+//   $0202  JMP $0201
+static const uint8_t interrupt_program[] = {0x58, 0xEA, 0x4C, 0x01, 0x02};
+
+// IRQ and BRK count in $10, NMI in $11.
+static const uint8_t interrupt_irq[] = {0xE6, 0x10, 0x40};
+static const uint8_t interrupt_nmi[] = {0xE6, 0x11, 0x40};
+
+static Memory interrupt_memory;
+static CPU interrupt_cpu;
+static BenchEngineState interrupt_engine;
+
+static void interrupt_setup(CPUTiming timing) {
+  memset(interrupt_memory, 0, sizeof(Memory));
+  memcpy(&interrupt_memory[0x0200], interrupt_program,
+         sizeof(interrupt_program));
+  memcpy(&interrupt_memory[0x0300], interrupt_irq, sizeof(interrupt_irq));
+  memcpy(&interrupt_memory[0x0400], interrupt_nmi, sizeof(interrupt_nmi));
+  interrupt_memory[0xFFFA] = 0x00;
+  interrupt_memory[0xFFFB] = 0x04;
+  interrupt_memory[0xFFFC] = 0x00;
+  interrupt_memory[0xFFFD] = 0x02;
+  interrupt_memory[0xFFFE] = 0x00;
+  interrupt_memory[0xFFFF] = 0x03;
+  cpu_init(&interrupt_cpu, &interrupt_memory);
+  interrupt_cpu.timing = timing;
+  interrupt_cpu.SP = 0xFF;
+  cpu_step_instruction(&interrupt_cpu);
+}
+
+// One interrupt entry from the loop, as cpu_step_instruction takes it.
+static int interrupt_check_entry(const char *name, uint16_t vector, bool brk) {
+  uint8_t p = cpu_flags(&interrupt_cpu);
+
+  uint8_t cycles = cpu_step_instruction(&interrupt_cpu);
+  uint8_t pushed = interrupt_memory[0x01FD];
+  uint8_t expected = brk ? p | 0x30 : (p & 0xEF) | 0x20;
+  uint16_t ret = interrupt_memory[0x01FE] | interrupt_memory[0x01FF] << 8;
+  if (cycles != 7 || interrupt_cpu.PC != vector || pushed != expected ||
+      ret != (brk ? 0x0203 : 0x0201) || !interrupt_cpu.P.flags.I) {
+    printf("%s: %u cycles to $%04X, pushed P $%02X and $%04X\n", name, cycles,
+           interrupt_cpu.PC, pushed, ret);
+    return 1;
+  }
+  return 0;
+}
+
+static int interrupt_check_entries(CPUTiming timing) {
+  int failed = 0;
+
+  interrupt_setup(timing);
+  cpu_set_irq(&interrupt_cpu, 3, true);
+  failed |= interrupt_check_entry("IRQ", 0x0300, false);
+
+  interrupt_setup(timing);
+  cpu_set_nmi(&interrupt_cpu, 0, true);
+  failed |= interrupt_check_entry("NMI", 0x0400, false);
+
+  interrupt_setup(timing);
+  interrupt_memory[0x0201] = 0x00;
+  failed |= interrupt_check_entry("BRK", 0x0300, true);
+  return failed;
+}
+
+static void interrupt_run(uint64_t cycles) {
+  uint64_t start = interrupt_cpu.cycles;
+  while (interrupt_cpu.cycles - start < cycles)
+    cpu_run(&interrupt_cpu, cycles - (interrupt_cpu.cycles - start));
+}
+
+static int interrupt_check_lines(BenchEngine engine) {
+  interrupt_setup(engine == ENGINE_CYCLE ? CPU_TIMING_CYCLE : CPU_TIMING_FAST);
+  if (!bench_engine_attach(&interrupt_engine, &interrupt_cpu, engine))
+    return 0;
+  interrupt_run(1000);
+
+  // Each entry takes 7 cycles, INC 5 and RTI 6, and the line is still held
+  // when RTI clears I again.
+  cpu_set_irq(&interrupt_cpu, 0, true);
+  cpu_set_irq(&interrupt_cpu, 5, true);
+  interrupt_run(180);
+  uint8_t both = interrupt_memory[0x10];
+  cpu_set_irq(&interrupt_cpu, 0, false);
+  interrupt_run(180);
+  uint8_t one = interrupt_memory[0x10] - both;
+  cpu_set_irq(&interrupt_cpu, 5, false);
+  interrupt_run(36);
+  uint8_t before = interrupt_memory[0x10];
+  interrupt_run(1000);
+  uint8_t released = interrupt_memory[0x10] - before;
+
+  // A held NMI line fires once, and a second source on it adds no edge.
+  cpu_set_nmi(&interrupt_cpu, 1, true);
+  interrupt_run(500);
+  cpu_set_nmi(&interrupt_cpu, 2, true);
+  interrupt_run(500);
+  uint8_t held = interrupt_memory[0x11];
+  cpu_set_nmi(&interrupt_cpu, 1, false);
+  cpu_set_nmi(&interrupt_cpu, 2, false);
+  cpu_set_nmi(&interrupt_cpu, 2, true);
+  interrupt_run(500);
+  uint8_t edges = interrupt_memory[0x11];
+
+  // Sources past the last are ignored rather than folded onto others.
+  cpu_set_irq(&interrupt_cpu, CPU_INTERRUPT_SOURCES, true);
+  cpu_set_irq(&interrupt_cpu, 40, true);
+  cpu_set_nmi(&interrupt_cpu, 33, true);
+  bool ignored = !interrupt_cpu.IRQ && !interrupt_cpu.irq_sources &&
+                 interrupt_cpu.nmi_sources == 1 << 2;
+
+  bench_engine_detach(&interrupt_engine);
+
+  if (both < 9 || one < 9 || released || held != 1 || edges != 2 ||
+      interrupt_cpu.IRQ || interrupt_cpu.NMI || !ignored) {
+    printf("%s: %u and %u IRQs held, %u released, %u/%u NMIs%s\n",
+           bench_engines[engine], both, one, released, held, edges,
+           ignored ? "" : ", bad sources taken");
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  failed |= interrupt_check_entries(CPU_TIMING_FAST);
+  failed |= interrupt_check_entries(CPU_TIMING_CYCLE);
+  for (BenchEngine engine = ENGINE_TABLE; engine <= ENGINE_CYCLE; engine++)
+    failed |= interrupt_check_lines(engine);
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
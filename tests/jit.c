@@ -0,0 +1,179 @@
+// Checks the recompiler against the interpreter on self-modifying code, on a
+// loop that switches its own bank and raises interrupts from a device, and
+// on random programs, including the PC the device's handlers see. Built
+// with -DTINY6502_JIT_HOT=1, as jit_hot1_test is, it translates every block
+// on first use, which covers far more code in the random programs.
+//
+//   cc -O2 tests/jit.c tiny6502*.c -o jit_test
+//   cc -O2 -DTINY6502_JIT_HOT=1 tests/jit.c tiny6502*.c -o jit_hot1_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_jit.h"
+
+// Rewrites its own LDA operand on every pass.
+static const uint8_t jit_self_modifying[] = {
+    0xA9, 0x00, 0x18, 0x69, 0x03, 0x8D, 0x01, 0x02,
+    0x95, 0x10, 0xE8, 0x4C, 0x00, 0x02};
+
+// Picks the bank at $8000 from a running sum, then reads the device. The
+// banks differ after the switch, so code after it must come from the new
+// bank.
+static const uint8_t jit_banked[] = {0xA9, 0x00, 0x65, 0x10, 0x85, 0x10,
+                                     0x29, 0x03, 0x8D, 0x20, 0xD0, 0xAD,
+                                     0x10, 0xD0, 0x4C, 0x00, 0x80};
+
+// IRQ handler: counts interrupts, has the device release IRQ and returns.
+static const uint8_t jit_handler[] = {0xE6, 0x12, 0x2C, 0xFF, 0xD0, 0x40};
+
+typedef struct {
+  Memory memory;
+  uint8_t banks[4][0x1000];
+  unsigned reads;
+  // Every PC the device's handlers have seen, folded together.
+  uint32_t pcs;
+} JitSystem;
+
+static JitSystem jit_system, reference_system;
+static CPU jit_cpu, reference_cpu;
+
+static uint64_t jit_rng = 88172645463325252ull;
+
+static uint8_t jit_random(void) {
+  jit_rng ^= jit_rng << 13;
+  jit_rng ^= jit_rng >> 7;
+  jit_rng ^= jit_rng << 17;
+  return jit_rng;
+}
+
+// Every fifth read raises an IRQ, and a read of $D0FF releases it.
+static uint8_t jit_device_read(CPU *cpu, void *data, uint16_t addr) {
+  JitSystem *system = data;
+  system->pcs = system->pcs * 31 + cpu->PC;
+  if ((addr & 0xFF) == 0xFF) {
+    cpu_set_irq(cpu, 0, false);
+    cpu_set_irq(cpu, 1, false);
+    return 0;
+  }
+  if (++system->reads % 5 == 0)
+    cpu_set_irq(cpu, 0, true);
+  return system->reads + addr;
+}
+
+// Writes to $D020 select the bank at $8000.
+static void jit_device_write(CPU *cpu, void *data, uint16_t addr,
+                             uint8_t value) {
+  JitSystem *system = data;
+  system->pcs = system->pcs * 31 + cpu->PC;
+  if ((addr & 0xFF) == 0x20)
+    cpu_map_ram(cpu, 0x8000, 0x1000, system->banks[value & 3]);
+}
+
+static void jit_setup(CPU *cpu, JitSystem *system) {
+  cpu_init(cpu, &system->memory);
+  cpu_map_ram(cpu, 0x8000, 0x1000, system->banks[0]);
+  cpu_map_io(cpu, 0xD000, 0x100, jit_device_read, jit_device_write, system);
+  cpu_map_rom(cpu, 0xE000, 0x2000, system->memory + 0xE000);
+  cpu_reset(cpu);
+}
+
+static int jit_compare(const char *name, int round) {
+  CPU *a = &jit_cpu, *b = &reference_cpu;
+  if (a->PC != b->PC || a->A != b->A || a->X != b->X || a->Y != b->Y ||
+      a->SP != b->SP || cpu_flags(a) != cpu_flags(b) ||
+      a->cycles != b->cycles || a->cycles_left != b->cycles_left ||
+      a->NMI != b->NMI || a->IRQ != b->IRQ ||
+      jit_system.reads != reference_system.reads ||
+      jit_system.pcs != reference_system.pcs ||
+      memcmp(jit_system.memory, reference_system.memory, sizeof(Memory)) ||
+      memcmp(jit_system.banks, reference_system.banks,
+             sizeof(jit_system.banks))) {
+    printf("%s round %d: PC $%04X/$%04X cycles %llu/%llu\n", name, round,
+           a->PC, b->PC, (unsigned long long)a->cycles,
+           (unsigned long long)b->cycles);
+    return 1;
+  }
+  return 0;
+}
+
+// Runs the program in jit_system on both engines.
+static int jit_check(const char *name, int rounds) {
+  memcpy(&reference_system, &jit_system, sizeof(JitSystem));
+  jit_setup(&jit_cpu, &jit_system);
+  jit_setup(&reference_cpu, &reference_system);
+
+  CPUJit *jit = cpu_jit_create(&jit_cpu);
+  if (!jit) {
+    puts("no recompiler on this host");
+    return 0;
+  }
+
+  int failed = 0;
+  for (int round = 0; round < rounds && !failed; round++) {
+    uint64_t budget = 1 + jit_random() % 300;
+    uint64_t a = cpu_run(&jit_cpu, budget);
+    uint64_t b = cpu_run(&reference_cpu, budget);
+    failed = a != b || jit_compare(name, round);
+
+    if (round % 8 == 7) {
+      cpu_set_irq(&jit_cpu, 1, true);
+      cpu_set_irq(&reference_cpu, 1, true);
+    }
+    // Switching off and on again keeps the translations.
+    cpu_jit_enable(jit, round % 16 < 12);
+  }
+
+  cpu_jit_destroy(jit);
+  return failed;
+}
+
+static void jit_clear(void) {
+  memset(&jit_system, 0, sizeof(jit_system));
+  memcpy(&jit_system.memory[0x0300], jit_handler, sizeof(jit_handler));
+  jit_system.memory[0xFFFE] = 0x00;
+  jit_system.memory[0xFFFF] = 0x03;
+  jit_system.memory[0xFFFA] = 0x00;
+  jit_system.memory[0xFFFB] = 0x03;
+}
+
+int main(void) {
+  int failed = 0;
+
+  jit_clear();
+  memcpy(&jit_system.memory[0x0200], jit_self_modifying,
+         sizeof(jit_self_modifying));
+  jit_system.memory[0xFFFC] = 0x00;
+  jit_system.memory[0xFFFD] = 0x02;
+  failed |= jit_check("self-modifying", 2000);
+
+  jit_clear();
+  for (int bank = 0; bank < 4; bank++) {
+    memcpy(jit_system.banks[bank], jit_banked, sizeof(jit_banked));
+    jit_system.banks[bank][1] = bank;
+    // Odd banks replace the device read with INC $11, NOP.
+    if (bank & 1)
+      memcpy(&jit_system.banks[bank][11], "\xE6\x11\xEA", 3);
+  }
+  jit_system.memory[0xFFFC] = 0x00;
+  jit_system.memory[0xFFFD] = 0x80;
+  failed |= jit_check("banked", 2000);
+
+  for (int program = 0; program < 200; program++) {
+    for (int i = 0; i < 0x10000; i++)
+      jit_system.memory[i] = jit_random();
+    for (int bank = 0; bank < 4; bank++)
+      for (int i = 0; i < 0x1000; i++)
+        jit_system.banks[bank][i] = jit_random();
+    // Zero page pointers into the device page.
+    for (int i = 0; i < 0x100; i += 8)
+      jit_system.memory[i + 1] = 0xD0;
+    jit_system.reads = 0;
+    jit_system.pcs = 0;
+    failed |= jit_check("random", 40);
+  }
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,111 @@
+// Checks the lockstep lane engine lane by lane against cpu_run, on a loop
+// with input-dependent branches and on random programs with interrupts.
+//
+//   cc -O2 tests/lanes.c tiny6502*.c -o lanes_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_lanes.h"
+
+#define LANES 100
+
+// Shifts the input at $00 through a loop that branches on every bit.
+static const uint8_t lanes_program[] = {
+    0xA5, 0x00, 0xA2, 0x08, 0x0A, 0x90, 0x02, 0x69, 0x1D, 0x49,
+    0x5A, 0xCA, 0xD0, 0xF6, 0x85, 0x01, 0xE6, 0x00, 0x4C, 0x00, 0x02};
+
+static Memory lane_memory[LANES], scalar_memory[LANES];
+static CPU lane_cpu[LANES], scalar_cpu[LANES];
+
+static uint64_t lanes_rng = 88172645463325252ull;
+
+static uint8_t lanes_random(void) {
+  lanes_rng ^= lanes_rng << 13;
+  lanes_rng ^= lanes_rng >> 7;
+  lanes_rng ^= lanes_rng << 17;
+  return lanes_rng;
+}
+
+static int lanes_compare(const char *name, int round) {
+  for (int i = 0; i < LANES; i++) {
+    CPU *a = &lane_cpu[i], *b = &scalar_cpu[i];
+    if (a->PC != b->PC || a->A != b->A || a->X != b->X || a->Y != b->Y ||
+        a->SP != b->SP || cpu_flags(a) != cpu_flags(b) ||
+        a->cycles != b->cycles || a->cycles_left != b->cycles_left ||
+        a->NMI != b->NMI || a->IRQ != b->IRQ ||
+        memcmp(lane_memory[i], scalar_memory[i], sizeof(Memory))) {
+      printf("%s round %d lane %d: PC $%04X/$%04X cycles %llu/%llu\n", name,
+             round, i, a->PC, b->PC, (unsigned long long)a->cycles,
+             (unsigned long long)b->cycles);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int lanes_check(const char *name, int rounds) {
+  for (int i = 0; i < LANES; i++) {
+    memcpy(scalar_memory[i], lane_memory[i], sizeof(Memory));
+    cpu_init(&lane_cpu[i], &lane_memory[i]);
+    cpu_init(&scalar_cpu[i], &scalar_memory[i]);
+  }
+
+  CPULanes lanes;
+  if (!cpu_lanes_init(&lanes, lane_cpu, LANES))
+    return 1;
+
+  int failed = 0;
+  for (int round = 0; round < rounds && !failed; round++) {
+    uint64_t budget = 1 + lanes_random() % 300;
+    cpu_lanes_run(&lanes, budget);
+    for (int i = 0; i < LANES; i++)
+      cpu_run(&scalar_cpu[i], budget);
+    failed = lanes_compare(name, round);
+
+    // Odd lanes hold IRQ every other round, and some get an NMI.
+    for (int i = 1; i < LANES && round % 2 == 1; i += 2) {
+      cpu_set_irq(&lane_cpu[i], 0, round % 4 == 3);
+      cpu_set_irq(&scalar_cpu[i], 0, round % 4 == 3);
+      cpu_set_nmi(&lane_cpu[i], 0, round % 4 == 3 && i % 7 == 0);
+      cpu_set_nmi(&scalar_cpu[i], 0, round % 4 == 3 && i % 7 == 0);
+    }
+  }
+
+  cpu_lanes_free(&lanes);
+  return failed;
+}
+
+int main(void) {
+  int failed = 0;
+
+  for (int i = 0; i < LANES; i++) {
+    memset(lane_memory[i], 0, sizeof(Memory));
+    memcpy(&lane_memory[i][0x0200], lanes_program, sizeof(lanes_program));
+    lane_memory[i][0x00] = lanes_random();
+    lane_memory[i][0xFFFC] = 0x00;
+    lane_memory[i][0xFFFD] = 0x02;
+    lane_memory[i][0xFFFA] = 0x00;
+    lane_memory[i][0xFFFB] = 0x02;
+    lane_memory[i][0xFFFE] = 0x00;
+    lane_memory[i][0xFFFF] = 0x02;
+  }
+  failed |= lanes_check("loop", 200);
+
+  for (int program = 0; program < 50; program++) {
+    uint8_t code[0x10000];
+    for (int j = 0; j < 0x10000; j++)
+      code[j] = lanes_random();
+    for (int i = 0; i < LANES; i++) {
+      memcpy(lane_memory[i], code, sizeof(code));
+      for (int j = 0; j < 0x10; j++)
+        lane_memory[i][j] = lanes_random();
+    }
+    failed |= lanes_check("random", 20);
+  }
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,162 @@
+// Checks the mappers: the power-on banks and bank switching of each built in
+// type, bank numbers wrapping to the image size, a window larger than the
+// image mirroring it, writes into $8000-$FFFF reaching the mapper and not the
+// image, and registered types being found before the built in ones, newest
+// first.
+//
+//   cc -O2 tests/mapper.c tiny6502*.c -o mapper_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_mapper.h"
+
+static Memory mapper_memory;
+static CPU mapper_cpu;
+static CPUMapper mapper;
+
+// Every byte of 4 KiB unit n of the image is n.
+static uint8_t mapper_rom[0x20000];
+
+// The 4 KiB unit of the image each 4 KiB window of $8000-$FFFF shows.
+static bool mapper_expect(const char *name, const uint8_t units[8]) {
+  for (unsigned window = 0; window < 8; window++) {
+    uint16_t addr = 0x8000 + window * 0x1000;
+    // The first and last byte, so a window mapped short shows too.
+    if (cpu_read(&mapper_cpu, addr) != units[window] ||
+        cpu_read(&mapper_cpu, addr + 0xFFF) != units[window]) {
+      printf("%s: $%04X shows unit %u, expected %u\n", name, addr,
+             cpu_read(&mapper_cpu, addr), units[window]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool mapper_attach(const char *type, uint32_t rom_size) {
+  memset(mapper_memory, 0, sizeof(Memory));
+  cpu_init(&mapper_cpu, &mapper_memory);
+  return cpu_mapper_attach(&mapper, &mapper_cpu, type, mapper_rom, rom_size);
+}
+
+static int mapper_check_builtins(void) {
+  bool ok = true;
+
+  // 128 KiB: 32 units.
+  ok &= mapper_attach("flat", sizeof(mapper_rom)) &&
+        mapper_expect("flat", (const uint8_t[]){24, 25, 26, 27, 28, 29, 30,
+                                                31});
+  cpu_write(&mapper_cpu, 0x8000, 5);
+  ok &= mapper_expect("flat after a write", (const uint8_t[]){24, 25, 26, 27,
+                                                              28, 29, 30, 31});
+
+  ok &= mapper_attach("uxrom", sizeof(mapper_rom)) &&
+        mapper_expect("uxrom", (const uint8_t[]){0, 1, 2, 3, 28, 29, 30, 31});
+  cpu_write(&mapper_cpu, 0xC123, 2);
+  ok &= mapper_expect("uxrom bank 2", (const uint8_t[]){8, 9, 10, 11, 28, 29,
+                                                        30, 31});
+  // Eight 16 KiB banks, so 10 wraps to 2.
+  cpu_write(&mapper_cpu, 0x8000, 10);
+  ok &= mapper_expect("uxrom bank 10", (const uint8_t[]){8, 9, 10, 11, 28, 29,
+                                                         30, 31}) &&
+        mapper.regs[0] == 10;
+
+  ok &= mapper_attach("bank8", sizeof(mapper_rom)) &&
+        mapper_expect("bank8", (const uint8_t[]){0, 1, 2, 3, 4, 5, 6, 7});
+  cpu_write(&mapper_cpu, 0xA000, 7);
+  cpu_write(&mapper_cpu, 0xFFFF, 17);
+  ok &= mapper_expect("bank8 switched", (const uint8_t[]){0, 1, 14, 15, 4, 5,
+                                                          2, 3});
+
+  ok &= mapper_attach("bank4", sizeof(mapper_rom)) &&
+        mapper_expect("bank4", (const uint8_t[]){0, 1, 2, 3, 4, 5, 6, 7});
+  cpu_write(&mapper_cpu, 0x9FFF, 31);
+  cpu_write(&mapper_cpu, 0xE000, 33);
+  ok &= mapper_expect("bank4 switched", (const uint8_t[]){0, 31, 2, 3, 4, 5,
+                                                          1, 7});
+
+  // Writes never reach the image.
+  for (unsigned i = 0; i < sizeof(mapper_rom) && ok; i++)
+    ok = mapper_rom[i] == i >> 12;
+  if (!ok)
+    puts("built in mappers");
+  return !ok;
+}
+
+// An 8 KiB image shown in a 16 KiB uxrom window, and 4 KiB images.
+static int mapper_check_small(void) {
+  bool ok = mapper_attach("uxrom", 0x2000) &&
+            mapper_expect("uxrom mirrored", (const uint8_t[]){0, 1, 0, 1, 0, 1,
+                                                              0, 1});
+  ok &= mapper_attach("flat", 0x1000) &&
+        mapper_expect("flat mirrored", (const uint8_t[]){0, 0, 0, 0, 0, 0, 0,
+                                                         0});
+  cpu_mapper_switch(&mapper, 0x8000, 0x8000, 3);
+  ok &= mapper_expect("switch mirrored", (const uint8_t[]){0, 0, 0, 0, 0, 0,
+                                                           0, 0});
+
+  // Sizes that are not a whole number of 4 KiB units, and unknown types.
+  ok &= !mapper_attach("bank4", 0) && !mapper_attach("bank4", 0x1800) &&
+        !mapper_attach("nonesuch", 0x1000);
+  if (!ok)
+    puts("small images");
+  return !ok;
+}
+
+static unsigned mapper_resets[2];
+
+static void mapper_first_reset(CPUMapper *m) {
+  mapper_resets[0]++;
+  cpu_mapper_switch(m, 0x8000, 0x8000, 1);
+}
+
+static void mapper_second_reset(CPUMapper *m) {
+  mapper_resets[1]++;
+  cpu_mapper_switch(m, 0x8000, 0x8000, 2);
+}
+
+static const CPUMapperType mapper_first = {"bank4", mapper_first_reset, NULL};
+static const CPUMapperType mapper_second = {"bank4", mapper_second_reset,
+                                            NULL};
+static const CPUMapperType mapper_other = {"other", mapper_first_reset, NULL};
+
+static int mapper_check_registry(void) {
+  bool ok = cpu_mapper_find("bank4") != &mapper_first &&
+            cpu_mapper_register(&mapper_first) &&
+            cpu_mapper_find("bank4") == &mapper_first &&
+            cpu_mapper_register(&mapper_other) &&
+            cpu_mapper_register(&mapper_second) &&
+            cpu_mapper_find("bank4") == &mapper_second &&
+            cpu_mapper_find("other") == &mapper_other &&
+            strcmp(cpu_mapper_find("uxrom")->name, "uxrom") == 0;
+
+  // The newest "bank4" is the one attached.
+  ok &= mapper_attach("bank4", sizeof(mapper_rom)) && mapper_resets[1] == 1 &&
+        !mapper_resets[0] &&
+        mapper_expect("registered", (const uint8_t[]){16, 17, 18, 19, 20, 21,
+                                                      22, 23});
+
+  // The registry fills up.
+  unsigned registered = 3;
+  while (registered < 100 && cpu_mapper_register(&mapper_other))
+    registered++;
+  ok &= registered > 3 && registered < 100 &&
+        cpu_mapper_find("bank4") == &mapper_second;
+  if (!ok)
+    puts("registry");
+  return !ok;
+}
+
+int main(void) {
+  for (unsigned i = 0; i < sizeof(mapper_rom); i++)
+    mapper_rom[i] = i >> 12;
+
+  int failed = 0;
+  failed |= mapper_check_builtins();
+  failed |= mapper_check_small();
+  failed |= mapper_check_registry();
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,152 @@
+// Checks the profiler on nested subroutine calls with an NMI arriving in the
+// innermost one: the folded call chains, the flat profile's hottest
+// address, and that cpu_run, with a block cache attached, and the cycle
+// engine profile the same as single steps. Needs the profiler compiled in:
+//
+//   cc -O2 -DTINY6502_PROFILE tests/profile.c tiny6502*.c -o profile_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_blocks.h"
+#include "../tiny6502_profile.h"
+
+#ifndef TINY6502_PROFILE
+#error "build with -DTINY6502_PROFILE"
+#endif
+
+//   $0200  JSR $0300
+//   $0203  JSR $0300
+//   $0206  JMP $0206
+//   $0300  JSR $0400
+//   $0303  RTS
+//   $0400  LDX #$05
+//   $0402  DEX
+//   $0403  BNE $0402
+//   $0405  RTS
+//   $0500  RTI            NMI handler
+static const uint8_t profile_main[] = {0x20, 0x00, 0x03, 0x20, 0x00,
+                                       0x03, 0x4C, 0x06, 0x02};
+static const uint8_t profile_outer[] = {0x20, 0x00, 0x04, 0x60};
+static const uint8_t profile_inner[] = {0xA2, 0x05, 0xCA, 0xD0, 0xFD, 0x60};
+
+// Fast timing charges BNE 4 cycles whether taken or not.
+static const char profile_folded[] = "$0200 12\n"
+                                     "$0200;$0300 24\n"
+                                     "$0200;$0300;$0400 83\n"
+                                     "$0200;$0300;$0400;$0500 6\n";
+
+static Memory profile_memory;
+static CPU profile_cpu;
+static CPUProfile profile, reference;
+static CPUBlockCache profile_blocks;
+
+static void profile_setup(CPUTiming timing) {
+  memset(profile_memory, 0, sizeof(Memory));
+  memcpy(&profile_memory[0x0200], profile_main, sizeof(profile_main));
+  memcpy(&profile_memory[0x0300], profile_outer, sizeof(profile_outer));
+  memcpy(&profile_memory[0x0400], profile_inner, sizeof(profile_inner));
+  profile_memory[0x0500] = 0x40;
+  profile_memory[0xFFFA] = 0x00;
+  profile_memory[0xFFFB] = 0x05;
+  profile_memory[0xFFFC] = 0x00;
+  profile_memory[0xFFFD] = 0x02;
+  cpu_init(&profile_cpu, &profile_memory);
+  profile_cpu.timing = timing;
+  profile_cpu.SP = 0xFF;
+  cpu_profile_init(&profile);
+  cpu_profile_attach(&profile_cpu, &profile);
+}
+
+// Runs to the final loop, raising NMI after the third instruction.
+static void profile_step(void) {
+  for (int step = 0; profile_cpu.PC != 0x0206; step++) {
+    if (step == 3)
+      cpu_set_nmi(&profile_cpu, 0, true);
+    cpu_step_instruction(&profile_cpu);
+  }
+}
+
+// As profile_step, in runs of a few cycles. The NMI goes in as the third
+// instruction completes.
+static void profile_run(void) {
+  cpu_run(&profile_cpu, 14);
+  cpu_set_nmi(&profile_cpu, 0, true);
+  while (profile_cpu.PC != 0x0206)
+    cpu_run(&profile_cpu, 1);
+}
+
+static int profile_same(const char *name) {
+  if (memcmp(profile.pc, reference.pc, sizeof(profile.pc)) ||
+      memcmp(profile.opcode, reference.opcode, sizeof(profile.opcode)) ||
+      profile.node_count != reference.node_count ||
+      memcmp(profile.nodes, reference.nodes,
+             profile.node_count * sizeof(*profile.nodes))) {
+    printf("%s: profiles differ\n", name);
+    return 1;
+  }
+  return 0;
+}
+
+static int profile_check_output(void) {
+  char text[512] = {0};
+  FILE *out = tmpfile();
+  if (!out)
+    return 1;
+  cpu_profile_fold(&profile, out);
+  rewind(out);
+  size_t size = fread(text, 1, sizeof(text) - 1, out);
+  text[size] = 0;
+  if (strcmp(text, profile_folded)) {
+    printf("folded:\n%s", text);
+    fclose(out);
+    return 1;
+  }
+
+  // The branch is the hottest address, 10 runs of 4 cycles.
+  rewind(out);
+  cpu_profile_print(&profile, out, 1);
+  rewind(out);
+  char line[128];
+  bool found = false;
+  if (fgets(line, sizeof(line), out) && fgets(line, sizeof(line), out)) {
+    unsigned long long cycles, count;
+    double share;
+    unsigned addr;
+    found = sscanf(line, "%llu %lf%% %llu $%X", &cycles, &share, &count,
+                   &addr) == 4 &&
+            cycles == 40 && count == 10 && addr == 0x0403;
+  }
+  fclose(out);
+  if (!found) {
+    printf("flat: %s", line);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+
+  profile_setup(CPU_TIMING_FAST);
+  profile_step();
+  failed |= profile_check_output();
+  memcpy(&reference, &profile, sizeof(profile));
+
+  profile_setup(CPU_TIMING_FAST);
+  cpu_blocks_attach(&profile_blocks, &profile_cpu);
+  profile_run();
+  cpu_blocks_detach(&profile_blocks);
+  failed |= profile_same("cpu_run");
+
+  profile_setup(CPU_TIMING_EXACT);
+  profile_step();
+  memcpy(&reference, &profile, sizeof(profile));
+  profile_setup(CPU_TIMING_CYCLE);
+  profile_step();
+  failed |= profile_same("cycle");
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
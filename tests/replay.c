@@ -0,0 +1,210 @@
+// Records a program driven by a timer IRQ, an I/O device that hands out
+// numbers, acknowledges the IRQ and pulses NMI, and an NMI the host toggles
+// between runs, then plays the log back into the machine with the devices
+// replaced by dead ones and checks it ends in the same state, on each engine
+// and timing, and that playback notices a program that does something else.
+//
+//   cc -O2 tests/replay.c tiny6502*.c -o replay_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../bench/bench.h"
+#include "../tiny6502_replay.h"
+
+//   $0200  CLI
+//   $0201  LDA $D000
+//   $0204  STA $0400,X
+//   $0207  INX
+//   $0208  STA $D001
+//   $020B  JMP $0201
+static const uint8_t replay_program[] = {0x58, 0xAD, 0x00, 0xD0, 0x9D, 0x00,
+                                         0x04, 0xE8, 0x8D, 0x01, 0xD0, 0x4C,
+                                         0x01, 0x02};
+
+// IRQ: PHA; LDA $D002; INC $10; PLA; RTI. NMI: INC $11; RTI.
+static const uint8_t replay_irq[] = {0x48, 0xAD, 0x02, 0xD0,
+                                     0xE6, 0x10, 0x68, 0x40};
+static const uint8_t replay_nmi[] = {0xE6, 0x11, 0x40};
+
+#define REPLAY_RUNS 200
+#define REPLAY_RUN_CYCLES 1000
+
+typedef struct {
+  Memory memory;
+  CPU cpu;
+  CPUScheduler scheduler;
+  int timer;
+  uint32_t seed;
+
+  // Inputs the live devices and the host gave the machine.
+  unsigned inputs;
+} ReplaySystem;
+
+static ReplaySystem replay_recorded, replay_played;
+static BenchEngineState replay_engine;
+
+static void replay_timer(CPU *cpu, void *data, uint64_t cycle) {
+  ReplaySystem *system = data;
+  system->inputs++;
+  cpu_set_irq(cpu, 0, true);
+  cpu_scheduler_at(&system->scheduler, system->timer, cycle + 97);
+}
+
+static uint8_t replay_read(CPU *cpu, void *data, uint16_t addr) {
+  ReplaySystem *system = data;
+  system->inputs++;
+  if (addr == 0xD002) {
+    system->inputs++;
+    cpu_set_irq(cpu, 0, false);
+    return 0;
+  }
+  system->seed = system->seed * 1103515245 + 12345;
+  return system->seed >> 16;
+}
+
+static void replay_write(CPU *cpu, void *data, uint16_t addr, uint8_t value) {
+  ReplaySystem *system = data;
+  (void)addr;
+  system->inputs++;
+  if ((value & 0x1F) == 0) {
+    system->inputs += 2;
+    cpu_set_nmi(cpu, 0, true);
+    cpu_set_nmi(cpu, 0, false);
+  }
+}
+
+// Stand-ins for playback, which must not matter.
+static uint8_t replay_dead_read(CPU *cpu, void *data, uint16_t addr) {
+  (void)data;
+  (void)addr;
+  cpu_set_irq(cpu, 0, true);
+  return 0xEE;
+}
+
+static void replay_dead_write(CPU *cpu, void *data, uint16_t addr,
+                              uint8_t value) {
+  (void)data;
+  (void)addr;
+  (void)value;
+  cpu_set_nmi(cpu, 3, true);
+}
+
+static void replay_setup(ReplaySystem *system, CPUTiming timing, bool live) {
+  memset(system->memory, 0, sizeof(Memory));
+  memcpy(&system->memory[0x0200], replay_program, sizeof(replay_program));
+  memcpy(&system->memory[0x0300], replay_irq, sizeof(replay_irq));
+  memcpy(&system->memory[0x0310], replay_nmi, sizeof(replay_nmi));
+  system->memory[0xFFFA] = 0x10;
+  system->memory[0xFFFB] = 0x03;
+  system->memory[0xFFFC] = 0x00;
+  system->memory[0xFFFD] = 0x02;
+  system->memory[0xFFFE] = 0x00;
+  system->memory[0xFFFF] = 0x03;
+  cpu_init(&system->cpu, &system->memory);
+  system->cpu.timing = timing;
+  system->cpu.SP = 0xFF;
+  system->seed = 1;
+  system->inputs = 0;
+  if (live)
+    cpu_map_io(&system->cpu, 0xD000, 0x100, replay_read, replay_write, system);
+  else
+    cpu_map_io(&system->cpu, 0xD000, 0x100, replay_dead_read,
+               replay_dead_write, system);
+
+  cpu_scheduler_init(&system->scheduler, &system->cpu);
+  system->timer = cpu_scheduler_add(&system->scheduler, replay_timer, system);
+  cpu_scheduler_at(&system->scheduler, system->timer, 97);
+}
+
+static void replay_record(CPUTiming timing, FILE *log) {
+  ReplaySystem *system = &replay_recorded;
+  replay_setup(system, timing, true);
+  CPUReplay replay;
+  cpu_replay_record(&replay, &system->cpu, log);
+  for (int run = 0; run < REPLAY_RUNS; run++) {
+    cpu_scheduler_run(&system->scheduler, REPLAY_RUN_CYCLES);
+    cpu_set_nmi(&system->cpu, 1, run % 3 == 0);
+    system->inputs++;
+  }
+  cpu_replay_stop(&replay);
+}
+
+// Plays the log back on engine, which must have the timing it was recorded
+// with.
+static int replay_play(BenchEngine engine, FILE *log, bool alter) {
+  const char *name = alter ? "altered" : bench_engines[engine];
+  ReplaySystem *system = &replay_played;
+  replay_setup(system, CPU_TIMING_FAST, false);
+  if (alter)
+    system->memory[0x0209] = 0x03;
+  if (!bench_engine_attach(&replay_engine, &system->cpu, engine))
+    return 0;
+
+  rewind(log);
+  CPUReplay replay;
+  cpu_replay_play(&replay, &system->cpu, log);
+  cpu_replay_run(&replay, replay_recorded.cpu.cycles);
+  bool playing = replay.playing;
+  cpu_replay_stop(&replay);
+
+  bench_engine_detach(&replay_engine);
+
+  if (alter) {
+    if (!replay.diverged ||
+        system->cpu.cycles >= replay_recorded.cpu.cycles) {
+      printf("%s: altered program not noticed or not stopped\n", name);
+      return 1;
+    }
+    return 0;
+  }
+
+  const CPU *a = &replay_recorded.cpu, *b = &system->cpu;
+  if (replay.diverged || playing ||
+      memcmp(replay_recorded.memory, system->memory, sizeof(Memory)) ||
+      a->cycles != b->cycles || a->PC != b->PC || a->A != b->A ||
+      a->X != b->X || a->SP != b->SP || cpu_flags(a) != cpu_flags(b) ||
+      a->IRQ != b->IRQ || a->NMI != b->NMI ||
+      a->irq_sources != b->irq_sources || a->nmi_sources != b->nmi_sources) {
+    printf("%s: %s, %llu/%llu cycles, %u/%u IRQs, %u/%u NMIs\n", name,
+           replay.diverged ? "diverged" : "differs",
+           (unsigned long long)b->cycles, (unsigned long long)a->cycles,
+           system->memory[0x10], replay_recorded.memory[0x10],
+           system->memory[0x11], replay_recorded.memory[0x11]);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  FILE *log = tmpfile();
+  if (!log)
+    return 1;
+
+  replay_record(CPU_TIMING_FAST, log);
+  long size = ftell(log);
+  if (replay_recorded.memory[0x10] == 0 || replay_recorded.memory[0x11] == 0 ||
+      size <= 0 || size > 4 * (long)replay_recorded.inputs) {
+    printf("recording: %u IRQs, %u NMIs, %ld bytes for %u inputs\n",
+           replay_recorded.memory[0x10], replay_recorded.memory[0x11], size,
+           replay_recorded.inputs);
+    failed = 1;
+  }
+  for (BenchEngine engine = ENGINE_TABLE; engine <= ENGINE_JIT; engine++)
+    failed |= replay_play(engine, log, false);
+  failed |= replay_play(ENGINE_TABLE, log, true);
+  fclose(log);
+
+  for (BenchEngine engine = ENGINE_EXACT; engine <= ENGINE_CYCLE; engine++) {
+    if (!(log = tmpfile()))
+      return 1;
+    replay_record(engine == ENGINE_EXACT ? CPU_TIMING_EXACT : CPU_TIMING_CYCLE,
+                  log);
+    failed |= replay_play(engine, log, false);
+    fclose(log);
+  }
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,124 @@
+// Runs the page copy workload with rewinding on, then jumps back to random
+// cycles in the window, steps back instruction by instruction and runs on
+// again, checking each state against a fresh machine run straight to the same
+// cycle. Covers the interpreter, the recompiler, whose pages the rewind has
+// to invalidate, and cycle timing.
+//
+//   cc -O2 tests/rewind.c tiny6502*.c -o rewind_test
+
+#include "../bench/bench.h"
+
+#include "../tiny6502_jit.h"
+#include "../tiny6502_rewind.h"
+
+#define REWIND_CYCLES 200000
+#define REWIND_INTERVAL 5000
+#define REWIND_FRAMES 16
+
+static Memory rewind_memory, rewind_reference_memory;
+static CPU rewind_cpu, rewind_reference;
+
+// Every instruction boundary of the workload, in cycles from reset.
+static uint64_t rewind_boundaries[1 << 18];
+static unsigned rewind_boundary_count;
+
+static void rewind_find_boundaries(void) {
+  bench_load(&rewind_reference, &rewind_reference_memory, &bench_memcpy);
+  rewind_boundary_count = 0;
+  while (rewind_reference.cycles < 2 * REWIND_CYCLES) {
+    rewind_boundaries[rewind_boundary_count++] = rewind_reference.cycles;
+    cpu_step_instruction(&rewind_reference);
+  }
+}
+
+// Where going back to cycle should land.
+static uint64_t rewind_expected(uint64_t cycle, CPUTiming timing) {
+  if (timing == CPU_TIMING_CYCLE)
+    return cycle;
+  unsigned low = 0, high = rewind_boundary_count;
+  while (high - low > 1) {
+    unsigned mid = (low + high) / 2;
+    if (rewind_boundaries[mid] <= cycle)
+      low = mid;
+    else
+      high = mid;
+  }
+  return rewind_boundaries[low];
+}
+
+static bool rewind_matches(const char *label, uint64_t cycle) {
+  bench_load(&rewind_reference, &rewind_reference_memory, &bench_memcpy);
+  rewind_reference.timing = rewind_cpu.timing;
+  if (cycle)
+    cpu_run(&rewind_reference, cycle);
+
+  const CPU *a = &rewind_cpu, *b = &rewind_reference;
+  if (a->cycles != cycle || b->cycles != cycle || a->PC != b->PC ||
+      a->A != b->A || a->X != b->X || a->Y != b->Y || a->SP != b->SP ||
+      cpu_flags(a) != cpu_flags(b) || a->cycle.cycle != b->cycle.cycle ||
+      memcmp(rewind_memory, rewind_reference_memory, sizeof(Memory))) {
+    printf("%s: at %llu, expected %llu\n", label,
+           (unsigned long long)a->cycles, (unsigned long long)cycle);
+    return false;
+  }
+  return true;
+}
+
+static int rewind_check(const char *name, CPUTiming timing, bool jit_on) {
+  bench_load(&rewind_cpu, &rewind_memory, &bench_memcpy);
+  rewind_cpu.timing = timing;
+  CPUJit *jit = jit_on ? cpu_jit_create(&rewind_cpu) : NULL;
+  CPURewind *rewind =
+      cpu_rewind_create(&rewind_cpu, REWIND_INTERVAL, REWIND_FRAMES, 0);
+  if (!rewind)
+    return 1;
+
+  int failed = 0;
+  cpu_rewind_run(rewind, REWIND_CYCLES);
+  uint64_t oldest = cpu_rewind_oldest(rewind);
+  if (oldest + REWIND_FRAMES * (REWIND_INTERVAL + 10) < rewind_cpu.cycles ||
+      oldest > rewind_cpu.cycles - (REWIND_FRAMES - 1) * REWIND_INTERVAL ||
+      cpu_rewind_to(rewind, oldest - 1) ||
+      cpu_rewind_to(rewind, rewind_cpu.cycles + 1)) {
+    printf("%s: window from %llu at %llu\n", name, (unsigned long long)oldest,
+           (unsigned long long)rewind_cpu.cycles);
+    failed = 1;
+  }
+
+  uint32_t seed = 1;
+  for (int jump = 0; jump < 20 && !failed; jump++) {
+    seed = seed * 1103515245 + 12345;
+    uint64_t span = rewind_cpu.cycles - oldest + 1;
+    uint64_t target = oldest + (seed >> 8) % span;
+    if (!cpu_rewind_to(rewind, target) ||
+        !rewind_matches(name, rewind_expected(target, timing)))
+      failed = 1;
+
+    // History carries on from where the machine went back to.
+    cpu_rewind_run(rewind, REWIND_INTERVAL / 2 + (seed & 0xFFF));
+    if (!rewind_matches(name, rewind_expected(rewind_cpu.cycles, timing)))
+      failed = 1;
+  }
+
+  for (int step = 0; step < 200 && !failed; step++) {
+    uint64_t cycles = rewind_cpu.cycles;
+    if (!cpu_rewind_step_back(rewind) ||
+        !rewind_matches(name, rewind_expected(cycles - 1, timing)))
+      failed = 1;
+  }
+
+  cpu_rewind_destroy(rewind);
+  cpu_jit_destroy(jit);
+  return failed;
+}
+
+int main(void) {
+  rewind_find_boundaries();
+  int failed = 0;
+  failed |= rewind_check("table", CPU_TIMING_FAST, false);
+  failed |= rewind_check("jit", CPU_TIMING_FAST, true);
+  failed |= rewind_check("cycle", CPU_TIMING_CYCLE, false);
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,236 @@
+// Runs a program against a periodic timer raising IRQs and a one-shot timer
+// that the program rearms through a device register, and checks that one
+// long scheduler run dispatches every event at the same cycle as runs of a
+// single instruction (or, under CPU_TIMING_CYCLE, a single cycle) polling
+// between each, on the interpreter, the block cache and the recompiler. Also
+// checks that breakpoints and watchpoints end a scheduler run.
+//
+//   cc -O2 tests/scheduler.c tiny6502*.c -o scheduler_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_blocks.h"
+#include "../tiny6502_debug.h"
+#include "../tiny6502_jit.h"
+#include "../tiny6502_scheduler.h"
+
+//   $0200  CLI
+//   $0201  LDX #$00
+//   $0203  INX
+//   $0204  TXA
+//   $0205  AND #$1F
+//   $0207  ORA #$01
+//   $0209  STA $D000      one-shot in A cycles
+//   $020C  LDY #$08
+//   $020E  DEY
+//   $020F  BNE $020E
+//   $0211  JMP $0203
+static const uint8_t scheduler_program[] = {
+    0x58, 0xA2, 0x00, 0xE8, 0x8A, 0x29, 0x1F, 0x09, 0x01, 0x8D,
+    0x00, 0xD0, 0xA0, 0x08, 0x88, 0xD0, 0xFD, 0x4C, 0x03, 0x02};
+
+// Interrupts count in $12 and copy the one-shot count to $13.
+static const uint8_t scheduler_handler[] = {0xE6, 0x12, 0xAD, 0x01,
+                                            0xD0, 0x85, 0x13, 0x40};
+
+#define SCHEDULER_PERIOD 100
+#define SCHEDULER_BUDGET 200000
+#define SCHEDULER_LOG 8192
+
+typedef struct {
+  uint64_t due, at;
+} SchedulerDispatch;
+
+typedef struct {
+  Memory memory;
+  CPU cpu;
+  CPUScheduler scheduler;
+  int timer, oneshot;
+  unsigned fired;
+
+  SchedulerDispatch log[SCHEDULER_LOG];
+  unsigned logged;
+} SchedulerSystem;
+
+static SchedulerSystem scheduler_reference, scheduler_system;
+static CPUBlockCache scheduler_blocks;
+static CPUDebug scheduler_debug;
+
+static void scheduler_log(SchedulerSystem *system, uint64_t due) {
+  if (system->logged < SCHEDULER_LOG)
+    system->log[system->logged] = (SchedulerDispatch){due, system->cpu.cycles};
+  system->logged++;
+}
+
+static void scheduler_timer(CPU *cpu, void *data, uint64_t cycle) {
+  SchedulerSystem *system = data;
+  scheduler_log(system, cycle);
+  cpu_set_irq(cpu, 0, true);
+  cpu_scheduler_at(&system->scheduler, system->timer,
+                   cycle + SCHEDULER_PERIOD);
+}
+
+// Every eighth one-shot pulses NMI.
+static void scheduler_oneshot(CPU *cpu, void *data, uint64_t cycle) {
+  SchedulerSystem *system = data;
+  scheduler_log(system, cycle);
+  cpu_set_nmi(cpu, 0, ++system->fired % 8 == 0);
+}
+
+// Reading the count releases the timer's IRQ.
+static uint8_t scheduler_read(CPU *cpu, void *data, uint16_t addr) {
+  (void)addr;
+  SchedulerSystem *system = data;
+  cpu_set_irq(cpu, 0, false);
+  return system->fired;
+}
+
+static void scheduler_write(CPU *cpu, void *data, uint16_t addr,
+                            uint8_t value) {
+  (void)addr;
+  SchedulerSystem *system = data;
+  cpu_scheduler_at(&system->scheduler, system->oneshot, cpu->cycles + value);
+}
+
+static void scheduler_setup(SchedulerSystem *system, CPUTiming timing) {
+  memset(system->memory, 0, sizeof(Memory));
+  memcpy(&system->memory[0x0200], scheduler_program,
+         sizeof(scheduler_program));
+  memcpy(&system->memory[0x0300], scheduler_handler,
+         sizeof(scheduler_handler));
+  system->memory[0xFFFA] = system->memory[0xFFFE] = 0x00;
+  system->memory[0xFFFB] = system->memory[0xFFFF] = 0x03;
+  system->memory[0xFFFC] = 0x00;
+  system->memory[0xFFFD] = 0x02;
+  cpu_init(&system->cpu, &system->memory);
+  system->cpu.timing = timing;
+  system->cpu.SP = 0xFF;
+  cpu_map_io(&system->cpu, 0xD000, 0x100, scheduler_read, scheduler_write,
+             system);
+
+  cpu_scheduler_init(&system->scheduler, &system->cpu);
+  system->timer = cpu_scheduler_add(&system->scheduler, scheduler_timer, system);
+  system->oneshot =
+      cpu_scheduler_add(&system->scheduler, scheduler_oneshot, system);
+  cpu_scheduler_at(&system->scheduler, system->timer, SCHEDULER_PERIOD);
+  system->fired = 0;
+  system->logged = 0;
+}
+
+static int scheduler_compare(const char *name, uint64_t consumed,
+                             uint64_t expected) {
+  SchedulerSystem *a = &scheduler_system, *b = &scheduler_reference;
+  bool same = consumed == expected && a->logged == b->logged &&
+              a->cpu.cycles == b->cpu.cycles && a->cpu.PC == b->cpu.PC &&
+              !memcmp(a->memory, b->memory, sizeof(Memory));
+  unsigned logged = a->logged < SCHEDULER_LOG ? a->logged : SCHEDULER_LOG;
+  for (unsigned i = 0; same && i < logged; i++)
+    same = a->log[i].due == b->log[i].due && a->log[i].at == b->log[i].at;
+  if (!same) {
+    printf("%s: %u/%u events, %llu/%llu cycles\n", name, a->logged,
+           b->logged, (unsigned long long)consumed,
+           (unsigned long long)expected);
+    return 1;
+  }
+  return 0;
+}
+
+// Polls between single instructions, or single cycles, and records how late
+// any event was dispatched.
+static uint64_t scheduler_run_reference(CPUTiming timing, uint64_t *late) {
+  scheduler_setup(&scheduler_reference, timing);
+  uint64_t consumed = 0;
+  while (consumed < SCHEDULER_BUDGET)
+    consumed += cpu_scheduler_run(&scheduler_reference.scheduler, 1);
+
+  *late = 0;
+  for (unsigned i = 0; i < scheduler_reference.logged; i++) {
+    const SchedulerDispatch *d = &scheduler_reference.log[i];
+    if (d->at - d->due > *late)
+      *late = d->at - d->due;
+  }
+  return consumed;
+}
+
+static int scheduler_check(CPUTiming timing, const char *name) {
+  uint64_t late;
+  uint64_t expected = scheduler_run_reference(timing, &late);
+  int failed = 0;
+
+  // Both timers must have kept running, and under CPU_TIMING_CYCLE no event
+  // may be late at all.
+  if (scheduler_reference.logged < SCHEDULER_BUDGET / SCHEDULER_PERIOD * 2 ||
+      scheduler_reference.memory[0x12] == 0 ||
+      late > (timing == CPU_TIMING_CYCLE ? 0 : 8)) {
+    printf("%s reference: %u events, %u interrupts, %llu cycles late\n", name,
+           scheduler_reference.logged, scheduler_reference.memory[0x12],
+           (unsigned long long)late);
+    failed = 1;
+  }
+
+  scheduler_setup(&scheduler_system, timing);
+  uint64_t consumed =
+      cpu_scheduler_run(&scheduler_system.scheduler, SCHEDULER_BUDGET);
+  failed |= scheduler_compare(name, consumed, expected);
+  if (timing != CPU_TIMING_FAST)
+    return failed;
+
+  scheduler_setup(&scheduler_system, timing);
+  cpu_blocks_attach(&scheduler_blocks, &scheduler_system.cpu);
+  consumed = cpu_scheduler_run(&scheduler_system.scheduler, SCHEDULER_BUDGET);
+  cpu_blocks_detach(&scheduler_blocks);
+  failed |= scheduler_compare("blocks", consumed, expected);
+
+  scheduler_setup(&scheduler_system, timing);
+  CPUJit *jit = cpu_jit_create(&scheduler_system.cpu);
+  if (jit) {
+    consumed =
+        cpu_scheduler_run(&scheduler_system.scheduler, SCHEDULER_BUDGET);
+    cpu_jit_destroy(jit);
+    failed |= scheduler_compare("jit", consumed, expected);
+  }
+  return failed;
+}
+
+// A breakpoint on the interrupt handler, then a watchpoint on the count it
+// stores, each stop the run where they hit rather than running past to the
+// end of the budget.
+static int scheduler_check_debug(CPUTiming timing, const char *name) {
+  scheduler_setup(&scheduler_system, timing);
+  CPU *cpu = &scheduler_system.cpu;
+  CPUScheduler *scheduler = &scheduler_system.scheduler;
+  if (!cpu_debug_attach(&scheduler_debug, cpu))
+    return 1;
+  cpu_debug_break(&scheduler_debug, 0x0300);
+  uint64_t consumed = cpu_scheduler_run(scheduler, SCHEDULER_BUDGET);
+  bool broke = consumed < SCHEDULER_BUDGET && cpu->PC == 0x0300 &&
+               scheduler_debug.stop.reason == CPU_STOP_BREAK;
+
+  cpu_debug_clear(&scheduler_debug, 0x0300);
+  cpu_debug_watch(&scheduler_debug, 0x13, 1, false, true);
+  consumed += cpu_scheduler_run(scheduler, SCHEDULER_BUDGET);
+  bool watched = consumed < SCHEDULER_BUDGET && cpu->PC == 0x0307 &&
+                 scheduler_debug.stop.reason == CPU_STOP_WRITE &&
+                 scheduler_debug.stop.addr == 0x13;
+  cpu_debug_detach(&scheduler_debug);
+  if (!broke || !watched) {
+    printf("%s debug: stopped at $%04X after %llu cycles\n", name, cpu->PC,
+           (unsigned long long)consumed);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  failed |= scheduler_check(CPU_TIMING_FAST, "fast");
+  failed |= scheduler_check(CPU_TIMING_EXACT, "exact");
+  failed |= scheduler_check(CPU_TIMING_CYCLE, "cycle");
+  failed |= scheduler_check_debug(CPU_TIMING_FAST, "fast");
+  failed |= scheduler_check_debug(CPU_TIMING_CYCLE, "cycle");
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,157 @@
+// Checks the copy-on-write snapshots: random programs, run under both timing
+// models from a snapshot taken mid-run, must come back to the snapshot's
+// registers and memory on every restore and then repeat the same run; a
+// second snapshot taken later still restores after the first one has been;
+// ROM pages are not tracked; and a CPU with no watcher free refuses a
+// snapshot.
+//
+//   cc -O2 tests/snapshot.c tiny6502*.c -o snapshot_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_snapshot.h"
+
+typedef struct {
+  Memory memory;
+  CPU cpu;
+} SnapshotMachine;
+
+static Memory snapshot_memory;
+static CPU snapshot_cpu;
+static CPUSnapshot snapshot_first, snapshot_second;
+
+// The machine when each snapshot was taken, and at the end of a run.
+static SnapshotMachine snapshot_start, snapshot_middle, snapshot_end;
+
+// $E000-$FFFF, mapped as ROM.
+static uint8_t snapshot_rom[0x2000];
+
+static uint64_t snapshot_rng = 88172645463325252ull;
+
+static uint8_t snapshot_random(void) {
+  snapshot_rng ^= snapshot_rng << 13;
+  snapshot_rng ^= snapshot_rng >> 7;
+  snapshot_rng ^= snapshot_rng << 17;
+  return snapshot_rng;
+}
+
+static void snapshot_keep(SnapshotMachine *machine) {
+  memcpy(machine->memory, snapshot_memory, sizeof(Memory));
+  machine->cpu = snapshot_cpu;
+}
+
+static int snapshot_compare(const SnapshotMachine *machine,
+                            const char *name) {
+  const CPU *a = &snapshot_cpu, *b = &machine->cpu;
+  if (memcmp(snapshot_memory, machine->memory, sizeof(Memory)) ||
+      a->cycles != b->cycles || a->cycles_left != b->cycles_left ||
+      a->PC != b->PC || a->A != b->A || a->X != b->X || a->Y != b->Y ||
+      a->SP != b->SP || cpu_flags(a) != cpu_flags(b) ||
+      a->cycle.cycle != b->cycle.cycle || a->cycle.opcode != b->cycle.opcode ||
+      a->cycle.data != b->cycle.data || a->cycle.base != b->cycle.base ||
+      a->cycle.addr != b->cycle.addr) {
+    printf("%s: differs at cycle %llu, PC $%04X, expected $%04X\n", name,
+           (unsigned long long)a->cycles, a->PC, b->PC);
+    return 1;
+  }
+  return 0;
+}
+
+static void snapshot_setup(CPUTiming timing) {
+  for (int i = 0; i < 0x10000; i++)
+    snapshot_memory[i] = snapshot_random();
+  for (int i = 0; i < 0x2000; i++)
+    snapshot_rom[i] = snapshot_random();
+  cpu_init(&snapshot_cpu, &snapshot_memory);
+  cpu_map_rom(&snapshot_cpu, 0xE000, 0x2000, snapshot_rom);
+  snapshot_cpu.timing = timing;
+  cpu_reset(&snapshot_cpu);
+  // Odd budgets leave the cycle engine part way through an instruction.
+  cpu_run(&snapshot_cpu, 1 + snapshot_random());
+}
+
+static int snapshot_check_random(CPUTiming timing, const char *name) {
+  for (int program = 0; program < 100; program++) {
+    snapshot_setup(timing);
+    if (!cpu_snapshot_take(&snapshot_first, &snapshot_cpu) ||
+        snapshot_first.host[0xDF] != &snapshot_memory[0xDF00] ||
+        snapshot_first.host[0xE0] || snapshot_first.host[0xFF]) {
+      printf("%s: snapshot not taken or ROM tracked\n", name);
+      return 1;
+    }
+    snapshot_keep(&snapshot_start);
+
+    uint64_t budget = 1 + snapshot_random() * 4;
+    for (int restore = 0; restore < 3; restore++) {
+      cpu_run(&snapshot_cpu, budget);
+      if (restore == 0)
+        snapshot_keep(&snapshot_end);
+      else if (snapshot_compare(&snapshot_end, name))
+        return 1;
+      cpu_snapshot_restore(&snapshot_first);
+      if (snapshot_compare(&snapshot_start, name))
+        return 1;
+    }
+
+    // A second snapshot part way through the same run. Restoring the first
+    // rewrites pages the second tracks, which must save them first.
+    cpu_run(&snapshot_cpu, budget / 2);
+    if (!cpu_snapshot_take(&snapshot_second, &snapshot_cpu)) {
+      printf("%s: no second snapshot\n", name);
+      return 1;
+    }
+    snapshot_keep(&snapshot_middle);
+    while (snapshot_cpu.cycles < snapshot_end.cpu.cycles)
+      cpu_run(&snapshot_cpu, snapshot_end.cpu.cycles - snapshot_cpu.cycles);
+    if (snapshot_compare(&snapshot_end, name))
+      return 1;
+    cpu_snapshot_restore(&snapshot_first);
+    if (snapshot_compare(&snapshot_start, name))
+      return 1;
+    cpu_snapshot_restore(&snapshot_second);
+    if (snapshot_compare(&snapshot_middle, name))
+      return 1;
+
+    cpu_snapshot_release(&snapshot_second);
+    cpu_snapshot_release(&snapshot_first);
+    if (snapshot_cpu.pages.watch[0x00] || snapshot_cpu.pages.watch[0xDF] ||
+        snapshot_cpu.pages.write[0xDF] != &snapshot_memory[0xDF00]) {
+      printf("%s: pages still watched after release\n", name);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void snapshot_ignore(CPU *cpu, void *data, uint16_t addr,
+                            uint8_t value) {
+  (void)cpu;
+  (void)data;
+  (void)addr;
+  (void)value;
+}
+
+// With every watcher taken a snapshot is refused, and releasing it is safe.
+static int snapshot_check_full(void) {
+  snapshot_setup(CPU_TIMING_FAST);
+  while (cpu_watch_add(&snapshot_cpu, snapshot_ignore, NULL) >= 0)
+    ;
+  if (cpu_snapshot_take(&snapshot_first, &snapshot_cpu)) {
+    puts("snapshot taken with no watcher free");
+    return 1;
+  }
+  cpu_snapshot_release(&snapshot_first);
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  failed |= snapshot_check_random(CPU_TIMING_FAST, "fast");
+  failed |= snapshot_check_random(CPU_TIMING_CYCLE, "cycle");
+  failed |= snapshot_check_full();
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,126 @@
+// Saves a machine with every register, both interrupt lines held and memory
+// that needs each page encoding, to a buffer and to a file, loads both into a
+// fresh machine and compares, and checks where the header puts the source
+// masks and the cycle count; then checks that other versions, a bad magic, a
+// bad page tag, a truncated state and a short buffer are all refused.
+//
+//   cc -O2 tests/state.c tiny6502*.c -o state_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_state.h"
+
+static Memory state_memory, state_loaded_memory;
+static CPU state_cpu, state_loaded;
+static uint8_t state_buffer[CPU_STATE_MAX_SIZE];
+
+static void state_setup(void) {
+  memset(state_memory, 0, sizeof(Memory));
+  // Runs at $0200, bytes with no runs at $0300 and a single value at $FF00.
+  for (unsigned i = 0; i < 0x100; i++) {
+    state_memory[0x0200 + i] = i / 16;
+    state_memory[0x0300 + i] = i * 13 + 7;
+    state_memory[0xFF00 + i] = 0xA5;
+  }
+  cpu_init(&state_cpu, &state_memory);
+  state_cpu.PC = 0x1234;
+  state_cpu.SP = 0xC7;
+  state_cpu.A = 0x11;
+  state_cpu.X = 0x22;
+  state_cpu.Y = 0x33;
+  cpu_set_flags(&state_cpu, 0xC3);
+  state_cpu.cycles = 0x0123456789ABull;
+  state_cpu.cycles_left = 5;
+  cpu_set_irq(&state_cpu, 3, true);
+  cpu_set_irq(&state_cpu, 6, true);
+  cpu_set_nmi(&state_cpu, 1, true);
+}
+
+static bool state_same(const char *what) {
+  const CPU *a = &state_cpu, *b = &state_loaded;
+  if (memcmp(state_memory, state_loaded_memory, sizeof(Memory)) ||
+      a->PC != b->PC || a->SP != b->SP || a->A != b->A || a->X != b->X ||
+      a->Y != b->Y || cpu_flags(a) != cpu_flags(b) || a->cycles != b->cycles ||
+      a->cycles_left != b->cycles_left || a->IRQ != b->IRQ ||
+      a->NMI != b->NMI || a->irq_sources != b->irq_sources ||
+      a->nmi_sources != b->nmi_sources) {
+    printf("%s: loaded state differs\n", what);
+    return false;
+  }
+  return true;
+}
+
+// Loads the buffer into a machine whose memory and registers are all wrong.
+static bool state_load(size_t size) {
+  memset(state_loaded_memory, 0xEE, sizeof(Memory));
+  cpu_init(&state_loaded, &state_loaded_memory);
+  return cpu_state_load_buffer(&state_loaded, state_buffer, size);
+}
+
+int main(void) {
+  int failed = 0;
+  state_setup();
+
+  size_t size =
+      cpu_state_save_buffer(&state_cpu, state_buffer, sizeof(state_buffer));
+  // Each zero page takes its tag, the runs at $0200 16 pairs, $0300 all 256
+  // bytes and $FF00 one pair.
+  if (size != 25 + 253 + (1 + 32) + (1 + 0x100) + (1 + 2) ||
+      !state_load(size) || !state_same("buffer"))
+    failed = 1;
+
+  // The source masks side by side, then the cycle count.
+  uint64_t cycles = 0;
+  for (int i = 0; i < 8; i++)
+    cycles |= (uint64_t)state_buffer[17 + i] << (8 * i);
+  if (state_buffer[15] != 0x48 || state_buffer[16] != 0x02 ||
+      cycles != state_cpu.cycles) {
+    puts("header laid out wrongly");
+    failed = 1;
+  }
+
+  FILE *file = tmpfile();
+  if (!file || cpu_state_save(&state_cpu, file) != size) {
+    puts("file: not saved");
+    failed = 1;
+  } else {
+    rewind(file);
+    memset(state_loaded_memory, 0xEE, sizeof(Memory));
+    cpu_init(&state_loaded, &state_loaded_memory);
+    if (!cpu_state_load(&state_loaded, file) || !state_same("file"))
+      failed = 1;
+  }
+  if (file)
+    fclose(file);
+
+  // Every version but this one is refused, 0 included.
+  static const uint16_t versions[] = {0, CPU_STATE_VERSION - 1,
+                                      CPU_STATE_VERSION + 1, 0xFFFF};
+  for (size_t i = 0; i < sizeof(versions) / sizeof(versions[0]); i++) {
+    state_buffer[4] = versions[i] & 0xFF;
+    state_buffer[5] = versions[i] >> 8;
+    if (state_load(size)) {
+      printf("version %u accepted\n", versions[i]);
+      failed = 1;
+    }
+  }
+  state_buffer[4] = CPU_STATE_VERSION & 0xFF;
+  state_buffer[5] = CPU_STATE_VERSION >> 8;
+
+  state_buffer[0] = 'X';
+  bool magic = state_load(size);
+  state_buffer[0] = 'T';
+  state_buffer[25] = 3;
+  bool tag = state_load(size);
+  state_buffer[25] = 0;
+  if (magic || tag || state_load(size - 1) || !state_load(size) ||
+      cpu_state_save_buffer(&state_cpu, state_buffer, size - 1)) {
+    puts("bad state accepted or good one refused");
+    failed = 1;
+  }
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,142 @@
+// Checks the threaded interpreter against the table interpreter, both with
+// tracing on: random programs, with a device page that counts its reads, run
+// through cpu_run in random slices and single stepped to the same cycle must
+// agree on registers, memory, device reads and the trace. Also checks that
+// tracing code fetched from a device reads each opcode once, on the threaded
+// interpreter and on the cycle engine.
+//
+// Built against a library with TINY6502_THREADED and TINY6502_TRACE, so that
+// cpu_run takes the threaded interpreter while cpu_step_instruction keeps to
+// the table.
+//
+//   cc -O2 -DTINY6502_THREADED -DTINY6502_TRACE tests/threaded.c tiny6502*.c
+//      -o threaded_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_trace.h"
+
+#define THREADED_TRACE 64
+
+typedef struct {
+  Memory memory;
+  unsigned reads;
+  CPUTrace trace;
+  CPUTraceEntry entries[THREADED_TRACE];
+} ThreadedSystem;
+
+static ThreadedSystem threaded_system, reference_system;
+static CPU threaded_cpu, reference_cpu;
+
+static uint64_t threaded_rng = 88172645463325252ull;
+
+static uint8_t threaded_random(void) {
+  threaded_rng ^= threaded_rng << 13;
+  threaded_rng ^= threaded_rng >> 7;
+  threaded_rng ^= threaded_rng << 17;
+  return threaded_rng;
+}
+
+// Serves the page from memory, counting reads.
+static uint8_t threaded_device_read(CPU *cpu, void *data, uint16_t addr) {
+  (void)cpu;
+  ThreadedSystem *system = data;
+  system->reads++;
+  return system->memory[addr];
+}
+
+static void threaded_setup(CPU *cpu, ThreadedSystem *system, CPUTiming timing,
+                           const ThreadedSystem *from) {
+  if (system != from)
+    memcpy(system->memory, from->memory, sizeof(Memory));
+  system->reads = 0;
+  cpu_init(cpu, &system->memory);
+  cpu->timing = timing;
+  cpu_map_io(cpu, 0xD000, 0x100, threaded_device_read, NULL, system);
+  cpu_trace_init(&system->trace, system->entries, THREADED_TRACE);
+  cpu_trace_attach(cpu, &system->trace);
+  cpu_reset(cpu);
+}
+
+static int threaded_compare(const char *name) {
+  const CPU *a = &threaded_cpu, *b = &reference_cpu;
+  if (memcmp(threaded_system.memory, reference_system.memory,
+             sizeof(Memory)) ||
+      a->cycles != b->cycles || a->PC != b->PC || a->A != b->A ||
+      a->X != b->X || a->Y != b->Y || a->SP != b->SP ||
+      cpu_flags(a) != cpu_flags(b) ||
+      threaded_system.reads != reference_system.reads ||
+      threaded_system.trace.count != reference_system.trace.count ||
+      memcmp(threaded_system.entries, reference_system.entries,
+             sizeof(threaded_system.entries))) {
+    printf("%s: differs at cycle %llu, PC $%04X/$%04X, %u/%u device reads\n",
+           name, (unsigned long long)b->cycles, a->PC, b->PC,
+           threaded_system.reads, reference_system.reads);
+    return 1;
+  }
+  return 0;
+}
+
+static int threaded_check_random(void) {
+  for (int program = 0; program < 200; program++) {
+    for (int i = 0; i < 0x10000; i++)
+      threaded_system.memory[i] = threaded_random();
+    // Zero page pointers into the device page.
+    for (int i = 0; i < 0x100; i += 8)
+      threaded_system.memory[i + 1] = 0xD0;
+    threaded_setup(&threaded_cpu, &threaded_system, CPU_TIMING_FAST,
+                   &threaded_system);
+    threaded_setup(&reference_cpu, &reference_system, CPU_TIMING_FAST,
+                   &threaded_system);
+
+    for (int slice = 0; slice < 40; slice++) {
+      cpu_run(&threaded_cpu, 1 + threaded_random() % 300);
+      while (reference_cpu.cycles < threaded_cpu.cycles)
+        cpu_step_instruction(&reference_cpu);
+      if (threaded_compare("random"))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+// NOPs from $D000 to a JMP $D000 at $D0FD: every fetch reads the device.
+static int threaded_check_fetches(CPUTiming timing, const char *name) {
+  memset(threaded_system.memory, 0xEA, sizeof(Memory));
+  memcpy(&threaded_system.memory[0xD0FD], "\x4C\x00\xD0", 3);
+  threaded_system.memory[0xFFFC] = 0x00;
+  threaded_system.memory[0xFFFD] = 0xD0;
+
+  unsigned reads[2];
+  for (int traced = 0; traced < 2; traced++) {
+    threaded_setup(&threaded_cpu, &threaded_system, timing, &threaded_system);
+    if (!traced)
+      cpu_trace_attach(&threaded_cpu, NULL);
+    while (threaded_cpu.cycles < 10000)
+      cpu_run(&threaded_cpu, 10000 - threaded_cpu.cycles);
+    reads[traced] = threaded_system.reads;
+  }
+
+  const CPUTraceEntry *last =
+      &threaded_system.entries[(threaded_system.trace.count - 1) &
+                               (THREADED_TRACE - 1)];
+  if (reads[1] != reads[0] ||
+      last->opcode != threaded_system.memory[last->PC]) {
+    printf("%s: %u device reads traced, %u untraced, $%02X traced at $%04X\n",
+           name, reads[1], reads[0], last->opcode, last->PC);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  failed |= threaded_check_random();
+  failed |= threaded_check_fetches(CPU_TIMING_FAST, "threaded fetches");
+  failed |= threaded_check_fetches(CPU_TIMING_CYCLE, "cycle fetches");
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,139 @@
+// Checks the cycles charged for page crossings and branches under both
+// timing models, and that cpu_run, with and without a block cache,
+// cpu_step_instruction and cpu_step_cycle agree under exact timing.
+//
+//   cc -O2 tests/timing.c tiny6502*.c -o timing_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_blocks.h"
+
+typedef struct {
+  const char *name;
+  uint16_t at;
+  uint8_t code[3];
+  uint8_t X, Y;
+  bool zero; // Z before the instruction
+  uint8_t exact, fast;
+} TimingCase;
+
+// $10 points at $20F0.
+static const TimingCase timing_cases[] = {
+    {"LDA abs,X", 0x0200, {0xBD, 0xF0, 0x20}, 0x0F, 0, false, 4, 5},
+    {"LDA abs,X crossing", 0x0200, {0xBD, 0xF0, 0x20}, 0x10, 0, false, 5, 5},
+    {"LDX abs,Y crossing", 0x0200, {0xBE, 0xFF, 0x20}, 0, 0x01, false, 5, 5},
+    {"LDA (zp),Y", 0x0200, {0xB1, 0x10}, 0, 0x0F, false, 5, 6},
+    {"LDA (zp),Y crossing", 0x0200, {0xB1, 0x10}, 0, 0x10, false, 6, 6},
+    {"STA abs,X", 0x0200, {0x9D, 0xF0, 0x20}, 0x0F, 0, false, 5, 5},
+    {"STA (zp),Y", 0x0200, {0x91, 0x10}, 0, 0x0F, false, 6, 6},
+    {"INC abs,X", 0x0200, {0xFE, 0xF0, 0x20}, 0x0F, 0, false, 7, 7},
+    {"BNE not taken", 0x0200, {0xD0, 0x10}, 0, 0, true, 2, 4},
+    {"BNE taken", 0x0200, {0xD0, 0x10}, 0, 0, false, 3, 4},
+    {"BNE taken backwards", 0x0210, {0xD0, 0xF0}, 0, 0, false, 3, 4},
+    {"BNE taken crossing", 0x0200, {0xD0, 0xF0}, 0, 0, false, 4, 4},
+    {"BNE taken forwards crossing", 0x02F0, {0xD0, 0x10}, 0, 0, false, 4, 4},
+    // The page that counts is the one after the branch, not the branch's.
+    {"BNE at page end", 0x02FE, {0xD0, 0x05}, 0, 0, false, 3, 4},
+};
+
+static Memory timing_memory;
+static CPU timing_cpu;
+static CPUBlockCache timing_blocks;
+
+static int timing_check(const TimingCase *c, CPUTiming timing) {
+  memset(timing_memory, 0, sizeof(Memory));
+  memcpy(&timing_memory[c->at], c->code, sizeof(c->code));
+  timing_memory[0x10] = 0xF0;
+  timing_memory[0x11] = 0x20;
+  cpu_init(&timing_cpu, &timing_memory);
+  timing_cpu.timing = timing;
+  timing_cpu.PC = c->at;
+  timing_cpu.X = c->X;
+  timing_cpu.Y = c->Y;
+  cpu_set_flags(&timing_cpu, c->zero ? 0x02 : 0x00);
+
+  uint8_t expected = timing == CPU_TIMING_EXACT ? c->exact : c->fast;
+  uint8_t cycles = cpu_step_instruction(&timing_cpu);
+  if (cycles != expected || timing_cpu.cycles != expected) {
+    printf("%s, %s timing: %u cycles, expected %u\n", c->name,
+           timing == CPU_TIMING_EXACT ? "exact" : "fast", cycles, expected);
+    return 1;
+  }
+  return 0;
+}
+
+// A loop over a table straddling a page, with a taken branch crossing a
+// page on every pass:
+//
+//   $02F8  LDY #$00
+//   $02FA  LDA $30F0,Y
+//   $02FD  STA $10,X
+//   $02FF  INY
+//   $0300  INX
+//   $0301  BNE $02FA
+static const uint8_t timing_loop[] = {0xA0, 0x00, 0xB9, 0xF0, 0x30, 0x95,
+                                      0x10, 0xC8, 0xE8, 0xD0, 0xF7};
+
+static void timing_loop_setup(void) {
+  memset(timing_memory, 0, sizeof(Memory));
+  memcpy(&timing_memory[0x02F8], timing_loop, sizeof(timing_loop));
+  timing_memory[0xFFFC] = 0xF8;
+  timing_memory[0xFFFD] = 0x02;
+  cpu_init(&timing_cpu, &timing_memory);
+  timing_cpu.timing = CPU_TIMING_EXACT;
+}
+
+static int timing_check_engines(void) {
+  // 2 for LDY, 255 passes of 16 ending in a branch across a page, a last
+  // pass of 14 that falls through, and a cycle for each of the 240 reads
+  // past $30FF.
+  const uint64_t expected = 2 + 255 * 16 + 14 + 240;
+  uint64_t step_cycles = 0;
+
+  timing_loop_setup();
+  while (timing_cpu.PC != 0x0303)
+    step_cycles += cpu_step_instruction(&timing_cpu);
+
+  timing_loop_setup();
+  uint64_t cycle_cycles = 0;
+  while (timing_cpu.PC != 0x0303 || timing_cpu.cycles_left) {
+    cpu_step_cycle(&timing_cpu);
+    cycle_cycles++;
+  }
+
+  timing_loop_setup();
+  uint64_t run_cycles = cpu_run(&timing_cpu, expected);
+  bool run_done = timing_cpu.PC == 0x0303;
+
+  // The cache only implements fast timing, so cpu_run must pass it by.
+  timing_loop_setup();
+  cpu_blocks_attach(&timing_blocks, &timing_cpu);
+  uint64_t block_cycles = cpu_run(&timing_cpu, expected);
+  bool block_done = timing_cpu.PC == 0x0303;
+  cpu_blocks_detach(&timing_blocks);
+
+  if (step_cycles != expected || cycle_cycles != expected ||
+      run_cycles != expected || block_cycles != expected || !run_done ||
+      !block_done) {
+    printf("loop: %llu/%llu/%llu/%llu cycles, expected %llu\n",
+           (unsigned long long)step_cycles, (unsigned long long)cycle_cycles,
+           (unsigned long long)run_cycles, (unsigned long long)block_cycles,
+           (unsigned long long)expected);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  for (unsigned i = 0; i < sizeof(timing_cases) / sizeof(*timing_cases); i++) {
+    failed |= timing_check(&timing_cases[i], CPU_TIMING_EXACT);
+    failed |= timing_check(&timing_cases[i], CPU_TIMING_FAST);
+  }
+  failed |= timing_check_engines();
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,126 @@
+// Checks the trace ring: a small ring that has wrapped holds the newest
+// entries of a large one, oldest first, whether printed or saved and decoded;
+// the text mode writes what the ring would hold; and entries print in the
+// documented format. Needs tracing compiled in:
+//
+//   cc -O2 -DTINY6502_TRACE tests/trace.c tiny6502*.c -o trace_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../tiny6502.h"
+#include "../tiny6502_trace.h"
+
+#ifndef TINY6502_TRACE
+#error "build with -DTINY6502_TRACE"
+#endif
+
+//   $0200  LDA #$42
+//   $0202  LDY #$07
+//   $0204  INX
+//   $0205  JMP $0204
+static const uint8_t trace_program[] = {0xA9, 0x42, 0xA0, 0x07,
+                                        0xE8, 0x4C, 0x04, 0x02};
+
+#define TRACE_STEPS 21
+#define TRACE_SMALL 8
+
+static Memory trace_memory;
+static CPU trace_cpu;
+static CPUTraceEntry trace_large_entries[32], trace_small_entries[TRACE_SMALL];
+static CPUTrace trace_large, trace_small;
+
+static const char trace_expected[] =
+    "         0 $0200 LDA(IMM)  A:00 X:00 Y:00 SP:FD P:24\n"
+    "         2 $0202 LDY(IMM)  A:42 X:00 Y:00 SP:FD P:24\n"
+    "         4 $0204 INX(IMP)  A:42 X:00 Y:07 SP:FD P:24\n"
+    "         6 $0205 JMP(ABS)  A:42 X:01 Y:07 SP:FD P:24\n";
+
+// Runs the program with trace attached, from power on.
+static void trace_run(CPUTrace *trace) {
+  memset(trace_memory, 0, sizeof(Memory));
+  memcpy(&trace_memory[0x0200], trace_program, sizeof(trace_program));
+  trace_memory[0xFFFC] = 0x00;
+  trace_memory[0xFFFD] = 0x02;
+  cpu_init(&trace_cpu, &trace_memory);
+  trace_cpu.SP = 0xFD;
+  cpu_set_flags(&trace_cpu, 0x24);
+  cpu_trace_attach(&trace_cpu, trace);
+  for (int i = 0; i < TRACE_STEPS; i++)
+    cpu_step_instruction(&trace_cpu);
+}
+
+// Everything written to file, which is then closed.
+static const char *trace_text(FILE *file) {
+  static char text[4096];
+  rewind(file);
+  size_t size = fread(text, 1, sizeof(text) - 1, file);
+  text[size] = 0;
+  fclose(file);
+  return text;
+}
+
+static const char *trace_printed(const CPUTrace *trace) {
+  FILE *file = tmpfile();
+  cpu_trace_print(trace, file);
+  return trace_text(file);
+}
+
+int main(void) {
+  int failed = 0;
+
+  cpu_trace_init(&trace_small, trace_small_entries, TRACE_SMALL);
+  if (cpu_trace_size(&trace_small) || *trace_printed(&trace_small)) {
+    puts("empty ring not empty");
+    failed = 1;
+  }
+
+  cpu_trace_init(&trace_large, trace_large_entries, 32);
+  trace_run(&trace_large);
+  char large[4096];
+  strcpy(large, trace_printed(&trace_large));
+  if (cpu_trace_size(&trace_large) != TRACE_STEPS ||
+      strncmp(large, trace_expected, strlen(trace_expected))) {
+    printf("large ring:\n%s", large);
+    failed = 1;
+  }
+
+  // The last TRACE_SMALL lines of the large ring.
+  const char *newest = large;
+  for (int i = 0; i < TRACE_STEPS - TRACE_SMALL && strchr(newest, '\n'); i++)
+    newest = strchr(newest, '\n') + 1;
+
+  trace_run(&trace_small);
+  if (trace_small.count != TRACE_STEPS ||
+      cpu_trace_size(&trace_small) != TRACE_SMALL ||
+      strcmp(trace_printed(&trace_small), newest)) {
+    printf("wrapped ring:\n%s", trace_printed(&trace_small));
+    failed = 1;
+  }
+
+  FILE *saved = tmpfile();
+  FILE *decoded = tmpfile();
+  if (cpu_trace_save(&trace_small, saved) != TRACE_SMALL) {
+    puts("wrapped ring not saved");
+    failed = 1;
+  }
+  rewind(saved);
+  cpu_trace_decode(saved, decoded);
+  fclose(saved);
+  if (strcmp(trace_text(decoded), newest)) {
+    puts("decoded ring differs");
+    failed = 1;
+  }
+
+  // Text mode stores nothing and writes every entry.
+  cpu_trace_init(&trace_small, trace_small_entries, TRACE_SMALL);
+  trace_small.text = tmpfile();
+  trace_run(&trace_small);
+  if (trace_small.count || strcmp(trace_text(trace_small.text), large)) {
+    puts("text mode differs");
+    failed = 1;
+  }
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
@@ -0,0 +1,140 @@
+// Checks the benchmark workloads compute what they should on every engine:
+// the page copy, the sort and the CRC after a long cpu_run finished off to
+// the end of a pass, and the interrupt program servicing every timer tick.
+// The alu, addressing mode and mixed loops are compared with the table
+// interpreter.
+//
+//   cc -O2 tests/workloads.c tiny6502*.c -o workloads_test
+
+#include "../bench/bench.h"
+
+#define WORKLOAD_CYCLES 1000000
+
+static Memory workload_memory, workload_reference;
+static CPU workload_cpu;
+static BenchEngineState workload_engine;
+
+// Loads the workload with a pattern at $1000-$13FF for the copy.
+static void workload_load(const BenchWorkload *workload) {
+  bench_load(&workload_cpu, &workload_memory, workload);
+  for (unsigned i = 0; i < 0x400; i++)
+    workload_memory[0x1000 + i] = i * 7 + (i >> 8);
+}
+
+// Runs the workload and steps one more instruction, which under
+// CPU_TIMING_CYCLE finishes any the run stopped inside.
+static void workload_run(const BenchWorkload *workload, BenchEngine engine) {
+  workload_load(workload);
+  bench_engine_attach(&workload_engine, &workload_cpu, engine);
+  uint64_t cycles = 0;
+  while (cycles < WORKLOAD_CYCLES)
+    cycles += cpu_run(&workload_cpu, WORKLOAD_CYCLES - cycles);
+  cpu_step_instruction(&workload_cpu);
+  bench_engine_detach(&workload_engine);
+}
+
+// As workload_run, then on to the start of the next pass.
+static void workload_finish(const BenchWorkload *workload,
+                            BenchEngine engine) {
+  workload_run(workload, engine);
+  while (workload_cpu.PC != workload->origin)
+    cpu_step_instruction(&workload_cpu);
+}
+
+static uint16_t workload_crc(const uint8_t *data, size_t size) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i] << 8;
+    for (int bit = 0; bit < 8; bit++)
+      crc = crc & 0x8000 ? crc << 1 ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static int workload_check_results(BenchEngine engine) {
+  const char *name = bench_engines[engine];
+  int failed = 0;
+
+  workload_finish(&bench_memcpy, engine);
+  if (memcmp(&workload_memory[0x2000], &workload_memory[0x1000], 0x400)) {
+    printf("%s: memcpy\n", name);
+    failed = 1;
+  }
+
+  workload_finish(&bench_sort, engine);
+  for (unsigned i = 0; i < 0x40; i++) {
+    if (workload_memory[0x0300 + i] != i) {
+      printf("%s: sort, $%02X at $%04X\n", name, workload_memory[0x0300 + i],
+             0x0300 + i);
+      failed = 1;
+      break;
+    }
+  }
+
+  workload_finish(&bench_crc, engine);
+  uint16_t crc = workload_memory[0x10] | workload_memory[0x11] << 8;
+  uint16_t expected = workload_crc(&workload_memory[0x0200], 0x100);
+  if (crc != expected) {
+    printf("%s: crc $%04X, expected $%04X\n", name, crc, expected);
+    failed = 1;
+  }
+  return failed;
+}
+
+// Single steps the table interpreter, with the engine's timing, to the cycle
+// the engine stopped at, and compares.
+static int workload_check_same(BenchEngine engine) {
+  static const BenchWorkload *const workloads[] = {&bench_alu, &bench_modes,
+                                                   &bench_mixed};
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+    workload_run(workloads[i], engine);
+    memcpy(workload_reference, workload_memory, sizeof(Memory));
+    CPU cpu = workload_cpu;
+
+    workload_load(workloads[i]);
+    workload_cpu.timing = cpu.timing;
+    while (workload_cpu.cycles < cpu.cycles)
+      cpu_step_instruction(&workload_cpu);
+    if (memcmp(workload_reference, workload_memory, sizeof(Memory)) ||
+        workload_cpu.cycles != cpu.cycles || workload_cpu.PC != cpu.PC ||
+        workload_cpu.A != cpu.A || workload_cpu.X != cpu.X ||
+        workload_cpu.Y != cpu.Y || workload_cpu.SP != cpu.SP ||
+        cpu_flags(&workload_cpu) != cpu_flags(&cpu)) {
+      printf("%s: %s differs\n", bench_engines[engine], workloads[i]->name);
+      failed = 1;
+    }
+  }
+  return failed;
+}
+
+// Every tick is serviced before the next, so $10 counts them all, bar one
+// still pending.
+static int workload_check_interrupts(BenchEngine engine) {
+  BenchTimer timer;
+  bench_timer_load(&timer, &workload_cpu, &workload_memory, 64);
+  bench_engine_attach(&workload_engine, &workload_cpu, engine);
+  uint64_t cycles = cpu_scheduler_run(&timer.scheduler, WORKLOAD_CYCLES);
+  bench_engine_detach(&workload_engine);
+
+  uint8_t lag = cycles / 64 - workload_memory[0x10];
+  if (lag > 1) {
+    printf("%s: %u interrupts in %llu cycles\n", bench_engines[engine],
+           workload_memory[0x10], (unsigned long long)cycles);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  for (BenchEngine engine = ENGINE_TABLE; engine <= ENGINE_CYCLE; engine++) {
+    failed |= workload_check_results(engine);
+    if (engine != ENGINE_TABLE)
+      failed |= workload_check_same(engine);
+    failed |= workload_check_interrupts(engine);
+  }
+
+  puts(failed ? "FAIL" : "ok");
+  return failed;
+}
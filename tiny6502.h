@@ -12,9 +12,9 @@ typedef struct {
   uint8_t I : 1; // Interrupt Disable
   uint8_t D : 1; // Decimal
   uint8_t B : 1; // Break
+  uint8_t _ : 1; // Unused
   uint8_t V : 1; // Overflow
   uint8_t N : 1; // Negative
-  uint8_t _ : 1; // Unused
 } CPUFlagsStruct;
 
 typedef union {
@@ -22,19 +22,153 @@ typedef union {
   uint8_t reg;
 } CPUFlags;
 
+typedef struct CPU CPU;
+
+// How instructions are charged. CPU_TIMING_FAST charges every instruction
+// its worst case: indexed reads always pay the page-crossing cycle and
+// branches always pay for being taken across a page. CPU_TIMING_EXACT
+// charges those cycles only when they happen, as the hardware does.
+//
+// CPU_TIMING_CYCLE charges exact timing too, but runs each instruction as
+// its individual bus cycles, in the order and with the dummy reads and
+// writes of an NMOS 6502: cpu_step_cycle() performs a single bus access,
+// CPU.cycles advances cycle by cycle and CPU.on_cycle sees every access.
+//
+// The slower modes run on the table interpreter: cpu_run bypasses the
+// threaded interpreter, the block cache and the recompiler, which only
+// implement fast timing. Lanes always charge fast timing.
+typedef enum {
+  CPU_TIMING_FAST,
+  CPU_TIMING_EXACT,
+  CPU_TIMING_CYCLE,
+} CPUTiming;
+
+// Handlers for pages that are not plain host memory. data is the pointer
+// given when the handler was mapped.
+typedef uint8_t (*CPUReadHandler)(CPU *cpu, void *data, uint16_t addr);
+typedef void (*CPUWriteHandler)(CPU *cpu, void *data, uint16_t addr,
+                                uint8_t value);
+
+typedef struct {
+  CPUReadHandler read;
+  CPUWriteHandler write;
+  void *read_data, *write_data;
+} CPUPageHandler;
+
+// Called after every bus cycle under CPU_TIMING_CYCLE with the address, the
+// byte read or written and the direction. CPU.cycles is the cycle's number.
+typedef void (*CPUCycleHandler)(CPU *cpu, void *data, uint16_t addr,
+                                uint8_t value, bool write);
+
+typedef struct {
+  CPUCycleHandler handler;
+  void *data;
+} CPUCycleWatcher;
+
+// Progress through the current instruction under CPU_TIMING_CYCLE.
+typedef struct {
+  uint8_t opcode;
+  uint8_t cycle; // bus cycles done so far, 0 between instructions
+  bool interrupt; // entering an interrupt rather than running opcode
+  bool taken; // a branch's condition held
+  uint8_t data; // the operand or value being modified
+  uint16_t base; // an address before indexing, a pointer or a vector
+  uint16_t addr; // the effective address
+  uint16_t pc; // where the instruction started, kept when profiling
+} CPUCycleState;
+
+// The address space as 256 pages of 256 bytes. A page with a host pointer is
+// accessed directly; a NULL pointer routes the access to the page's handler.
+// Unmapped pages read as $FF and ignore writes.
 typedef struct {
+  const uint8_t *read[0x100];
+  uint8_t *write[0x100];
+  CPUPageHandler handler[0x100];
+
+  // The RAM behind each page, kept while writes to the page are watched and
+  // its write pointer is NULL.
+  uint8_t *ram[0x100];
+
+  // Bit n is set while watcher n watches the page.
+  uint8_t watch[0x100];
+} CPUBus;
+
+#define CPU_WATCHERS 8
+
+// Devices that may share an interrupt line.
+#define CPU_INTERRUPT_SOURCES 8
+
+typedef struct {
+  CPUWriteHandler write;
+  void *data;
+  bool stores; // called for CPU writes only, not for remaps
+} CPUWatcher;
+
+struct CPU {
   uint16_t PC;
   uint8_t SP;
   uint8_t A, X, Y;
+
+  // The status register. Instructions set N, Z, V and C with plain stores to
+  // the fields below instead of read-modify-writes of P, and the packed
+  // value is only built when something looks at it: use cpu_flags() and
+  // cpu_set_flags(). P keeps I, D, B and the unused bit; its other bits are
+  // stale. N is bit 7 of flag_n, Z is set while flag_z is zero, V is bit 7
+  // of flag_v and C is flag_c, which is 0 or 1.
   CPUFlags P;
+  uint8_t flag_n, flag_z, flag_v, flag_c;
 
+  // Interrupt inputs, best driven with cpu_set_irq() and cpu_set_nmi(). IRQ
+  // is the level of the IRQ line. NMI is latched by an edge on the NMI line
+  // and cleared when the CPU takes the interrupt. Bit n of each mask is set
+  // while source n holds its line.
   bool NMI;
   bool IRQ;
+  uint8_t irq_sources, nmi_sources;
 
   uint8_t cycles_left;
+  uint64_t cycles;
+
+  // Where the current cpu_run() stops, see cpu_stop_at().
+  uint64_t deadline;
+
+  // CPU_TIMING_FAST after cpu_init; may be changed between instructions.
+  CPUTiming timing;
+
+  // Only used under CPU_TIMING_CYCLE, see tiny6502_cycle.c.
+  CPUCycleWatcher on_cycle;
+  CPUCycleState cycle;
 
   Memory *memory;
-} CPU;
+
+  // Points at pages; instructions always go through this pointer so that
+  // engines running on a copy of the registers share the real page tables.
+  CPUBus *bus;
+
+  // Only consulted when built with TINY6502_TRACE, see tiny6502_trace.h.
+  struct CPUTrace *trace;
+
+  // Only consulted when built with TINY6502_PROFILE, see tiny6502_profile.h.
+  struct CPUProfile *profile;
+
+  // Only consulted on the I/O paths and by cpu_set_irq() and cpu_set_nmi(),
+  // see tiny6502_replay.h.
+  struct CPUReplay *replay;
+
+  // Only consulted by cpu_run, and before each instruction only while it
+  // holds breakpoints, see tiny6502_debug.h.
+  struct CPUDebug *debug;
+
+  // Only consulted by cpu_run, see tiny6502_blocks.h.
+  struct CPUBlockCache *blocks;
+
+  // Only consulted by cpu_run, see tiny6502_jit.h.
+  struct CPUJit *jit;
+
+  CPUWatcher watchers[CPU_WATCHERS];
+
+  CPUBus pages;
+};
 
 uint8_t cpu_read(CPU *cpu, uint16_t addr);
 void cpu_write(CPU *cpu, uint16_t addr, uint8_t data);
@@ -42,8 +176,90 @@ void cpu_write(CPU *cpu, uint16_t addr, uint8_t data);
 uint16_t cpu_read16(CPU *cpu, uint16_t addr);
 void cpu_write16(CPU *cpu, uint16_t addr, uint16_t data);
 
+// The packed status register, as PHP pushes it but without forcing B and the
+// unused bit, and the reverse.
+uint8_t cpu_flags(const CPU *cpu);
+void cpu_set_flags(CPU *cpu, uint8_t p);
+
+// Maps mem over the whole address space as RAM.
 void cpu_init(CPU *cpu, Memory *mem);
 void cpu_reset(CPU *cpu);
 void cpu_step_cycle(CPU *cpu);
 
+// Executes one whole instruction (or interrupt entry), first retiring any
+// cycles still owed by cpu_step_cycle(). Returns the cycles consumed.
+uint8_t cpu_step_instruction(CPU *cpu);
+
+// Executes whole instructions until at least cycle_budget cycles have been
+// consumed and returns the number actually consumed. The last instruction may
+// overrun the budget; totals always match driving the CPU with
+// cpu_step_cycle(). Under CPU_TIMING_CYCLE it runs exactly cycle_budget
+// cycles and may stop inside an instruction.
+uint64_t cpu_run(CPU *cpu, uint64_t cycle_budget);
+
+// Interrupt lines, each wired-OR between CPU_INTERRUPT_SOURCES sources
+// numbered by the caller from 0. A source holds its line from asserting it
+// until it releases it. Calls for any other source number are ignored.
+//
+// IRQ is level triggered: before each instruction that starts with I clear
+// while any source holds the line, the CPU enters an interrupt through
+// $FFFE. The handler must get its device to release the line before it
+// returns or clears I, or it is entered again at once.
+//
+// NMI is edge triggered: the line going from released to held latches one
+// interrupt through $FFFA, taken before the next instruction whatever I is.
+// Holding the line does not trigger another.
+//
+// Either way the interrupt is taken at the first instruction boundary after
+// the line changes, with B clear in the pushed P, and its entry is charged 7
+// cycles like an instruction. A device raising a line from a scheduler event
+// thus knows the cycle its handler starts without polling the CPU.
+void cpu_set_irq(CPU *cpu, unsigned source, bool asserted);
+void cpu_set_nmi(CPU *cpu, unsigned source, bool asserted);
+
+// Brings the end of the current cpu_run() forward: it returns at the first
+// instruction boundary (or, under CPU_TIMING_CYCLE, the first cycle) at or
+// after cycle, if that comes before its budget runs out. For bus handlers and
+// watchers, such as a device that needs attention sooner than the run would
+// otherwise end. Lanes ignore it; outside cpu_run() it has no effect.
+void cpu_stop_at(CPU *cpu, uint64_t cycle);
+
+// Page mappings. addr is rounded down to a page boundary and size up to a
+// whole number of pages; host must cover the rounded range.
+void cpu_map_ram(CPU *cpu, uint16_t addr, uint32_t size, uint8_t *host);
+
+// Reads come from host; writes go to the page's write handler, if any, and
+// are otherwise dropped.
+void cpu_map_rom(CPU *cpu, uint16_t addr, uint32_t size, const uint8_t *host);
+
+// Routes accesses to handlers. A NULL read or write handler leaves that
+// direction of the existing mapping in place, data included, so a device can,
+// for example, watch writes to a ROM window while reads stay direct.
+void cpu_map_io(CPU *cpu, uint16_t addr, uint32_t size, CPUReadHandler read,
+                CPUWriteHandler write, void *data);
+
+void cpu_unmap(CPU *cpu, uint16_t addr, uint32_t size);
+
+// Write watches, for subsystems that must know when memory changes. A watcher
+// is called for every CPU write to the pages it watches, before the write is
+// made, and once with the page's first address before the page is remapped.
+// Watched RAM pages leave the direct write path until no watcher is left on
+// them. Returns the watcher number, or -1 if all are taken.
+int cpu_watch_add(CPU *cpu, CPUWriteHandler write, void *data);
+
+// A watcher that is only called for CPU writes, for subsystems that care what
+// the program stores rather than whether a page still holds what it did.
+int cpu_watch_add_stores(CPU *cpu, CPUWriteHandler write, void *data);
+
+// Stops the watcher and releases its number.
+void cpu_watch_remove(CPU *cpu, int watcher);
+
+void cpu_watch_page(CPU *cpu, int watcher, uint8_t page, bool on);
+
+// Tells the watchers of each page in the range that the host is about to
+// change it behind the CPU's back. Each watcher, other than those added with
+// cpu_watch_add_stores, is called once per page with the page's first
+// address.
+void cpu_watch_touch(CPU *cpu, uint16_t addr, uint32_t size);
+
 #endif // TINY6502_H
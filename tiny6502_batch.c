@@ -0,0 +1,158 @@
+#include "tiny6502_batch.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct CPUBatch {
+  CPUMachine *machines;
+  size_t count;
+};
+
+// The machines a worker has left to run, [begin, end). The owner takes from
+// the front and thieves take from the back.
+typedef struct {
+  _Alignas(64) pthread_mutex_t lock;
+  size_t begin, end;
+} CPUBatchQueue;
+
+typedef struct {
+  CPUBatch *batch;
+  const CPUBatchOptions *options;
+  CPUBatchQueue *queues;
+  unsigned threads;
+  unsigned self;
+} CPUBatchWorker;
+
+CPUBatch *cpu_batch_create(size_t count) {
+  CPUBatch *batch = malloc(sizeof(*batch));
+  if (!batch)
+    return NULL;
+  batch->machines = calloc(count ? count : 1, sizeof(CPUMachine));
+  if (!batch->machines) {
+    free(batch);
+    return NULL;
+  }
+  batch->count = count;
+  for (size_t i = 0; i < count; i++)
+    cpu_init(&batch->machines[i].cpu, &batch->machines[i].memory);
+  return batch;
+}
+
+void cpu_batch_destroy(CPUBatch *batch) {
+  if (!batch)
+    return;
+  free(batch->machines);
+  free(batch);
+}
+
+size_t cpu_batch_size(const CPUBatch *batch) { return batch->count; }
+
+CPUMachine *cpu_batch_machine(CPUBatch *batch, size_t index) {
+  return &batch->machines[index];
+}
+
+static void cpu_batch_run_machine(CPUMachine *machine,
+                                  const CPUBatchOptions *options) {
+  uint64_t budget = options->cycle_budget;
+  uint64_t slice = options->slice ? options->slice : budget;
+
+  machine->cycles = 0;
+  machine->halted = false;
+  while (machine->cycles < budget) {
+    uint64_t left = budget - machine->cycles;
+    machine->cycles += cpu_run(&machine->cpu, left < slice ? left : slice);
+    if (options->halt && options->halt(machine, options->data)) {
+      machine->halted = true;
+      break;
+    }
+  }
+}
+
+static bool cpu_batch_take(CPUBatchQueue *queue, size_t *index) {
+  pthread_mutex_lock(&queue->lock);
+  bool taken = queue->begin < queue->end;
+  if (taken)
+    *index = queue->begin++;
+  pthread_mutex_unlock(&queue->lock);
+  return taken;
+}
+
+static bool cpu_batch_steal(CPUBatchWorker *worker) {
+  CPUBatchQueue *own = &worker->queues[worker->self];
+  for (unsigned i = 1; i < worker->threads; i++) {
+    CPUBatchQueue *victim =
+        &worker->queues[(worker->self + i) % worker->threads];
+
+    pthread_mutex_lock(&victim->lock);
+    size_t left = victim->end - victim->begin;
+    size_t half = (left + 1) / 2;
+    victim->end -= half;
+    size_t end = victim->end + half;
+    pthread_mutex_unlock(&victim->lock);
+
+    if (half) {
+      pthread_mutex_lock(&own->lock);
+      own->begin = end - half;
+      own->end = end;
+      pthread_mutex_unlock(&own->lock);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void *cpu_batch_work(void *arg) {
+  CPUBatchWorker *worker = arg;
+  size_t index;
+  do {
+    while (cpu_batch_take(&worker->queues[worker->self], &index))
+      cpu_batch_run_machine(&worker->batch->machines[index], worker->options);
+  } while (cpu_batch_steal(worker));
+  return NULL;
+}
+
+void cpu_batch_run(CPUBatch *batch, const CPUBatchOptions *options) {
+  unsigned threads = options->threads;
+  if (!threads) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? online : 1;
+  }
+  if (threads > batch->count)
+    threads = batch->count ? batch->count : 1;
+
+  CPUBatchQueue *queues = aligned_alloc(64, threads * sizeof(CPUBatchQueue));
+  CPUBatchWorker *workers = malloc(threads * sizeof(CPUBatchWorker));
+  pthread_t *ids = malloc(threads * sizeof(pthread_t));
+  if (!queues || !workers || !ids) {
+    // Too little memory for a pool; run everything on this thread.
+    for (size_t i = 0; i < batch->count; i++)
+      cpu_batch_run_machine(&batch->machines[i], options);
+    goto done;
+  }
+
+  for (unsigned i = 0; i < threads; i++) {
+    pthread_mutex_init(&queues[i].lock, NULL);
+    queues[i].begin = batch->count * i / threads;
+    queues[i].end = batch->count * (i + 1) / threads;
+    workers[i] = (CPUBatchWorker){batch, options, queues, threads, i};
+  }
+
+  // The calling thread is worker 0. Workers that fail to start are covered
+  // by the others stealing their share.
+  unsigned started = 1;
+  for (unsigned i = 1; i < threads; i++)
+    if (pthread_create(&ids[started], NULL, cpu_batch_work, &workers[i]) == 0)
+      started++;
+  cpu_batch_work(&workers[0]);
+  for (unsigned i = 1; i < started; i++)
+    pthread_join(ids[i], NULL);
+
+  for (unsigned i = 0; i < threads; i++)
+    pthread_mutex_destroy(&queues[i].lock);
+
+done:
+  free(queues);
+  free(workers);
+  free(ids);
+}
@@ -0,0 +1,55 @@
+#ifndef TINY6502_BATCH_H
+#define TINY6502_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Runs many independent machines on a pool of threads. Each worker starts
+// with an equal share of the machines and, once its own run out, steals half
+// of the remaining share of another worker, so machines that halt early or
+// run slower do not leave cores idle. The core keeps no mutable global state;
+// machines share nothing unless their page mappings do.
+
+typedef struct {
+  CPU cpu;
+  Memory memory;
+
+  // Filled in by cpu_batch_run.
+  uint64_t cycles;
+  bool halted;
+} CPUMachine;
+
+// Checked after each slice of a machine's run; returning true stops it.
+typedef bool (*CPUHaltCondition)(CPUMachine *machine, void *data);
+
+typedef struct {
+  uint64_t cycle_budget;
+
+  // Cycles run between halt checks, 0 to run the whole budget at once.
+  uint64_t slice;
+  CPUHaltCondition halt;
+  void *data;
+
+  // 0 uses one thread per online processor.
+  unsigned threads;
+} CPUBatchOptions;
+
+typedef struct CPUBatch CPUBatch;
+
+// Allocates count machines, each initialised with cpu_init on its own zeroed
+// memory. Load programs into the memory and cpu_reset before running. Returns
+// NULL if the allocation fails.
+CPUBatch *cpu_batch_create(size_t count);
+void cpu_batch_destroy(CPUBatch *batch);
+
+size_t cpu_batch_size(const CPUBatch *batch);
+CPUMachine *cpu_batch_machine(CPUBatch *batch, size_t index);
+
+// Runs every machine for options->cycle_budget cycles or until its halt
+// condition holds, continuing from where the previous run left off.
+void cpu_batch_run(CPUBatch *batch, const CPUBatchOptions *options);
+
+#endif // TINY6502_BATCH_H
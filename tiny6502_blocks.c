@@ -0,0 +1,232 @@
+#include "tiny6502_blocks.h"
+
+#include <string.h>
+
+#include "tiny6502_ops.h"
+#include "tiny6502_trace.h"
+
+#define INTERRUPT_PENDING(c) ((c)->NMI || ((c)->IRQ && !(c)->P.flags.I))
+
+static void cpu_blocks_written(CPU *cpu, void *data, uint16_t addr,
+                               uint8_t value) {
+  (void)value;
+  CPUBlockCache *cache = data;
+  unsigned page = addr >> 8;
+  cache->generation[page]++;
+  cpu_watch_page(cpu, cache->watcher, page, false);
+}
+
+bool cpu_blocks_attach(CPUBlockCache *cache, CPU *cpu) {
+  memset(cache, 0, sizeof(*cache));
+  cache->watcher = cpu_watch_add(cpu, cpu_blocks_written, cache);
+  if (cache->watcher < 0)
+    return false;
+  cache->cpu = cpu;
+  cpu->blocks = cache;
+  return true;
+}
+
+void cpu_blocks_detach(CPUBlockCache *cache) {
+  if (!cache->cpu)
+    return;
+  cpu_watch_remove(cache->cpu, cache->watcher);
+  cache->cpu->blocks = NULL;
+  cache->cpu = NULL;
+}
+
+// Branches, jumps, calls and returns end a block.
+static bool cpu_blocks_ends(uint8_t opcode) {
+  switch (opcode) {
+  case 0x00: // BRK
+  case 0x20: // JSR
+  case 0x40: // RTI
+  case 0x4C: // JMP
+  case 0x60: // RTS
+  case 0x6C: // JMP ()
+    return true;
+  default:
+    return (opcode & 0x1F) == 0x10;
+  }
+}
+
+// Operands come from the decoded entry instead of the instruction stream.
+// Indirect modes still read their pointer when executed, since it lives in
+// memory that can change.
+
+static inline uint16_t cpu_block_address_ZP(uint16_t operand) {
+  return operand;
+}
+
+static inline uint16_t cpu_block_address_ZPX(CPU *cpu, uint16_t operand) {
+  return (uint8_t)(operand + cpu->X);
+}
+
+static inline uint16_t cpu_block_address_ZPY(CPU *cpu, uint16_t operand) {
+  return (uint8_t)(operand + cpu->Y);
+}
+
+static inline uint16_t cpu_block_address_ABS(uint16_t operand) {
+  return operand;
+}
+
+static inline uint16_t cpu_block_address_ABSX(CPU *cpu, uint16_t operand) {
+  return operand + cpu->X;
+}
+
+static inline uint16_t cpu_block_address_ABSY(CPU *cpu, uint16_t operand) {
+  return operand + cpu->Y;
+}
+
+static inline uint16_t cpu_block_address_IND(CPU *cpu, uint16_t ptr) {
+  uint16_t value = cpu_load(cpu, ptr);
+  return value | (cpu_load(cpu, (ptr & 0xFF00) | ((ptr + 1) & 0xFF)) << 8);
+}
+
+static inline uint16_t cpu_block_address_INDX(CPU *cpu, uint16_t operand) {
+  uint8_t ptr = operand + cpu->X;
+  uint16_t value = cpu_load(cpu, ptr);
+  return value | (cpu_load(cpu, (uint8_t)(ptr + 1)) << 8);
+}
+
+static inline uint16_t cpu_block_address_INDY(CPU *cpu, uint16_t operand) {
+  uint8_t ptr = operand;
+  uint16_t value = cpu_load(cpu, ptr);
+  value |= cpu_load(cpu, (uint8_t)(ptr + 1)) << 8;
+  return value + cpu->Y;
+}
+
+#define BLOCK_ADDRESS_ZP(cpu) cpu_block_address_ZP(decoded->operand)
+#define BLOCK_ADDRESS_ZPX(cpu) cpu_block_address_ZPX(cpu, decoded->operand)
+#define BLOCK_ADDRESS_ZPY(cpu) cpu_block_address_ZPY(cpu, decoded->operand)
+#define BLOCK_ADDRESS_ABS(cpu) cpu_block_address_ABS(decoded->operand)
+#define BLOCK_ADDRESS_ABSX(cpu) cpu_block_address_ABSX(cpu, decoded->operand)
+#define BLOCK_ADDRESS_ABSY(cpu) cpu_block_address_ABSY(cpu, decoded->operand)
+#define BLOCK_ADDRESS_IND(cpu) cpu_block_address_IND(cpu, decoded->operand)
+#define BLOCK_ADDRESS_INDX(cpu) cpu_block_address_INDX(cpu, decoded->operand)
+#define BLOCK_ADDRESS_INDY(cpu) cpu_block_address_INDY(cpu, decoded->operand)
+
+#define BLOCK_OPERAND_IMM(cpu) ((uint8_t)decoded->operand)
+#define BLOCK_OPERAND_ZP(cpu) cpu_load(cpu, BLOCK_ADDRESS_ZP(cpu))
+#define BLOCK_OPERAND_ZPX(cpu) cpu_load(cpu, BLOCK_ADDRESS_ZPX(cpu))
+#define BLOCK_OPERAND_ZPY(cpu) cpu_load(cpu, BLOCK_ADDRESS_ZPY(cpu))
+#define BLOCK_OPERAND_ABS(cpu) cpu_load(cpu, BLOCK_ADDRESS_ABS(cpu))
+#define BLOCK_OPERAND_ABSX(cpu) cpu_load(cpu, BLOCK_ADDRESS_ABSX(cpu))
+#define BLOCK_OPERAND_ABSY(cpu) cpu_load(cpu, BLOCK_ADDRESS_ABSY(cpu))
+#define BLOCK_OPERAND_INDX(cpu) cpu_load(cpu, BLOCK_ADDRESS_INDX(cpu))
+#define BLOCK_OPERAND_INDY(cpu) cpu_load(cpu, BLOCK_ADDRESS_INDY(cpu))
+
+#undef CPU_ADDRESS
+#undef CPU_OPERAND
+#define CPU_ADDRESS(cpu, mode) BLOCK_ADDRESS_##mode(cpu)
+#define CPU_OPERAND(cpu, mode) BLOCK_OPERAND_##mode(cpu)
+
+#define HANDLER(code, mn, mode, cycles, page_cycles)                           \
+  static void cpu_block_op_##code(CPU *cpu, const CPUBlockOp *decoded) {       \
+    (void)decoded;                                                             \
+    EXEC_##mn(cpu, mode);                                                      \
+  }
+TINY6502_OPCODES(HANDLER)
+#undef HANDLER
+
+#define ENTRY(code, mn, mode, cycles, page_cycles) [code] = cpu_block_op_##code,
+static void (*const cpu_block_handlers[256])(CPU *, const CPUBlockOp *) = {
+    TINY6502_OPCODES(ENTRY)};
+#undef ENTRY
+
+static CPUBlock *cpu_blocks_decode(CPUBlockCache *cache, CPUBlock *block,
+                                   uint16_t pc) {
+  CPU *cpu = cache->cpu;
+  unsigned page = pc >> 8;
+  const uint8_t *host = cpu->pages.read[page];
+  if (!host)
+    return NULL;
+
+  unsigned count = 0;
+  for (unsigned offset = pc & 0xFF; count < CPU_BLOCK_OPS;) {
+    uint8_t opcode = host[offset];
+    const OpcodeInfo *info = &cpu_opcode_table[opcode];
+    unsigned length = cpu_mode_length(info->mode);
+    if (offset + length > 0x100)
+      break;
+
+    uint16_t operand = 0;
+    if (length > 1)
+      operand = host[offset + 1];
+    if (length > 2)
+      operand |= host[offset + 2] << 8;
+
+    bool ends = cpu_blocks_ends(opcode);
+    uint16_t at = (pc & 0xFF00) | offset;
+    block->ops[count++] = (CPUBlockOp){
+        .handler = cpu_block_handlers[opcode],
+        .operand = operand,
+        .pc = at,
+        .next = at + (ends ? 1 : length),
+        .opcode = opcode,
+        .cycles = info->cycles + info->page_cycles,
+    };
+    offset += length;
+    if (ends || offset == 0x100)
+      break;
+  }
+  if (!count)
+    return NULL;
+
+  cpu_watch_page(cpu, cache->watcher, page, true);
+  block->generation = cache->generation[page];
+  block->pc = pc;
+  block->count = count;
+  return block;
+}
+
+static inline CPUBlock *cpu_blocks_lookup(CPUBlockCache *cache, uint16_t pc) {
+  CPUBlock *block = &cache->blocks[pc % CPU_BLOCK_SLOTS];
+  unsigned page = pc >> 8;
+  if (block->count && block->pc == pc &&
+      block->generation == cache->generation[page])
+    return block;
+  return cpu_blocks_decode(cache, block, pc);
+}
+
+uint64_t cpu_run_blocks(CPU *cpu, uint64_t cycle_budget) {
+  uint64_t consumed = cpu->cycles_left;
+  if (consumed > cycle_budget)
+    consumed = cycle_budget;
+  cpu->cycles_left -= consumed;
+
+  CPUBlockCache *cache = cpu->blocks;
+  uint64_t start = cpu->cycles;
+  cpu->deadline = start + (cycle_budget - consumed);
+
+  while (cpu->cycles < cpu->deadline) {
+    CPUBlock *block = NULL;
+    if (!INTERRUPT_PENDING(cpu))
+      block = cpu_blocks_lookup(cache, cpu->PC);
+    if (!block) {
+      // Interrupt entries and code the cache cannot hold.
+      cpu_step_instruction(cpu);
+      continue;
+    }
+
+    unsigned page = block->pc >> 8;
+    uint32_t generation = block->generation;
+    for (const CPUBlockOp *op = block->ops; op < block->ops + block->count;
+         op++) {
+#ifdef TINY6502_TRACE
+      if (cpu->trace)
+        cpu_trace_record(cpu->trace, cpu, op->pc, op->opcode);
+#endif
+      cpu->PC = op->next;
+      op->handler(cpu, op);
+      cpu->cycles += op->cycles;
+
+      // A write to the block's own page, or a remap of it, may have changed
+      // the code ahead.
+      if (cpu->cycles >= cpu->deadline || INTERRUPT_PENDING(cpu) ||
+          cache->generation[page] != generation)
+        break;
+    }
+  }
+
+  return consumed + (cpu->cycles - start);
+}
@@ -0,0 +1,60 @@
+#ifndef TINY6502_BLOCKS_H
+#define TINY6502_BLOCKS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Decoded-block cache. While a cache is attached, cpu_run executes straight
+// runs of instructions, up to and including the next branch, jump, call or
+// return, from blocks decoded once and kept by start address. Each entry
+// holds a handler specialised for its opcode, the operand bytes already
+// read and the cycle cost, so hot loops skip the opcode and operand fetches
+// and the table lookup. Cycle counts, interrupts and traces match the
+// interpreter exactly.
+//
+// Blocks never cross a page. A block is dropped on the first write to its
+// page, which keeps self-modifying code correct, and when the page is
+// remapped, for example by a bank switch. Pages with read handlers are never
+// cached.
+
+#define CPU_BLOCK_OPS 16
+#define CPU_BLOCK_SLOTS 4096
+
+typedef struct CPUBlockOp CPUBlockOp;
+
+struct CPUBlockOp {
+  void (*handler)(CPU *cpu, const CPUBlockOp *op);
+  uint16_t operand;
+  uint16_t pc;
+  // PC as the handler expects it: past the operand, or just past the opcode
+  // for instructions that read their own operand, such as branches.
+  uint16_t next;
+  uint8_t opcode;
+  uint8_t cycles;
+};
+
+typedef struct {
+  uint32_t generation;
+  uint16_t pc;
+  uint8_t count;
+  CPUBlockOp ops[CPU_BLOCK_OPS];
+} CPUBlock;
+
+typedef struct CPUBlockCache {
+  CPU *cpu;
+  int watcher;
+
+  // Bumped on the first write to, or remap of, a page holding blocks.
+  uint32_t generation[0x100];
+
+  // Direct mapped by start address.
+  CPUBlock blocks[CPU_BLOCK_SLOTS];
+} CPUBlockCache;
+
+// Returns false if the CPU has no write watcher free.
+bool cpu_blocks_attach(CPUBlockCache *cache, CPU *cpu);
+void cpu_blocks_detach(CPUBlockCache *cache);
+
+#endif // TINY6502_BLOCKS_H
@@ -0,0 +1,538 @@
+#include "tiny6502.h"
+#include "tiny6502_debug.h"
+#include "tiny6502_ops.h"
+#include "tiny6502_profile.h"
+#include "tiny6502_trace.h"
+
+// The CPU_TIMING_CYCLE engine. Each call to cpu_cycle_step() performs one
+// bus access of the current instruction, following the NMOS 6502's cycle
+// tables: implied instructions read the byte after the opcode, indexed
+// modes read the address before the carry into the high byte is fixed,
+// read-modify-write instructions write the unmodified value back before the
+// result, and so on. What an instruction does with its operand comes from
+// the same opcode bodies as the other engines, expanded below against the
+// operand latched in CPU.cycle.
+
+enum {
+  CYCLE_IMPLIED,
+  CYCLE_READ,
+  CYCLE_WRITE,
+  CYCLE_RMW,
+  CYCLE_BRANCH,
+  CYCLE_JMP,
+  CYCLE_JSR,
+  CYCLE_RTS,
+  CYCLE_RTI,
+  CYCLE_BRK,
+  CYCLE_PUSH,
+  CYCLE_PULL,
+};
+
+#define CYCLE_KIND_ADC CYCLE_READ
+#define CYCLE_KIND_AND CYCLE_READ
+#define CYCLE_KIND_ASL CYCLE_RMW
+#define CYCLE_KIND_BCC CYCLE_BRANCH
+#define CYCLE_KIND_BCS CYCLE_BRANCH
+#define CYCLE_KIND_BEQ CYCLE_BRANCH
+#define CYCLE_KIND_BIT CYCLE_READ
+#define CYCLE_KIND_BMI CYCLE_BRANCH
+#define CYCLE_KIND_BNE CYCLE_BRANCH
+#define CYCLE_KIND_BPL CYCLE_BRANCH
+#define CYCLE_KIND_BRK CYCLE_BRK
+#define CYCLE_KIND_BVC CYCLE_BRANCH
+#define CYCLE_KIND_BVS CYCLE_BRANCH
+#define CYCLE_KIND_CLC CYCLE_IMPLIED
+#define CYCLE_KIND_CLD CYCLE_IMPLIED
+#define CYCLE_KIND_CLI CYCLE_IMPLIED
+#define CYCLE_KIND_CLV CYCLE_IMPLIED
+#define CYCLE_KIND_CMP CYCLE_READ
+#define CYCLE_KIND_CPX CYCLE_READ
+#define CYCLE_KIND_CPY CYCLE_READ
+#define CYCLE_KIND_DEC CYCLE_RMW
+#define CYCLE_KIND_DEX CYCLE_IMPLIED
+#define CYCLE_KIND_DEY CYCLE_IMPLIED
+#define CYCLE_KIND_EOR CYCLE_READ
+#define CYCLE_KIND_INC CYCLE_RMW
+#define CYCLE_KIND_INX CYCLE_IMPLIED
+#define CYCLE_KIND_INY CYCLE_IMPLIED
+#define CYCLE_KIND_JMP CYCLE_JMP
+#define CYCLE_KIND_JSR CYCLE_JSR
+#define CYCLE_KIND_LDA CYCLE_READ
+#define CYCLE_KIND_LDX CYCLE_READ
+#define CYCLE_KIND_LDY CYCLE_READ
+#define CYCLE_KIND_LSR CYCLE_RMW
+#define CYCLE_KIND_NOP CYCLE_IMPLIED
+#define CYCLE_KIND_ORA CYCLE_READ
+#define CYCLE_KIND_PHA CYCLE_PUSH
+#define CYCLE_KIND_PHP CYCLE_PUSH
+#define CYCLE_KIND_PLA CYCLE_PULL
+#define CYCLE_KIND_PLP CYCLE_PULL
+#define CYCLE_KIND_ROL CYCLE_RMW
+#define CYCLE_KIND_ROR CYCLE_RMW
+#define CYCLE_KIND_RTI CYCLE_RTI
+#define CYCLE_KIND_RTS CYCLE_RTS
+#define CYCLE_KIND_SBC CYCLE_READ
+#define CYCLE_KIND_SEC CYCLE_IMPLIED
+#define CYCLE_KIND_SED CYCLE_IMPLIED
+#define CYCLE_KIND_SEI CYCLE_IMPLIED
+#define CYCLE_KIND_STA CYCLE_WRITE
+#define CYCLE_KIND_STX CYCLE_WRITE
+#define CYCLE_KIND_STY CYCLE_WRITE
+#define CYCLE_KIND_TAX CYCLE_IMPLIED
+#define CYCLE_KIND_TAY CYCLE_IMPLIED
+#define CYCLE_KIND_TSX CYCLE_IMPLIED
+#define CYCLE_KIND_TXA CYCLE_IMPLIED
+#define CYCLE_KIND_TXS CYCLE_IMPLIED
+#define CYCLE_KIND_TYA CYCLE_IMPLIED
+#define CYCLE_KIND_ILL CYCLE_IMPLIED
+
+// Shifts and rotates of A touch no memory.
+#define ENTRY(code, mn, mode, cycles, page_cycles)                             \
+  [code] = (mode) == ACC ? CYCLE_IMPLIED : CYCLE_KIND_##mn,
+static const uint8_t cpu_cycle_kind[256] = {TINY6502_OPCODES(ENTRY)};
+#undef ENTRY
+
+// The bodies work on the latched operand: reads consume it, read-modify-write
+// instructions modify it in place and branches only decide.
+#undef CPU_ADDRESS
+#undef CPU_OPERAND
+#undef CPU_BRANCH
+#undef CPU_RMW_ZP
+#undef CPU_RMW_ZPX
+#undef CPU_RMW_ABS
+#undef CPU_RMW_ABSX
+#define CPU_ADDRESS(cpu, mode) ((cpu)->cycle.addr)
+#define CPU_OPERAND(cpu, mode) ((cpu)->cycle.data)
+#define CPU_BRANCH(cpu, cond) ((cpu)->cycle.taken = (cond))
+#define CYCLE_MODIFY(cpu, op) ((cpu)->cycle.data = op(cpu, (cpu)->cycle.data))
+#define CPU_RMW_ZP(cpu, op) CYCLE_MODIFY(cpu, op)
+#define CPU_RMW_ZPX(cpu, op) CYCLE_MODIFY(cpu, op)
+#define CPU_RMW_ABS(cpu, op) CYCLE_MODIFY(cpu, op)
+#define CPU_RMW_ABSX(cpu, op) CYCLE_MODIFY(cpu, op)
+
+#define HANDLER(code, mn, mode, cycles, page_cycles)                           \
+  static void cpu_cycle_op_##code(CPU *cpu) { EXEC_##mn(cpu, mode); }
+TINY6502_OPCODES(HANDLER)
+#undef HANDLER
+
+#define ENTRY(code, mn, mode, cycles, page_cycles) [code] = cpu_cycle_op_##code,
+static const Instruction cpu_cycle_ops[256] = {TINY6502_OPCODES(ENTRY)};
+#undef ENTRY
+
+static uint8_t cpu_cycle_read(CPU *cpu, uint16_t addr) {
+  uint8_t value = cpu_load(cpu, addr);
+  if (cpu->on_cycle.handler)
+    cpu->on_cycle.handler(cpu, cpu->on_cycle.data, addr, value, false);
+  return value;
+}
+
+static void cpu_cycle_write(CPU *cpu, uint16_t addr, uint8_t value) {
+  cpu_store(cpu, addr, value);
+  if (cpu->on_cycle.handler)
+    cpu->on_cycle.handler(cpu, cpu->on_cycle.data, addr, value, true);
+}
+
+static void cpu_cycle_push(CPU *cpu, uint8_t value) {
+  cpu_cycle_write(cpu, 0x0100 | cpu->SP--, value);
+}
+
+static uint8_t cpu_cycle_pop(CPU *cpu) {
+  return cpu_cycle_read(cpu, 0x0100 | ++cpu->SP);
+}
+
+// STY, STA and STX are told apart by the low bits of the opcode.
+static uint8_t cpu_cycle_stored(CPU *cpu, uint8_t opcode) {
+  switch (opcode & 3) {
+  case 0:
+    return cpu->Y;
+  case 1:
+    return cpu->A;
+  default:
+    return cpu->X;
+  }
+}
+
+// Indexed reads first read from the address with the carry out of the low
+// byte not yet applied. Returns true if that was the right address.
+static bool cpu_cycle_unfixed(CPU *cpu, CPUCycleState *s) {
+  uint16_t unfixed = (s->base & 0xFF00) | (s->addr & 0x00FF);
+  s->data = cpu_cycle_read(cpu, unfixed);
+  return unfixed == s->addr;
+}
+
+// Cycles of instructions that read, write or modify memory. Every case
+// returns until its address is complete; the access follows from cycle
+// first on.
+static bool cpu_cycle_memory(CPU *cpu, CPUCycleState *s, unsigned t,
+                             unsigned kind, AddressingMode mode) {
+  unsigned first;
+  switch (mode) {
+  case IMM:
+    s->data = cpu_cycle_read(cpu, cpu->PC++);
+    cpu_cycle_ops[s->opcode](cpu);
+    return true;
+  case ZP:
+    first = 3;
+    if (t == 2) {
+      s->addr = cpu_cycle_read(cpu, cpu->PC++);
+      return false;
+    }
+    break;
+  case ZPX:
+  case ZPY:
+    first = 4;
+    if (t == 2) {
+      s->addr = cpu_cycle_read(cpu, cpu->PC++);
+      return false;
+    }
+    if (t == 3) {
+      cpu_cycle_read(cpu, s->addr);
+      s->addr = (uint8_t)(s->addr + (mode == ZPX ? cpu->X : cpu->Y));
+      return false;
+    }
+    break;
+  case ABS:
+    first = 4;
+    if (t == 2) {
+      s->addr = cpu_cycle_read(cpu, cpu->PC++);
+      return false;
+    }
+    if (t == 3) {
+      s->addr |= cpu_cycle_read(cpu, cpu->PC++) << 8;
+      return false;
+    }
+    break;
+  case ABSX:
+  case ABSY:
+    first = 5;
+    if (t == 2) {
+      s->base = cpu_cycle_read(cpu, cpu->PC++);
+      return false;
+    }
+    if (t == 3) {
+      s->base |= cpu_cycle_read(cpu, cpu->PC++) << 8;
+      s->addr = s->base + (mode == ABSX ? cpu->X : cpu->Y);
+      return false;
+    }
+    if (t == 4) {
+      if (cpu_cycle_unfixed(cpu, s) && kind == CYCLE_READ) {
+        cpu_cycle_ops[s->opcode](cpu);
+        return true;
+      }
+      return false;
+    }
+    break;
+  case INDX:
+    first = 6;
+    if (t == 2) {
+      s->base = cpu_cycle_read(cpu, cpu->PC++);
+      return false;
+    }
+    if (t == 3) {
+      cpu_cycle_read(cpu, s->base);
+      s->base = (uint8_t)(s->base + cpu->X);
+      return false;
+    }
+    if (t == 4) {
+      s->addr = cpu_cycle_read(cpu, s->base);
+      return false;
+    }
+    if (t == 5) {
+      s->addr |= cpu_cycle_read(cpu, (uint8_t)(s->base + 1)) << 8;
+      return false;
+    }
+    break;
+  case INDY:
+    first = 6;
+    if (t == 2) {
+      s->base = cpu_cycle_read(cpu, cpu->PC++);
+      return false;
+    }
+    if (t == 3) {
+      s->addr = cpu_cycle_read(cpu, s->base);
+      return false;
+    }
+    if (t == 4) {
+      s->addr |= cpu_cycle_read(cpu, (uint8_t)(s->base + 1)) << 8;
+      s->base = s->addr;
+      s->addr += cpu->Y;
+      return false;
+    }
+    if (t == 5) {
+      if (cpu_cycle_unfixed(cpu, s) && kind == CYCLE_READ) {
+        cpu_cycle_ops[s->opcode](cpu);
+        return true;
+      }
+      return false;
+    }
+    break;
+  default:
+    return true;
+  }
+
+  switch (kind) {
+  case CYCLE_READ:
+    s->data = cpu_cycle_read(cpu, s->addr);
+    cpu_cycle_ops[s->opcode](cpu);
+    return true;
+  case CYCLE_WRITE:
+    cpu_cycle_write(cpu, s->addr, cpu_cycle_stored(cpu, s->opcode));
+    return true;
+  default:
+    if (t == first) {
+      s->data = cpu_cycle_read(cpu, s->addr);
+      return false;
+    }
+    cpu_cycle_write(cpu, s->addr, s->data);
+    if (t == first + 1) {
+      cpu_cycle_ops[s->opcode](cpu);
+      return false;
+    }
+    return true;
+  }
+}
+
+// Interrupt entries and BRK push the return address and P, then read the
+// vector, from cycle 3 on.
+static bool cpu_cycle_interrupt(CPU *cpu, CPUCycleState *s, unsigned t,
+                                uint8_t pushed, uint16_t vector) {
+  switch (t) {
+  case 3:
+    cpu_cycle_push(cpu, cpu->PC >> 8);
+    return false;
+  case 4:
+    cpu_cycle_push(cpu, cpu->PC & 0xFF);
+    return false;
+  case 5:
+    cpu_cycle_push(cpu, pushed);
+    cpu->P.flags.I = 1;
+    return false;
+  case 6:
+    s->addr = cpu_cycle_read(cpu, vector);
+    return false;
+  default:
+    s->addr |= cpu_cycle_read(cpu, vector + 1) << 8;
+    cpu->PC = s->addr;
+    return true;
+  }
+}
+
+// Runs cycle t, counting from 2, of everything but memory instructions.
+// Returns true when the instruction is complete.
+static bool cpu_cycle_control(CPU *cpu, CPUCycleState *s, unsigned t,
+                              unsigned kind, AddressingMode mode) {
+  switch (kind) {
+  case CYCLE_IMPLIED:
+    cpu_cycle_read(cpu, cpu->PC);
+    cpu_cycle_ops[s->opcode](cpu);
+    return true;
+
+  case CYCLE_BRANCH:
+    if (t == 2) {
+      s->data = cpu_cycle_read(cpu, cpu->PC++);
+      cpu_cycle_ops[s->opcode](cpu);
+      s->addr = cpu->PC + (int8_t)s->data;
+      return !s->taken;
+    }
+    cpu_cycle_read(cpu, t == 3 ? cpu->PC
+                               : (cpu->PC & 0xFF00) | (s->addr & 0x00FF));
+    if (t == 3 && (cpu->PC ^ s->addr) >> 8)
+      return false;
+    cpu->PC = s->addr;
+    return true;
+
+  case CYCLE_JMP:
+    if (t == 2) {
+      s->base = cpu_cycle_read(cpu, cpu->PC++);
+      return false;
+    }
+    if (mode == ABS) {
+      cpu->PC = s->base | (cpu_cycle_read(cpu, cpu->PC) << 8);
+      return true;
+    }
+    if (t == 3) {
+      s->base |= cpu_cycle_read(cpu, cpu->PC++) << 8;
+      return false;
+    }
+    if (t == 4) {
+      s->addr = cpu_cycle_read(cpu, s->base);
+      return false;
+    }
+    // The pointer's high byte does not carry into the next page.
+    s->addr |= cpu_cycle_read(cpu, (s->base & 0xFF00) |
+                                       ((s->base + 1) & 0x00FF)) << 8;
+    cpu->PC = s->addr;
+    return true;
+
+  case CYCLE_JSR:
+    switch (t) {
+    case 2:
+      s->addr = cpu_cycle_read(cpu, cpu->PC++);
+      return false;
+    case 3:
+      cpu_cycle_read(cpu, 0x0100 | cpu->SP);
+      return false;
+    case 4:
+      cpu_cycle_push(cpu, cpu->PC >> 8);
+      return false;
+    case 5:
+      cpu_cycle_push(cpu, cpu->PC & 0xFF);
+      return false;
+    default:
+      s->addr |= cpu_cycle_read(cpu, cpu->PC) << 8;
+      cpu->PC = s->addr;
+      return true;
+    }
+
+  case CYCLE_RTS:
+  case CYCLE_RTI:
+    switch (t) {
+    case 2:
+      cpu_cycle_read(cpu, cpu->PC);
+      return false;
+    case 3:
+      cpu_cycle_read(cpu, 0x0100 | cpu->SP);
+      return false;
+    }
+    if (kind == CYCLE_RTI && t == 4) {
+      cpu_unpack_flags(cpu, cpu_cycle_pop(cpu) & 0xCF);
+      return false;
+    }
+    if (t == 4 + (kind == CYCLE_RTI)) {
+      s->addr = cpu_cycle_pop(cpu);
+      return false;
+    }
+    if (t == 5 + (kind == CYCLE_RTI)) {
+      s->addr |= cpu_cycle_pop(cpu) << 8;
+      cpu->PC = s->addr;
+      return kind == CYCLE_RTI;
+    }
+    cpu_cycle_read(cpu, cpu->PC++);
+    return true;
+
+  case CYCLE_BRK:
+    if (t == 2) {
+      cpu_cycle_read(cpu, cpu->PC++);
+      return false;
+    }
+    return cpu_cycle_interrupt(cpu, s, t, cpu_pack_flags(cpu) | 0x30, 0xFFFE);
+
+  case CYCLE_PUSH:
+    if (t == 2) {
+      cpu_cycle_read(cpu, cpu->PC);
+      return false;
+    }
+    cpu_cycle_push(cpu, s->opcode == 0x48 ? cpu->A
+                                          : cpu_pack_flags(cpu) | 0x30);
+    return true;
+
+  default: // CYCLE_PULL
+    if (t == 2) {
+      cpu_cycle_read(cpu, cpu->PC);
+      return false;
+    }
+    if (t == 3) {
+      cpu_cycle_read(cpu, 0x0100 | cpu->SP);
+      return false;
+    }
+    s->data = cpu_cycle_pop(cpu);
+    if (s->opcode == 0x68)
+      CPU_LOAD(cpu, A, s->data);
+    else
+      cpu_unpack_flags(cpu, s->data & 0xCF);
+    return true;
+  }
+}
+
+// The first cycle fetches the opcode, or for an interrupt reads it and
+// throws it away.
+static void cpu_cycle_fetch(CPU *cpu, CPUCycleState *s) {
+  if (cpu->NMI || (cpu->IRQ && !cpu->P.flags.I)) {
+    // The vector is picked here; an NMI edge is used up, the IRQ line stays.
+    s->base = 0xFFFE;
+    if (cpu->NMI) {
+      cpu->NMI = 0;
+      s->base = 0xFFFA;
+    }
+    s->interrupt = true;
+    cpu_cycle_read(cpu, cpu->PC);
+    return;
+  }
+
+  s->interrupt = false;
+#ifdef TINY6502_PROFILE
+  s->pc = cpu->PC;
+#endif
+  s->opcode = cpu_cycle_read(cpu, cpu->PC++);
+#ifdef TINY6502_TRACE
+  if (cpu->trace)
+    cpu_trace_record(cpu->trace, cpu, cpu->PC - 1, s->opcode);
+#endif
+}
+
+// Returns true if the cycle completed an instruction.
+static bool cpu_cycle_run(CPU *cpu) {
+  CPUCycleState *s = &cpu->cycle;
+  unsigned t = ++s->cycle;
+  bool done = false;
+
+  if (t == 1) {
+    cpu_cycle_fetch(cpu, s);
+  } else if (s->interrupt) {
+    if (t == 2)
+      cpu_cycle_read(cpu, cpu->PC);
+    else
+      done = cpu_cycle_interrupt(cpu, s, t, cpu_interrupt_flags(cpu),
+                                 s->base);
+  } else {
+    unsigned kind = cpu_cycle_kind[s->opcode];
+    AddressingMode mode = cpu_opcode_table[s->opcode].mode;
+    if (kind >= CYCLE_READ && kind <= CYCLE_RMW)
+      done = cpu_cycle_memory(cpu, s, t, kind, mode);
+    else
+      done = cpu_cycle_control(cpu, s, t, kind, mode);
+  }
+
+  cpu->cycles++;
+  if (done) {
+#ifdef TINY6502_PROFILE
+    if (cpu->profile && s->interrupt)
+      cpu_profile_interrupt(cpu->profile, cpu, t);
+    else if (cpu->profile)
+      cpu_profile_record(cpu->profile, cpu, s->pc, s->opcode, t);
+#endif
+    s->cycle = 0;
+  }
+  return done;
+}
+
+void cpu_cycle_step(CPU *cpu) { cpu_cycle_run(cpu); }
+
+uint8_t cpu_cycle_instruction(CPU *cpu) {
+  uint8_t cycles = 0;
+  if (cpu->cycle.cycle)
+    while (cycles++, !cpu_cycle_run(cpu))
+      ;
+  while (cycles++, !cpu_cycle_run(cpu))
+    ;
+  return cycles;
+}
+
+uint64_t cpu_run_cycles(CPU *cpu, uint64_t cycle_budget) {
+  uint64_t consumed = cpu->cycles_left;
+  if (consumed > cycle_budget)
+    consumed = cycle_budget;
+  cpu->cycles_left -= consumed;
+
+  uint64_t start = cpu->cycles;
+  cpu->deadline = start + (cycle_budget - consumed);
+  if (cpu->debug && cpu->debug->breakpoints) {
+    while (cpu->cycles < cpu->deadline &&
+           (cpu->cycle.cycle || !cpu_debug_breaks(cpu->debug, cpu)))
+      cpu_cycle_run(cpu);
+  } else {
+    while (cpu->cycles < cpu->deadline)
+      cpu_cycle_run(cpu);
+  }
+  return consumed + (cpu->cycles - start);
+}
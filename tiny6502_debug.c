@@ -0,0 +1,218 @@
+#include "tiny6502_debug.h"
+
+#include <string.h>
+
+static bool cpu_debug_bit(const uint64_t *bits, uint16_t addr) {
+  return bits[addr >> 6] >> (addr & 63) & 1;
+}
+
+static void cpu_debug_set_bit(uint64_t *bits, uint16_t addr, bool on) {
+  if (on)
+    bits[addr >> 6] |= 1ull << (addr & 63);
+  else
+    bits[addr >> 6] &= ~(1ull << (addr & 63));
+}
+
+// Watchpoints stop the run at the end of the instruction making the access.
+static void cpu_debug_stop(CPUDebug *debug, CPU *cpu, CPUStopReason reason,
+                           uint16_t addr, uint8_t value) {
+  debug->stop.reason = reason;
+  debug->stop.addr = addr;
+  debug->stop.value = value;
+  cpu_stop_at(cpu, cpu->cycles);
+}
+
+static uint8_t cpu_debug_read(CPU *cpu, void *data, uint16_t addr) {
+  CPUDebug *debug = cpu->debug;
+  unsigned page = addr >> 8;
+  uint8_t value = 0xFF;
+  if (debug->host[page])
+    value = debug->host[page][addr & 0xFF];
+  else if (debug->device[page])
+    value = debug->device[page](cpu, data, addr);
+  if (cpu_debug_bit(debug->reads, addr))
+    cpu_debug_stop(debug, cpu, CPU_STOP_READ, addr, value);
+  return value;
+}
+
+static void cpu_debug_written(CPU *cpu, void *data, uint16_t addr,
+                              uint8_t value) {
+  CPUDebug *debug = data;
+  if (cpu_debug_bit(debug->writes, addr))
+    cpu_debug_stop(debug, cpu, CPU_STOP_WRITE, addr, value);
+}
+
+// Routes reads of the page through cpu_debug_read, or back. Code caches
+// built from the page are dropped, as for any remapping.
+static void cpu_debug_trap_reads(CPUDebug *debug, unsigned page, bool on) {
+  CPU *cpu = debug->cpu;
+  CPUPageHandler *handler = &cpu->pages.handler[page];
+  cpu_watch_touch(cpu, page << 8, 0x100);
+  if (on) {
+    debug->host[page] = cpu->pages.read[page];
+    debug->device[page] = handler->read;
+    cpu->pages.read[page] = NULL;
+    handler->read = cpu_debug_read;
+  } else if (handler->read == cpu_debug_read) {
+    cpu->pages.read[page] = debug->host[page];
+    handler->read = debug->device[page];
+  }
+}
+
+bool cpu_debug_attach(CPUDebug *debug, CPU *cpu) {
+  memset(debug, 0, sizeof(*debug));
+  debug->watcher = cpu_watch_add_stores(cpu, cpu_debug_written, debug);
+  if (debug->watcher < 0)
+    return false;
+  debug->cpu = cpu;
+  debug->broke_cycles = UINT64_MAX;
+  cpu->debug = debug;
+  return true;
+}
+
+void cpu_debug_detach(CPUDebug *debug) {
+  CPU *cpu = debug->cpu;
+  if (!cpu)
+    return;
+  cpu_debug_unwatch(debug, 0, 0x10000, true, true);
+  cpu_watch_remove(cpu, debug->watcher);
+  if (cpu->debug == debug)
+    cpu->debug = NULL;
+  debug->cpu = NULL;
+}
+
+static void cpu_debug_mark(CPUDebug *debug, uint16_t addr) {
+  if (!cpu_debug_bit(debug->breaks, addr)) {
+    cpu_debug_set_bit(debug->breaks, addr, true);
+    debug->breakpoints++;
+  }
+}
+
+void cpu_debug_break(CPUDebug *debug, uint16_t addr) {
+  cpu_debug_mark(debug, addr);
+  cpu_debug_set_bit(debug->always, addr, true);
+}
+
+bool cpu_debug_break_if(CPUDebug *debug, uint16_t addr, CPUDebugRegister reg,
+                        uint8_t mask, uint8_t value) {
+  if (debug->condition_count == CPU_DEBUG_CONDITIONS)
+    return false;
+  debug->conditions[debug->condition_count++] =
+      (CPUDebugCondition){addr, reg, mask, value};
+  cpu_debug_mark(debug, addr);
+  return true;
+}
+
+void cpu_debug_clear(CPUDebug *debug, uint16_t addr) {
+  if (!cpu_debug_bit(debug->breaks, addr))
+    return;
+  cpu_debug_set_bit(debug->breaks, addr, false);
+  cpu_debug_set_bit(debug->always, addr, false);
+  debug->breakpoints--;
+
+  unsigned kept = 0;
+  for (unsigned i = 0; i < debug->condition_count; i++)
+    if (debug->conditions[i].addr != addr)
+      debug->conditions[kept++] = debug->conditions[i];
+  debug->condition_count = kept;
+}
+
+// A remapping since the page's first read watchpoint was set has dropped
+// them all; forget them so that the next one traps again.
+static void cpu_debug_check_reads(CPUDebug *debug, unsigned page) {
+  CPU *cpu = debug->cpu;
+  CPUPageHandler *handler = &cpu->pages.handler[page];
+  if (!debug->page_reads[page] ||
+      (!cpu->pages.read[page] && handler->read == cpu_debug_read))
+    return;
+  if (handler->read == cpu_debug_read)
+    handler->read = debug->device[page];
+  memset(&debug->reads[page * 4], 0, 4 * sizeof(debug->reads[0]));
+  debug->page_reads[page] = 0;
+}
+
+static void cpu_debug_set_watch(CPUDebug *debug, uint16_t addr, uint32_t size,
+                                bool read, bool write, bool on) {
+  CPU *cpu = debug->cpu;
+  uint32_t end = (uint32_t)addr + size;
+  if (end > 0x10000)
+    end = 0x10000;
+  for (uint32_t at = addr; at < end; at++) {
+    unsigned page = at >> 8;
+    if (read)
+      cpu_debug_check_reads(debug, page);
+    if (read && cpu_debug_bit(debug->reads, at) != on) {
+      cpu_debug_set_bit(debug->reads, at, on);
+      debug->page_reads[page] += on ? 1 : -1;
+      if (debug->page_reads[page] == (on ? 1 : 0))
+        cpu_debug_trap_reads(debug, page, on);
+    }
+    if (write && cpu_debug_bit(debug->writes, at) != on) {
+      cpu_debug_set_bit(debug->writes, at, on);
+      debug->page_writes[page] += on ? 1 : -1;
+      if (debug->page_writes[page] == (on ? 1 : 0))
+        cpu_watch_page(cpu, debug->watcher, page, on);
+    }
+  }
+}
+
+void cpu_debug_watch(CPUDebug *debug, uint16_t addr, uint32_t size, bool read,
+                     bool write) {
+  cpu_debug_set_watch(debug, addr, size, read, write, true);
+}
+
+void cpu_debug_unwatch(CPUDebug *debug, uint16_t addr, uint32_t size,
+                       bool read, bool write) {
+  cpu_debug_set_watch(debug, addr, size, read, write, false);
+}
+
+static uint8_t cpu_debug_register(const CPU *cpu, CPUDebugRegister reg) {
+  switch (reg) {
+  case CPU_DEBUG_A:
+    return cpu->A;
+  case CPU_DEBUG_X:
+    return cpu->X;
+  case CPU_DEBUG_Y:
+    return cpu->Y;
+  case CPU_DEBUG_SP:
+    return cpu->SP;
+  case CPU_DEBUG_P:
+    return cpu_flags(cpu);
+  }
+  return 0;
+}
+
+bool cpu_debug_hit(CPUDebug *debug, CPU *cpu) {
+  uint16_t pc = cpu->PC;
+
+  // An interrupt entry comes first; the instruction runs after its handler.
+  if (cpu->NMI || (cpu->IRQ && !cpu->P.flags.I))
+    return false;
+  if (pc == debug->broke_pc && cpu->cycles == debug->broke_cycles)
+    return false;
+
+  bool hit = cpu_debug_bit(debug->always, pc);
+  for (unsigned i = 0; i < debug->condition_count && !hit; i++) {
+    const CPUDebugCondition *condition = &debug->conditions[i];
+    hit = condition->addr == pc &&
+          (cpu_debug_register(cpu, condition->reg) & condition->mask) ==
+              condition->value;
+  }
+  if (!hit)
+    return false;
+
+  debug->stop.reason = CPU_STOP_BREAK;
+  debug->stop.addr = pc;
+  debug->stop.value = 0;
+  debug->broke_pc = pc;
+  debug->broke_cycles = cpu->cycles;
+  return true;
+}
+
+CPUStop cpu_debug_run(CPUDebug *debug, uint64_t cycle_budget) {
+  uint64_t cycles = cpu_run(debug->cpu, cycle_budget);
+  if (debug->stop.reason == CPU_STOP_BUDGET && cycles < cycle_budget)
+    debug->stop.reason = CPU_STOP_REQUESTED;
+  debug->stop.cycles = cycles;
+  return debug->stop;
+}
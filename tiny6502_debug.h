@@ -0,0 +1,140 @@
+#ifndef TINY6502_DEBUG_H
+#define TINY6502_DEBUG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Breakpoints and watchpoints. A breakpoint stops cpu_run before the
+// instruction at its address, optionally only while a register holds a given
+// value. A watchpoint stops it after the instruction that reads or writes its
+// address, or under CPU_TIMING_CYCLE right after the access.
+//
+// Breakpoints are a bitmap with one bit per address, tested before each
+// instruction only while any is set. cpu_run then keeps to the table
+// interpreter and the cycle engine; the threaded interpreter, the block cache
+// and the recompiler come back when the last breakpoint goes. Watchpoints
+// cost nothing on pages without one: reads of a page with a read watchpoint
+// go through a handler that forwards to whatever was mapped there, and
+// writes to a page with a write watchpoint go through a write watcher, so
+// they work on every engine cpu_run picks. Remapping a page drops its read
+// watchpoints.
+//
+// Lanes (tiny6502_lanes.h) are the exception: they run each lane to its own
+// deadline and ignore cpu_stop_at, so neither breakpoints nor watchpoints
+// stop a lane.
+//
+// A CPUDebug uses one of the CPU's write watchers, added with
+// cpu_watch_add_stores so that remapping a page is not taken for a write.
+
+// Why the last run stopped.
+typedef enum {
+  CPU_STOP_BUDGET, // ran its cycles
+  CPU_STOP_BREAK, // reached a breakpoint; addr is the PC
+  CPU_STOP_READ, // read a watched address; addr and value say what
+  CPU_STOP_WRITE, // wrote a watched address; addr and value say what
+  CPU_STOP_REQUESTED, // a handler or watcher called cpu_stop_at
+} CPUStopReason;
+
+typedef struct {
+  CPUStopReason reason;
+  uint16_t addr;
+  uint8_t value;
+  uint64_t cycles; // consumed by the run
+} CPUStop;
+
+// The registers a breakpoint condition can test.
+typedef enum {
+  CPU_DEBUG_A,
+  CPU_DEBUG_X,
+  CPU_DEBUG_Y,
+  CPU_DEBUG_SP,
+  CPU_DEBUG_P, // as cpu_flags() packs it
+} CPUDebugRegister;
+
+#define CPU_DEBUG_CONDITIONS 32
+
+typedef struct {
+  uint16_t addr;
+  CPUDebugRegister reg;
+  uint8_t mask, value;
+} CPUDebugCondition;
+
+typedef struct CPUDebug {
+  CPU *cpu;
+  int watcher;
+
+  // The most recent stop, see cpu_debug_run.
+  CPUStop stop;
+
+  // Addresses with any breakpoint, and with one that always stops.
+  uint64_t breaks[0x10000 / 64];
+  uint64_t always[0x10000 / 64];
+  unsigned breakpoints;
+
+  // Breakpoints that stop while (register & mask) == value.
+  CPUDebugCondition conditions[CPU_DEBUG_CONDITIONS];
+  unsigned condition_count;
+
+  // Where the last breakpoint stopped, so that running on does not stop at
+  // it again before the instruction runs.
+  uint16_t broke_pc;
+  uint64_t broke_cycles;
+
+  // Watched addresses, and how many of them each page holds.
+  uint64_t reads[0x10000 / 64];
+  uint64_t writes[0x10000 / 64];
+  uint16_t page_reads[0x100];
+  uint16_t page_writes[0x100];
+
+  // What reads of each page with a read watchpoint went to before.
+  const uint8_t *host[0x100];
+  CPUReadHandler device[0x100];
+} CPUDebug;
+
+// Attaches debug to cpu with nothing set. Returns false if the CPU has no
+// watcher free.
+bool cpu_debug_attach(CPUDebug *debug, CPU *cpu);
+
+// Clears every breakpoint and watchpoint and detaches.
+void cpu_debug_detach(CPUDebug *debug);
+
+// Breakpoints at addr: one that always stops, or one that stops while
+// (register & mask) == value. Returns false once CPU_DEBUG_CONDITIONS
+// conditional breakpoints are set.
+void cpu_debug_break(CPUDebug *debug, uint16_t addr);
+bool cpu_debug_break_if(CPUDebug *debug, uint16_t addr, CPUDebugRegister reg,
+                        uint8_t mask, uint8_t value);
+
+// Removes every breakpoint at addr.
+void cpu_debug_clear(CPUDebug *debug, uint16_t addr);
+
+// Watches or stops watching reads, writes or both of size bytes from addr.
+void cpu_debug_watch(CPUDebug *debug, uint16_t addr, uint32_t size, bool read,
+                     bool write);
+void cpu_debug_unwatch(CPUDebug *debug, uint16_t addr, uint32_t size,
+                       bool read, bool write);
+
+// cpu_run, returning why it stopped. Running on from a breakpoint executes
+// the instruction there instead of stopping again. Plain cpu_run stops at
+// breakpoints and watchpoints too, and leaves the reason in debug->stop, or
+// CPU_STOP_BUDGET if none was hit.
+CPUStop cpu_debug_run(CPUDebug *debug, uint64_t cycle_budget);
+
+// Whether the last cpu_run stopped at a breakpoint or watchpoint. Loops that
+// call cpu_run until a budget is used up return when it did, so that the
+// stop is not run past.
+static inline bool cpu_debug_stopped(const CPU *cpu) {
+  return cpu->debug && cpu->debug->stop.reason != CPU_STOP_BUDGET;
+}
+
+// Called by the core before each instruction while breakpoints are set.
+bool cpu_debug_hit(CPUDebug *debug, CPU *cpu);
+
+static inline bool cpu_debug_breaks(CPUDebug *debug, CPU *cpu) {
+  uint16_t pc = cpu->PC;
+  return (debug->breaks[pc >> 6] >> (pc & 63) & 1) && cpu_debug_hit(debug, cpu);
+}
+
+#endif // TINY6502_DEBUG_H
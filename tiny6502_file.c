@@ -0,0 +1,139 @@
+#include "tiny6502_file.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct CPUFile {
+  CPUFileMode mode;
+  uint8_t *data;
+  size_t size;   // bytes in the file
+  size_t length; // bytes mapped, a whole number of host pages
+
+  // ROM files are shared through a list of those open, by file identity.
+  dev_t device;
+  ino_t inode;
+  unsigned opens;
+  CPUFile *next;
+};
+
+static pthread_mutex_t cpu_file_lock = PTHREAD_MUTEX_INITIALIZER;
+static CPUFile *cpu_file_roms;
+
+// Reserves zeroed pages for the file plus a page of 6502 padding, then maps
+// the file over their start. Reads past the end of the file then see zeros
+// rather than faulting.
+static bool cpu_file_map(CPUFile *file, int fd) {
+  size_t host_page = sysconf(_SC_PAGESIZE);
+  file->length = (file->size + 0xFF + host_page - 1) / host_page * host_page;
+
+  int prot = file->mode == CPU_FILE_ROM ? PROT_READ : PROT_READ | PROT_WRITE;
+  void *data =
+      mmap(NULL, file->length, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED)
+    return false;
+  int flags = file->mode == CPU_FILE_PRIVATE ? MAP_PRIVATE : MAP_SHARED;
+  if (mmap(data, file->size, prot, flags | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(data, file->length);
+    return false;
+  }
+  file->data = data;
+  return true;
+}
+
+CPUFile *cpu_file_open(const char *path, CPUFileMode mode, size_t size) {
+  int fd = mode == CPU_FILE_RAM ? open(path, O_RDWR | O_CREAT, 0666)
+                                : open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
+  }
+  if (mode == CPU_FILE_RAM && (size_t)st.st_size < size) {
+    if (ftruncate(fd, size) < 0) {
+      close(fd);
+      return NULL;
+    }
+    st.st_size = size;
+  }
+  if (!st.st_size) {
+    close(fd);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&cpu_file_lock);
+  CPUFile *file = NULL;
+  if (mode == CPU_FILE_ROM) {
+    for (file = cpu_file_roms; file; file = file->next)
+      if (file->device == st.st_dev && file->inode == st.st_ino)
+        break;
+  }
+  if (file) {
+    file->opens++;
+  } else if ((file = calloc(1, sizeof(*file)))) {
+    *file = (CPUFile){.mode = mode,
+                      .size = st.st_size,
+                      .device = st.st_dev,
+                      .inode = st.st_ino,
+                      .opens = 1};
+    if (!cpu_file_map(file, fd)) {
+      free(file);
+      file = NULL;
+    } else if (mode == CPU_FILE_ROM) {
+      file->next = cpu_file_roms;
+      cpu_file_roms = file;
+    }
+  }
+  pthread_mutex_unlock(&cpu_file_lock);
+  close(fd);
+  return file;
+}
+
+void cpu_file_close(CPUFile *file) {
+  if (!file)
+    return;
+  pthread_mutex_lock(&cpu_file_lock);
+  bool last = --file->opens == 0;
+  if (last && file->mode == CPU_FILE_ROM) {
+    CPUFile **link = &cpu_file_roms;
+    while (*link != file)
+      link = &(*link)->next;
+    *link = file->next;
+  }
+  pthread_mutex_unlock(&cpu_file_lock);
+  if (!last)
+    return;
+  munmap(file->data, file->length);
+  free(file);
+}
+
+const uint8_t *cpu_file_data(const CPUFile *file) { return file->data; }
+
+size_t cpu_file_size(const CPUFile *file) { return file->size; }
+
+bool cpu_file_sync(CPUFile *file) {
+  if (file->mode != CPU_FILE_RAM)
+    return true;
+  size_t host_page = sysconf(_SC_PAGESIZE);
+  size_t length = (file->size + host_page - 1) / host_page * host_page;
+  return msync(file->data, length, MS_SYNC) == 0;
+}
+
+bool cpu_map_file(CPU *cpu, uint16_t addr, CPUFile *file, size_t offset,
+                  uint32_t size) {
+  // The pages start where addr's page does, which must be in the file too.
+  if (offset > file->size || size > file->size - offset ||
+      addr + size > 0x10000 || offset < (addr & 0xFFu))
+    return false;
+  uint8_t *host = file->data + offset - (addr & 0xFF);
+  if (file->mode == CPU_FILE_ROM)
+    cpu_map_rom(cpu, addr, size + (addr & 0xFF), host);
+  else
+    cpu_map_ram(cpu, addr, size + (addr & 0xFF), host);
+  return true;
+}
@@ -0,0 +1,55 @@
+#ifndef TINY6502_FILE_H
+#define TINY6502_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Address ranges backed directly by mmap()ed files, so a machine's ROM and
+// RAM need not be copied into its Memory array.
+//
+// A ROM file is mapped read-only once per process: opening the same file
+// again, from any thread, returns the same mapping, so any number of CPUs
+// running one ROM share a single physical copy. A RAM file is mapped shared
+// and writable, so what the CPU stores lands in the file and persists across
+// runs. A private file is a copy-on-write image: the CPU may write to it, but
+// the writes stay in the process.
+//
+// Mappings are padded with zeros to a whole number of pages past the end of
+// the file, so a file need not fill its last page. A file must stay open as
+// long as any CPU maps it.
+
+typedef enum {
+  CPU_FILE_ROM,
+  CPU_FILE_RAM,
+  CPU_FILE_PRIVATE,
+} CPUFileMode;
+
+typedef struct CPUFile CPUFile;
+
+// Opens and maps path. A RAM file is created if missing and grown with zeros
+// to at least size bytes; size is otherwise ignored. Returns NULL if the file
+// cannot be opened or mapped, or is empty.
+CPUFile *cpu_file_open(const char *path, CPUFileMode mode, size_t size);
+
+// Unmaps the file once every open of it is closed. NULL is ignored.
+void cpu_file_close(CPUFile *file);
+
+const uint8_t *cpu_file_data(const CPUFile *file);
+size_t cpu_file_size(const CPUFile *file);
+
+// Writes a RAM file's changes back to disk now rather than whenever the
+// system gets to them.
+bool cpu_file_sync(CPUFile *file);
+
+// Maps size bytes of the file from offset at addr, with cpu_map_rom() for a
+// ROM file and cpu_map_ram() otherwise. Mappings are whole pages, so when
+// addr is not on a page boundary the start of its page shows the bytes just
+// before offset. Returns false if the range runs outside the file or the
+// address space.
+bool cpu_map_file(CPU *cpu, uint16_t addr, CPUFile *file, size_t offset,
+                  uint32_t size);
+
+#endif // TINY6502_FILE_H
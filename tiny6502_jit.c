@@ -0,0 +1,1233 @@
+#define _DEFAULT_SOURCE
+#include "tiny6502_jit.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tiny6502_ops.h"
+#include "tiny6502_trace.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) ||       \
+                            defined(__FreeBSD__))
+#define CPU_JIT_X64
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <pthread.h>
+#endif
+#endif
+
+#define INTERRUPT_PENDING(c) ((c)->NMI || ((c)->IRQ && !(c)->P.flags.I))
+
+#define JIT_SLOTS 4096
+#define JIT_BLOCK_OPS 32
+
+// Executions of an address before the code there is translated.
+#ifndef TINY6502_JIT_HOT
+#define TINY6502_JIT_HOT 16
+#endif
+
+#define JIT_CODE_SIZE (4u << 20)
+
+// Room reserved per translated instruction and per block; generous upper
+// bounds on what the emitters below produce.
+#define JIT_OP_BYTES 1024
+#define JIT_BLOCK_BYTES (JIT_BLOCK_OPS * JIT_OP_BYTES + 256)
+
+typedef struct {
+  const void *code;
+  uint32_t generation;
+  uint16_t pc;
+  uint16_t hits;
+} CPUJitSlot;
+
+typedef void (*CPUJitEntry)(CPU *cpu, const void *code);
+
+struct CPUJit {
+  CPU *cpu;
+  int watcher;
+
+  // Bumped on the first write to, or remap of, a page holding translations.
+  uint32_t generation[0x100];
+
+  // Direct mapped by start address. Translated code looks up the next block
+  // here too, so the layout is fixed.
+  CPUJitSlot slots[JIT_SLOTS];
+
+  uint8_t *code;
+  size_t used;
+
+  // The shared entry and exit sequences at the start of the code buffer.
+  CPUJitEntry enter;
+  const uint8_t *leave;
+  size_t base;
+};
+
+void cpu_jit_enable(CPUJit *jit, bool on) { jit->cpu->jit = on ? jit : NULL; }
+
+#ifdef CPU_JIT_X64
+
+_Static_assert(sizeof(CPUJitSlot) == 16, "slots are indexed by shift");
+
+static void cpu_jit_written(CPU *cpu, void *data, uint16_t addr,
+                            uint8_t value) {
+  (void)value;
+  CPUJit *jit = data;
+  unsigned page = addr >> 8;
+  jit->generation[page]++;
+  cpu_watch_page(cpu, jit->watcher, page, false);
+}
+
+// x86-64 encoding. Only the forms the translator needs are covered.
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R12 = 12, R13, R14, R15 };
+
+// Where the 6502 state lives while translated code runs. RSP points at the
+// frame: scratch at +0 and the slow-path flag at +8. The deadline is read
+// from the CPU, where handlers may bring it forward.
+#define JIT_CPU RBX
+#define JIT_CYCLES RBP
+#define JIT_A R12
+#define JIT_X R13
+#define JIT_Y R14
+#define JIT_P R15
+
+#define FRAME_SCRATCH 0
+#define FRAME_SLOW 8
+#define FRAME_SIZE 24
+
+enum { ALU_ADD, ALU_OR, ALU_ADC, ALU_SBB, ALU_AND, ALU_SUB, ALU_XOR, ALU_CMP };
+enum { CC_B = 2, CC_AE, CC_E, CC_NE };
+
+#define OFF(field) ((int32_t)offsetof(CPU, field))
+#define OFF_READ(page) (OFF(pages.read) + (int32_t)(page) * 8)
+#define OFF_WRITE(page) (OFF(pages.write) + (int32_t)(page) * 8)
+
+// A pending jump to the exit that stores pc and leaves translated code.
+typedef struct {
+  uint8_t *rel;
+  uint16_t pc;
+} CPUJitExit;
+
+typedef struct {
+  CPUJit *jit;
+  uint8_t *at;
+  CPUJitExit exits[JIT_BLOCK_OPS * 8 + 4];
+  unsigned exit_count;
+} CPUJitEmit;
+
+static void x64_byte(CPUJitEmit *e, uint8_t value) { *e->at++ = value; }
+
+static void x64_u16(CPUJitEmit *e, uint16_t value) {
+  memcpy(e->at, &value, 2);
+  e->at += 2;
+}
+
+static void x64_u32(CPUJitEmit *e, uint32_t value) {
+  memcpy(e->at, &value, 4);
+  e->at += 4;
+}
+
+static void x64_u64(CPUJitEmit *e, uint64_t value) {
+  memcpy(e->at, &value, 8);
+  e->at += 8;
+}
+
+// Opcodes above 0xFF are two-byte 0x0F opcodes. REX is always emitted for
+// registers 8 and up, which also makes byte operands of those registers
+// addressable; byte operands elsewhere only use AL, CL and DL.
+static void x64_opcode(CPUJitEmit *e, bool wide, unsigned op, unsigned reg,
+                       unsigned index, unsigned base) {
+  uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) |
+                (base >> 3);
+  if (rex != 0x40)
+    x64_byte(e, rex);
+  if (op > 0xFF)
+    x64_byte(e, op >> 8);
+  x64_byte(e, op);
+}
+
+// op reg, rm with both operands registers.
+static void x64_rr(CPUJitEmit *e, bool wide, unsigned op, unsigned reg,
+                   unsigned rm) {
+  x64_opcode(e, wide, op, reg, 0, rm);
+  x64_byte(e, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+static void x64_disp(CPUJitEmit *e, unsigned reg, unsigned rm, unsigned base,
+                     int32_t disp) {
+  if (disp == 0 && (base & 7) != RBP) {
+    x64_byte(e, (reg & 7) << 3 | rm);
+  } else if (disp >= -128 && disp < 128) {
+    x64_byte(e, 0x40 | (reg & 7) << 3 | rm);
+  } else {
+    x64_byte(e, 0x80 | (reg & 7) << 3 | rm);
+  }
+}
+
+static void x64_disp_value(CPUJitEmit *e, unsigned base, int32_t disp) {
+  if (disp == 0 && (base & 7) != RBP)
+    return;
+  if (disp >= -128 && disp < 128)
+    x64_byte(e, (uint8_t)disp);
+  else
+    x64_u32(e, disp);
+}
+
+// op reg, [base + disp]
+static void x64_rm(CPUJitEmit *e, bool wide, unsigned op, unsigned reg,
+                   unsigned base, int32_t disp) {
+  x64_opcode(e, wide, op, reg, 0, base);
+  x64_disp(e, reg, base & 7, base, disp);
+  if ((base & 7) == RSP)
+    x64_byte(e, 0x24);
+  x64_disp_value(e, base, disp);
+}
+
+// op reg, [base + index << scale + disp]
+static void x64_rmi(CPUJitEmit *e, bool wide, unsigned op, unsigned reg,
+                    unsigned base, unsigned index, unsigned scale,
+                    int32_t disp) {
+  x64_opcode(e, wide, op, reg, index, base);
+  x64_disp(e, reg, RSP, base, disp);
+  x64_byte(e, scale << 6 | (index & 7) << 3 | (base & 7));
+  x64_disp_value(e, base, disp);
+}
+
+static void x64_alu_ri(CPUJitEmit *e, bool wide, unsigned alu, unsigned rm,
+                       int32_t imm) {
+  if (imm >= -128 && imm < 128) {
+    x64_rr(e, wide, 0x83, alu, rm);
+    x64_byte(e, (uint8_t)imm);
+  } else {
+    x64_rr(e, wide, 0x81, alu, rm);
+    x64_u32(e, imm);
+  }
+}
+
+static void x64_mov_ri(CPUJitEmit *e, unsigned reg, uint32_t imm) {
+  x64_opcode(e, false, 0xB8 + (reg & 7), 0, 0, reg);
+  x64_u32(e, imm);
+}
+
+static void x64_mov_ri64(CPUJitEmit *e, unsigned reg, const void *imm) {
+  x64_opcode(e, true, 0xB8 + (reg & 7), 0, 0, reg);
+  x64_u64(e, (uint64_t)(uintptr_t)imm);
+}
+
+// mov byte [base + disp], imm
+static void x64_store8(CPUJitEmit *e, unsigned base, int32_t disp,
+                       uint8_t imm) {
+  x64_rm(e, false, 0xC6, 0, base, disp);
+  x64_byte(e, imm);
+}
+
+// cmp byte [base + disp], imm
+static void x64_cmp8(CPUJitEmit *e, unsigned base, int32_t disp,
+                     uint8_t imm) {
+  x64_rm(e, false, 0x80, ALU_CMP, base, disp);
+  x64_byte(e, imm);
+}
+
+static void x64_shift(CPUJitEmit *e, unsigned ext, unsigned rm, uint8_t by) {
+  x64_rr(e, false, 0xC1, ext, rm);
+  x64_byte(e, by);
+}
+
+#define SHL 4
+#define SHR 5
+
+// Jumps with a 32-bit displacement, returned for x64_patch.
+static uint8_t *x64_jcc(CPUJitEmit *e, unsigned cc) {
+  x64_byte(e, 0x0F);
+  x64_byte(e, 0x80 | cc);
+  e->at += 4;
+  return e->at - 4;
+}
+
+static uint8_t *x64_jmp(CPUJitEmit *e) {
+  x64_byte(e, 0xE9);
+  e->at += 4;
+  return e->at - 4;
+}
+
+static void x64_patch(uint8_t *rel, const uint8_t *target) {
+  int32_t disp = (int32_t)(target - (rel + 4));
+  memcpy(rel, &disp, 4);
+}
+
+static void x64_call(CPUJitEmit *e, const void *fn) {
+  x64_mov_ri64(e, RAX, fn);
+  x64_rr(e, false, 0xFF, 2, RAX);
+}
+
+// Moving the 6502 state between host registers and the CPU.
+
+// Translated code keeps P packed; the CPU keeps N, Z, V and C apart, see
+// CPU.P. Spilling clobbers EDX, reloading ECX and EDX.
+static void jit_spill(CPUJitEmit *e) {
+  x64_rm(e, false, 0x88, JIT_A, JIT_CPU, OFF(A));
+  x64_rm(e, false, 0x88, JIT_X, JIT_CPU, OFF(X));
+  x64_rm(e, false, 0x88, JIT_Y, JIT_CPU, OFF(Y));
+  x64_rm(e, false, 0x88, JIT_P, JIT_CPU, OFF(P));
+  x64_rm(e, false, 0x88, JIT_P, JIT_CPU, OFF(flag_n));
+  x64_rr(e, false, 0x89, JIT_P, RDX);
+  x64_alu_ri(e, false, ALU_AND, RDX, 0x02);
+  x64_alu_ri(e, false, ALU_XOR, RDX, 0x02);
+  x64_rm(e, false, 0x88, RDX, JIT_CPU, OFF(flag_z));
+  x64_rmi(e, false, 0x8D, RDX, JIT_P, JIT_P, 0, 0);
+  x64_rm(e, false, 0x88, RDX, JIT_CPU, OFF(flag_v));
+  x64_rr(e, false, 0x89, JIT_P, RDX);
+  x64_alu_ri(e, false, ALU_AND, RDX, 0x01);
+  x64_rm(e, false, 0x88, RDX, JIT_CPU, OFF(flag_c));
+  x64_rm(e, true, 0x89, JIT_CYCLES, JIT_CPU, OFF(cycles));
+}
+
+static void jit_reload(CPUJitEmit *e) {
+  x64_rm(e, false, 0x0FB6, JIT_A, JIT_CPU, OFF(A));
+  x64_rm(e, false, 0x0FB6, JIT_X, JIT_CPU, OFF(X));
+  x64_rm(e, false, 0x0FB6, JIT_Y, JIT_CPU, OFF(Y));
+  x64_rm(e, false, 0x0FB6, JIT_P, JIT_CPU, OFF(P));
+  x64_alu_ri(e, false, ALU_AND, JIT_P, 0x3C);
+  x64_rm(e, false, 0x0FB6, RDX, JIT_CPU, OFF(flag_n));
+  x64_alu_ri(e, false, ALU_AND, RDX, 0x80);
+  x64_rr(e, false, 0x09, RDX, JIT_P);
+  x64_rm(e, false, 0x0FB6, RDX, JIT_CPU, OFF(flag_v));
+  x64_alu_ri(e, false, ALU_AND, RDX, 0x80);
+  x64_shift(e, SHR, RDX, 1);
+  x64_rr(e, false, 0x09, RDX, JIT_P);
+  x64_rm(e, false, 0x0FB6, RDX, JIT_CPU, OFF(flag_c));
+  x64_rr(e, false, 0x09, RDX, JIT_P);
+  x64_rr(e, false, 0x31, RCX, RCX);
+  x64_cmp8(e, JIT_CPU, OFF(flag_z), 0);
+  x64_rr(e, false, 0x0F94, 0, RCX);
+  x64_rmi(e, false, 0x8D, JIT_P, JIT_P, RCX, 1, 0);
+  x64_rm(e, true, 0x8B, JIT_CYCLES, JIT_CPU, OFF(cycles));
+}
+
+static void jit_exit_on(CPUJitEmit *e, unsigned cc, uint16_t pc) {
+  e->exits[e->exit_count++] = (CPUJitExit){x64_jcc(e, cc), pc};
+}
+
+static void jit_store_pc(CPUJitEmit *e, uint16_t pc) {
+  x64_byte(e, 0x66);
+  x64_rm(e, false, 0xC7, 0, JIT_CPU, OFF(PC));
+  x64_u16(e, pc);
+}
+
+// Calls into the core. The state is spilled first, with pc, the address of
+// the next instruction, as the PC, so that handlers see the CPU as the
+// interpreter would show it to them; it is reloaded after in case they
+// changed it. The slow-path flag makes the instruction check for interrupts
+// and invalidation once it completes.
+static void jit_call_read(CPUJitEmit *e, uint16_t pc) {
+  jit_store_pc(e, pc);
+  jit_spill(e);
+  x64_rr(e, true, 0x89, JIT_CPU, RDI);
+  x64_rr(e, false, 0x89, RCX, RSI);
+  x64_call(e, (const void *)cpu_read);
+  x64_rr(e, false, 0x0FB6, RAX, RAX);
+  x64_store8(e, RSP, FRAME_SLOW, 1);
+  jit_reload(e);
+}
+
+static void jit_call_write(CPUJitEmit *e, uint16_t pc) {
+  jit_store_pc(e, pc);
+  jit_spill(e);
+  x64_rr(e, false, 0x89, RAX, RDX);
+  x64_rr(e, false, 0x89, RCX, RSI);
+  x64_rr(e, true, 0x89, JIT_CPU, RDI);
+  x64_call(e, (const void *)cpu_write);
+  x64_store8(e, RSP, FRAME_SLOW, 1);
+  jit_reload(e);
+}
+
+// Reads the byte at the address in ECX into EAX, for the instruction ending
+// at pc.
+static void jit_read(CPUJitEmit *e, uint16_t pc) {
+  x64_rr(e, false, 0x89, RCX, RDX);
+  x64_shift(e, SHR, RDX, 8);
+  x64_rmi(e, true, 0x8B, RAX, JIT_CPU, RDX, 3, OFF(pages.read));
+  x64_rr(e, true, 0x85, RAX, RAX);
+  uint8_t *slow = x64_jcc(e, CC_E);
+  x64_rr(e, false, 0x0FB6, RDX, RCX);
+  x64_rmi(e, false, 0x0FB6, RAX, RAX, RDX, 0, 0);
+  uint8_t *done = x64_jmp(e);
+  x64_patch(slow, e->at);
+  jit_call_read(e, pc);
+  x64_patch(done, e->at);
+}
+
+static void jit_read_const(CPUJitEmit *e, uint16_t addr, uint16_t pc) {
+  x64_rm(e, true, 0x8B, RAX, JIT_CPU, OFF_READ(addr >> 8));
+  x64_rr(e, true, 0x85, RAX, RAX);
+  uint8_t *slow = x64_jcc(e, CC_E);
+  x64_rm(e, false, 0x0FB6, RAX, RAX, addr & 0xFF);
+  uint8_t *done = x64_jmp(e);
+  x64_patch(slow, e->at);
+  x64_mov_ri(e, RCX, addr);
+  jit_call_read(e, pc);
+  x64_patch(done, e->at);
+}
+
+// Writes AL to the address in ECX, for the instruction ending at pc.
+static void jit_write(CPUJitEmit *e, uint16_t pc) {
+  x64_rr(e, false, 0x89, RCX, RDX);
+  x64_shift(e, SHR, RDX, 8);
+  x64_rmi(e, true, 0x8B, RDX, JIT_CPU, RDX, 3, OFF(pages.write));
+  x64_rr(e, true, 0x85, RDX, RDX);
+  uint8_t *slow = x64_jcc(e, CC_E);
+  x64_rr(e, false, 0x0FB6, RCX, RCX);
+  x64_rmi(e, false, 0x88, RAX, RDX, RCX, 0, 0);
+  uint8_t *done = x64_jmp(e);
+  x64_patch(slow, e->at);
+  jit_call_write(e, pc);
+  x64_patch(done, e->at);
+}
+
+static void jit_write_const(CPUJitEmit *e, uint16_t addr, uint16_t pc) {
+  x64_rm(e, true, 0x8B, RDX, JIT_CPU, OFF_WRITE(addr >> 8));
+  x64_rr(e, true, 0x85, RDX, RDX);
+  uint8_t *slow = x64_jcc(e, CC_E);
+  x64_rm(e, false, 0x88, RAX, RDX, addr & 0xFF);
+  uint8_t *done = x64_jmp(e);
+  x64_patch(slow, e->at);
+  x64_mov_ri(e, RCX, addr);
+  jit_call_write(e, pc);
+  x64_patch(done, e->at);
+}
+
+// Translation of single instructions.
+
+typedef struct {
+  uint16_t pc;
+  uint16_t operand;
+  uint8_t opcode;
+  uint8_t mnemonic;
+  uint8_t mode;
+  uint8_t length;
+  uint8_t cycles;
+} CPUJitOp;
+
+#define MNEMONICS(X)                                                           \
+  X(ADC) X(AND) X(ASL) X(BCC) X(BCS) X(BEQ) X(BIT) X(BMI) X(BNE) X(BPL)        \
+  X(BRK) X(BVC) X(BVS) X(CLC) X(CLD) X(CLI) X(CLV) X(CMP) X(CPX) X(CPY)        \
+  X(DEC) X(DEX) X(DEY) X(EOR) X(INC) X(INX) X(INY) X(JMP) X(JSR) X(LDA)        \
+  X(LDX) X(LDY) X(LSR) X(NOP) X(ORA) X(PHA) X(PHP) X(PLA) X(PLP) X(ROL)        \
+  X(ROR) X(RTI) X(RTS) X(SBC) X(SEC) X(SED) X(SEI) X(STA) X(STX) X(STY)        \
+  X(TAX) X(TAY) X(TSX) X(TXA) X(TXS) X(TYA) X(ILL)
+
+#define ENUM(mn) JIT_##mn,
+enum { MNEMONICS(ENUM) };
+#undef ENUM
+
+#define ENTRY(code, mn, mode, cycles, page_cycles) [code] = JIT_##mn,
+static const uint8_t cpu_jit_mnemonics[256] = {TINY6502_OPCODES(ENTRY)};
+#undef ENTRY
+
+// Sets N and Z from the low byte of reg.
+static void jit_nz(CPUJitEmit *e, unsigned reg) {
+  x64_alu_ri(e, false, ALU_AND, JIT_P, 0x7D);
+  x64_rr(e, false, 0x31, RDX, RDX);
+  x64_rr(e, false, 0x84, reg, reg);
+  x64_rr(e, false, 0x0F94, 0, RDX);
+  x64_rmi(e, false, 0x8D, JIT_P, JIT_P, RDX, 1, 0);
+  x64_rr(e, false, 0x89, reg, RDX);
+  x64_alu_ri(e, false, ALU_AND, RDX, 0x80);
+  x64_rr(e, false, 0x09, RDX, JIT_P);
+}
+
+// Replaces C with bit 0 of ECX.
+static void jit_set_carry(CPUJitEmit *e) {
+  x64_alu_ri(e, false, ALU_AND, JIT_P, 0xFE);
+  x64_rr(e, false, 0x09, RCX, JIT_P);
+}
+
+// Leaves the effective address of a memory operand in ECX.
+static void jit_address(CPUJitEmit *e, const CPUJitOp *op) {
+  uint16_t next = op->pc + op->length;
+  switch (op->mode) {
+  case ZP:
+  case ABS:
+    x64_mov_ri(e, RCX, op->operand);
+    break;
+  case ZPX:
+  case ZPY:
+    x64_rm(e, false, 0x8D, RCX, op->mode == ZPX ? JIT_X : JIT_Y, op->operand);
+    x64_rr(e, false, 0x0FB6, RCX, RCX);
+    break;
+  case ABSX:
+  case ABSY:
+    x64_rm(e, false, 0x8D, RCX, op->mode == ABSX ? JIT_X : JIT_Y,
+           op->operand);
+    x64_rr(e, false, 0x0FB7, RCX, RCX);
+    break;
+  case INDX:
+    x64_rm(e, false, 0x8D, RCX, JIT_X, op->operand);
+    x64_rr(e, false, 0x0FB6, RCX, RCX);
+    x64_rm(e, false, 0x89, RCX, RSP, FRAME_SCRATCH);
+    jit_read(e, next);
+    x64_rm(e, false, 0x89, RAX, RSP, FRAME_SCRATCH + 4);
+    x64_rm(e, false, 0x8B, RCX, RSP, FRAME_SCRATCH);
+    x64_alu_ri(e, false, ALU_ADD, RCX, 1);
+    x64_rr(e, false, 0x0FB6, RCX, RCX);
+    jit_read(e, next);
+    x64_shift(e, SHL, RAX, 8);
+    x64_rm(e, false, 0x0B, RAX, RSP, FRAME_SCRATCH + 4);
+    x64_rr(e, false, 0x89, RAX, RCX);
+    break;
+  case INDY:
+    jit_read_const(e, op->operand, next);
+    x64_rm(e, false, 0x89, RAX, RSP, FRAME_SCRATCH + 4);
+    jit_read_const(e, (op->operand + 1) & 0xFF, next);
+    x64_shift(e, SHL, RAX, 8);
+    x64_rm(e, false, 0x0B, RAX, RSP, FRAME_SCRATCH + 4);
+    x64_rr(e, false, 0x01, JIT_Y, RAX);
+    x64_rr(e, false, 0x0FB7, RCX, RAX);
+    break;
+  }
+}
+
+// Leaves the operand of a reading instruction in EAX.
+static void jit_operand(CPUJitEmit *e, const CPUJitOp *op) {
+  switch (op->mode) {
+  case IMM:
+    x64_mov_ri(e, RAX, op->operand);
+    break;
+  case ZP:
+  case ABS:
+    jit_read_const(e, op->operand, op->pc + op->length);
+    break;
+  default:
+    jit_address(e, op);
+    jit_read(e, op->pc + op->length);
+    break;
+  }
+}
+
+static void jit_store(CPUJitEmit *e, const CPUJitOp *op, unsigned reg) {
+  uint16_t next = op->pc + op->length;
+  if (op->mode == ZP || op->mode == ABS) {
+    x64_rr(e, false, 0x89, reg, RAX);
+    jit_write_const(e, op->operand, next);
+  } else {
+    jit_address(e, op);
+    x64_rr(e, false, 0x89, reg, RAX);
+    jit_write(e, next);
+  }
+}
+
+static void jit_load(CPUJitEmit *e, const CPUJitOp *op, unsigned reg) {
+  jit_operand(e, op);
+  x64_rr(e, false, 0x89, RAX, reg);
+  jit_nz(e, reg);
+}
+
+static void jit_adc(CPUJitEmit *e) {
+  x64_rr(e, false, 0x89, JIT_P, RDX);
+  x64_alu_ri(e, false, ALU_AND, RDX, 1);
+  x64_rr(e, false, 0x01, RAX, RDX);
+  x64_rr(e, false, 0x01, JIT_A, RDX);
+  // V from the signs: set when A and the operand agree and the result
+  // differs.
+  x64_rr(e, false, 0x89, JIT_A, RCX);
+  x64_rr(e, false, 0x31, RDX, RCX);
+  x64_rr(e, false, 0x31, RDX, RAX);
+  x64_rr(e, false, 0x21, RCX, RAX);
+  x64_alu_ri(e, false, ALU_AND, RAX, 0x80);
+  x64_shift(e, SHR, RAX, 1);
+  x64_alu_ri(e, false, ALU_AND, JIT_P, 0x3C);
+  x64_rr(e, false, 0x09, RAX, JIT_P);
+  x64_rr(e, false, 0x89, RDX, RAX);
+  x64_shift(e, SHR, RAX, 8);
+  x64_rr(e, false, 0x09, RAX, JIT_P);
+  x64_rr(e, false, 0x0FB6, JIT_A, RDX);
+  jit_nz(e, JIT_A);
+}
+
+static void jit_compare(CPUJitEmit *e, unsigned reg) {
+  x64_rr(e, false, 0x31, RCX, RCX);
+  x64_rr(e, false, 0x39, RAX, reg);
+  x64_rr(e, false, 0x0F93, 0, RCX);
+  jit_set_carry(e);
+  x64_rr(e, false, 0x89, reg, RCX);
+  x64_rr(e, false, 0x29, RAX, RCX);
+  jit_nz(e, RCX);
+}
+
+static void jit_bit(CPUJitEmit *e) {
+  x64_alu_ri(e, false, ALU_AND, JIT_P, 0x3D);
+  x64_rr(e, false, 0x89, RAX, RCX);
+  x64_alu_ri(e, false, ALU_AND, RCX, 0xC0);
+  x64_rr(e, false, 0x09, RCX, JIT_P);
+  x64_rr(e, false, 0x31, RDX, RDX);
+  x64_rr(e, false, 0x84, RAX, JIT_A);
+  x64_rr(e, false, 0x0F94, 0, RDX);
+  x64_rmi(e, false, 0x8D, JIT_P, JIT_P, RDX, 1, 0);
+}
+
+// Shifts, rotates and increments of the byte in EAX.
+static void jit_modify(CPUJitEmit *e, unsigned mnemonic) {
+  switch (mnemonic) {
+  case JIT_ASL:
+    x64_rr(e, false, 0x89, RAX, RCX);
+    x64_shift(e, SHR, RCX, 7);
+    x64_rr(e, false, 0x01, RAX, RAX);
+    break;
+  case JIT_LSR:
+    x64_rr(e, false, 0x89, RAX, RCX);
+    x64_alu_ri(e, false, ALU_AND, RCX, 1);
+    x64_shift(e, SHR, RAX, 1);
+    break;
+  case JIT_ROL:
+    x64_rr(e, false, 0x89, JIT_P, RCX);
+    x64_alu_ri(e, false, ALU_AND, RCX, 1);
+    x64_rmi(e, false, 0x8D, RAX, RCX, RAX, 1, 0);
+    x64_rr(e, false, 0x89, RAX, RCX);
+    x64_shift(e, SHR, RCX, 8);
+    break;
+  case JIT_ROR:
+    x64_rr(e, false, 0x89, JIT_P, RCX);
+    x64_alu_ri(e, false, ALU_AND, RCX, 1);
+    x64_shift(e, SHL, RCX, 8);
+    x64_rr(e, false, 0x09, RCX, RAX);
+    x64_rr(e, false, 0x89, RAX, RCX);
+    x64_alu_ri(e, false, ALU_AND, RCX, 1);
+    x64_shift(e, SHR, RAX, 1);
+    break;
+  case JIT_INC:
+    x64_alu_ri(e, false, ALU_ADD, RAX, 1);
+    break;
+  case JIT_DEC:
+    x64_alu_ri(e, false, ALU_SUB, RAX, 1);
+    break;
+  }
+  if (mnemonic != JIT_INC && mnemonic != JIT_DEC)
+    jit_set_carry(e);
+  x64_rr(e, false, 0x0FB6, RAX, RAX);
+  jit_nz(e, RAX);
+}
+
+static void jit_read_modify_write(CPUJitEmit *e, const CPUJitOp *op) {
+  uint16_t next = op->pc + op->length;
+  if (op->mode == ACC) {
+    x64_rr(e, false, 0x89, JIT_A, RAX);
+    jit_modify(e, op->mnemonic);
+    x64_rr(e, false, 0x89, RAX, JIT_A);
+  } else if (op->mode == ZP || op->mode == ABS) {
+    jit_read_const(e, op->operand, next);
+    jit_modify(e, op->mnemonic);
+    jit_write_const(e, op->operand, next);
+  } else {
+    jit_address(e, op);
+    x64_rm(e, false, 0x89, RCX, RSP, FRAME_SCRATCH);
+    jit_read(e, next);
+    jit_modify(e, op->mnemonic);
+    x64_rm(e, false, 0x8B, RCX, RSP, FRAME_SCRATCH);
+    jit_write(e, next);
+  }
+}
+
+// Leaves the stack address of a push in ECX and moves SP on.
+static void jit_push_address(CPUJitEmit *e) {
+  x64_rm(e, false, 0x0FB6, RCX, JIT_CPU, OFF(SP));
+  x64_alu_ri(e, false, ALU_OR, RCX, 0x100);
+  x64_rm(e, false, 0xFE, 1, JIT_CPU, OFF(SP));
+}
+
+static void jit_pop(CPUJitEmit *e, uint16_t pc) {
+  x64_rm(e, false, 0xFE, 0, JIT_CPU, OFF(SP));
+  x64_rm(e, false, 0x0FB6, RCX, JIT_CPU, OFF(SP));
+  x64_alu_ri(e, false, ALU_OR, RCX, 0x100);
+  jit_read(e, pc);
+}
+
+static void jit_transfer(CPUJitEmit *e, unsigned from, unsigned to) {
+  x64_rr(e, false, 0x89, from, to);
+  jit_nz(e, to);
+}
+
+static void jit_increment(CPUJitEmit *e, unsigned reg, int32_t by) {
+  x64_alu_ri(e, false, ALU_ADD, reg, by);
+  x64_rr(e, false, 0x0FB6, reg, reg);
+  jit_nz(e, reg);
+}
+
+// Emits the body of a straight-line instruction. Returns false for
+// instructions that end a block.
+static bool jit_instruction(CPUJitEmit *e, const CPUJitOp *op) {
+  uint16_t next = op->pc + op->length;
+  switch (op->mnemonic) {
+  case JIT_LDA:
+    jit_load(e, op, JIT_A);
+    break;
+  case JIT_LDX:
+    jit_load(e, op, JIT_X);
+    break;
+  case JIT_LDY:
+    jit_load(e, op, JIT_Y);
+    break;
+  case JIT_STA:
+    jit_store(e, op, JIT_A);
+    break;
+  case JIT_STX:
+    jit_store(e, op, JIT_X);
+    break;
+  case JIT_STY:
+    jit_store(e, op, JIT_Y);
+    break;
+  case JIT_AND:
+  case JIT_ORA:
+  case JIT_EOR:
+    jit_operand(e, op);
+    x64_rr(e, false,
+           op->mnemonic == JIT_AND   ? 0x21
+           : op->mnemonic == JIT_ORA ? 0x09
+                                     : 0x31,
+           RAX, JIT_A);
+    jit_nz(e, JIT_A);
+    break;
+  case JIT_ADC:
+    jit_operand(e, op);
+    jit_adc(e);
+    break;
+  case JIT_SBC:
+    jit_operand(e, op);
+    x64_alu_ri(e, false, ALU_XOR, RAX, 0xFF);
+    jit_adc(e);
+    break;
+  case JIT_CMP:
+    jit_operand(e, op);
+    jit_compare(e, JIT_A);
+    break;
+  case JIT_CPX:
+    jit_operand(e, op);
+    jit_compare(e, JIT_X);
+    break;
+  case JIT_CPY:
+    jit_operand(e, op);
+    jit_compare(e, JIT_Y);
+    break;
+  case JIT_BIT:
+    jit_operand(e, op);
+    jit_bit(e);
+    break;
+  case JIT_ASL:
+  case JIT_LSR:
+  case JIT_ROL:
+  case JIT_ROR:
+  case JIT_INC:
+  case JIT_DEC:
+    jit_read_modify_write(e, op);
+    break;
+  case JIT_INX:
+    jit_increment(e, JIT_X, 1);
+    break;
+  case JIT_INY:
+    jit_increment(e, JIT_Y, 1);
+    break;
+  case JIT_DEX:
+    jit_increment(e, JIT_X, -1);
+    break;
+  case JIT_DEY:
+    jit_increment(e, JIT_Y, -1);
+    break;
+  case JIT_TAX:
+    jit_transfer(e, JIT_A, JIT_X);
+    break;
+  case JIT_TAY:
+    jit_transfer(e, JIT_A, JIT_Y);
+    break;
+  case JIT_TXA:
+    jit_transfer(e, JIT_X, JIT_A);
+    break;
+  case JIT_TYA:
+    jit_transfer(e, JIT_Y, JIT_A);
+    break;
+  case JIT_TSX:
+    x64_rm(e, false, 0x0FB6, JIT_X, JIT_CPU, OFF(SP));
+    jit_nz(e, JIT_X);
+    break;
+  case JIT_TXS:
+    x64_rm(e, false, 0x88, JIT_X, JIT_CPU, OFF(SP));
+    break;
+  case JIT_CLC:
+    x64_alu_ri(e, false, ALU_AND, JIT_P, 0xFE);
+    break;
+  case JIT_SEC:
+    x64_alu_ri(e, false, ALU_OR, JIT_P, 0x01);
+    break;
+  case JIT_CLI:
+    x64_alu_ri(e, false, ALU_AND, JIT_P, 0xFB);
+    break;
+  case JIT_SEI:
+    x64_alu_ri(e, false, ALU_OR, JIT_P, 0x04);
+    break;
+  case JIT_CLD:
+    x64_alu_ri(e, false, ALU_AND, JIT_P, 0xF7);
+    break;
+  case JIT_SED:
+    x64_alu_ri(e, false, ALU_OR, JIT_P, 0x08);
+    break;
+  case JIT_CLV:
+    x64_alu_ri(e, false, ALU_AND, JIT_P, 0xBF);
+    break;
+  case JIT_PHA:
+    jit_push_address(e);
+    x64_rr(e, false, 0x89, JIT_A, RAX);
+    jit_write(e, next);
+    break;
+  case JIT_PHP:
+    jit_push_address(e);
+    x64_rr(e, false, 0x89, JIT_P, RAX);
+    x64_alu_ri(e, false, ALU_OR, RAX, 0x30);
+    jit_write(e, next);
+    break;
+  case JIT_PLA:
+    jit_pop(e, next);
+    x64_rr(e, false, 0x89, RAX, JIT_A);
+    jit_nz(e, JIT_A);
+    break;
+  case JIT_PLP:
+    jit_pop(e, next);
+    x64_alu_ri(e, false, ALU_AND, RAX, 0xCF);
+    x64_rr(e, false, 0x89, RAX, JIT_P);
+    break;
+  case JIT_NOP:
+  case JIT_ILL:
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+static bool jit_touches_memory(const CPUJitOp *op) {
+  switch (op->mnemonic) {
+  case JIT_PHA:
+  case JIT_PHP:
+  case JIT_PLA:
+  case JIT_PLP:
+    return true;
+  default:
+    return op->mode != ACC && op->mode != IMP && op->mode != IMM;
+  }
+}
+
+static void jit_check_interrupts(CPUJitEmit *e, uint16_t pc) {
+  x64_cmp8(e, JIT_CPU, OFF(NMI), 0);
+  jit_exit_on(e, CC_NE, pc);
+  x64_cmp8(e, JIT_CPU, OFF(IRQ), 0);
+  uint8_t *done = x64_jcc(e, CC_E);
+  x64_rr(e, false, 0xF6, 0, JIT_P);
+  x64_byte(e, 0x04);
+  jit_exit_on(e, CC_E, pc);
+  x64_patch(done, e->at);
+}
+
+// Leaves at pc if a handler has brought the deadline forward so that the
+// rest of the block, ahead cycles before its last instruction, no longer
+// fits.
+static void jit_check_deadline(CPUJitEmit *e, uint16_t pc, uint32_t ahead) {
+  x64_rm(e, true, 0x8D, RAX, JIT_CYCLES, ahead);
+  x64_rm(e, true, 0x3B, RAX, JIT_CPU, OFF(deadline));
+  jit_exit_on(e, CC_AE, pc);
+}
+
+static void jit_check_generation(CPUJitEmit *e, uint16_t block_pc,
+                                 uint16_t pc) {
+  unsigned page = block_pc >> 8;
+  x64_mov_ri64(e, RAX, &e->jit->generation[page]);
+  x64_rm(e, false, 0x81, ALU_CMP, RAX, 0);
+  x64_u32(e, e->jit->generation[page]);
+  jit_exit_on(e, CC_NE, pc);
+}
+
+// Continues at the translation for pc if there is a valid one, otherwise
+// leaves translated code there.
+static void jit_chain(CPUJitEmit *e, uint16_t pc) {
+  CPUJitSlot *slot = &e->jit->slots[pc % JIT_SLOTS];
+  x64_mov_ri64(e, RDX, slot);
+  x64_byte(e, 0x66);
+  x64_rm(e, false, 0x81, ALU_CMP, RDX, offsetof(CPUJitSlot, pc));
+  x64_u16(e, pc);
+  jit_exit_on(e, CC_NE, pc);
+  x64_mov_ri64(e, RAX, &e->jit->generation[pc >> 8]);
+  x64_rm(e, false, 0x8B, RAX, RAX, 0);
+  x64_rm(e, false, 0x3B, RAX, RDX, offsetof(CPUJitSlot, generation));
+  jit_exit_on(e, CC_NE, pc);
+  x64_rm(e, true, 0x8B, RAX, RDX, offsetof(CPUJitSlot, code));
+  x64_rr(e, true, 0x85, RAX, RAX);
+  jit_exit_on(e, CC_E, pc);
+  x64_rr(e, false, 0xFF, 4, RAX);
+}
+
+// The same for a PC only known at run time, in cpu->PC.
+static void jit_chain_dynamic(CPUJitEmit *e) {
+  uint8_t *leave[5];
+  x64_cmp8(e, JIT_CPU, OFF(NMI), 0);
+  leave[0] = x64_jcc(e, CC_NE);
+  x64_cmp8(e, JIT_CPU, OFF(IRQ), 0);
+  uint8_t *enabled = x64_jcc(e, CC_E);
+  x64_rr(e, false, 0xF6, 0, JIT_P);
+  x64_byte(e, 0x04);
+  leave[1] = x64_jcc(e, CC_E);
+  x64_patch(enabled, e->at);
+
+  x64_rm(e, false, 0x0FB7, RCX, JIT_CPU, OFF(PC));
+  x64_rr(e, false, 0x89, RCX, RAX);
+  x64_alu_ri(e, false, ALU_AND, RAX, JIT_SLOTS - 1);
+  x64_shift(e, SHL, RAX, 4);
+  x64_mov_ri64(e, RDX, e->jit->slots);
+  x64_rr(e, true, 0x01, RAX, RDX);
+  x64_byte(e, 0x66);
+  x64_rm(e, false, 0x3B, RCX, RDX, offsetof(CPUJitSlot, pc));
+  leave[2] = x64_jcc(e, CC_NE);
+  x64_shift(e, SHR, RCX, 8);
+  x64_mov_ri64(e, RAX, e->jit->generation);
+  x64_rmi(e, false, 0x8B, RAX, RAX, RCX, 2, 0);
+  x64_rm(e, false, 0x3B, RAX, RDX, offsetof(CPUJitSlot, generation));
+  leave[3] = x64_jcc(e, CC_NE);
+  x64_rm(e, true, 0x8B, RAX, RDX, offsetof(CPUJitSlot, code));
+  x64_rr(e, true, 0x85, RAX, RAX);
+  leave[4] = x64_jcc(e, CC_E);
+  x64_rr(e, false, 0xFF, 4, RAX);
+
+  for (int i = 0; i < 5; i++)
+    x64_patch(leave[i], e->jit->leave);
+}
+
+// Instructions that end a block. Branches and JMP run natively and chain
+// to their target; the rest run their interpreter handler.
+static void jit_terminator(CPUJitEmit *e, const CPUJitOp *op,
+                           const uint8_t *start, uint16_t block_pc) {
+  static const uint8_t branch_flag[] = {
+      [JIT_BCC] = 0x01, [JIT_BCS] = 0x01, [JIT_BNE] = 0x02, [JIT_BEQ] = 0x02,
+      [JIT_BVC] = 0x40, [JIT_BVS] = 0x40, [JIT_BPL] = 0x80, [JIT_BMI] = 0x80};
+  uint16_t next = op->pc + op->length;
+
+  switch (op->mnemonic) {
+  case JIT_BCC:
+  case JIT_BCS:
+  case JIT_BNE:
+  case JIT_BEQ:
+  case JIT_BVC:
+  case JIT_BVS:
+  case JIT_BPL:
+  case JIT_BMI: {
+    uint16_t target = next + (int8_t)op->operand;
+    bool if_set = op->mnemonic == JIT_BCS || op->mnemonic == JIT_BEQ ||
+                  op->mnemonic == JIT_BVS || op->mnemonic == JIT_BMI;
+    x64_alu_ri(e, true, ALU_ADD, JIT_CYCLES, op->cycles);
+    x64_rr(e, false, 0xF6, 0, JIT_P);
+    x64_byte(e, branch_flag[op->mnemonic]);
+    uint8_t *not_taken = x64_jcc(e, if_set ? CC_E : CC_NE);
+    if (target == block_pc)
+      x64_patch(x64_jmp(e), start);
+    else
+      jit_chain(e, target);
+    x64_patch(not_taken, e->at);
+    jit_chain(e, next);
+    return;
+  }
+  case JIT_JMP:
+    if (op->mode == ABS) {
+      x64_alu_ri(e, true, ALU_ADD, JIT_CYCLES, op->cycles);
+      if (op->operand == block_pc)
+        x64_patch(x64_jmp(e), start);
+      else
+        jit_chain(e, op->operand);
+      return;
+    }
+    break;
+  }
+
+  jit_store_pc(e, op->pc + 1);
+  jit_spill(e);
+  x64_rr(e, true, 0x89, JIT_CPU, RDI);
+  x64_call(e, (const void *)cpu_opcode_table[op->opcode].handler);
+  jit_reload(e);
+  x64_alu_ri(e, true, ALU_ADD, JIT_CYCLES, op->cycles);
+  jit_chain_dynamic(e);
+}
+
+// Block translation.
+
+static bool jit_ends_block(unsigned mnemonic) {
+  switch (mnemonic) {
+  case JIT_BCC:
+  case JIT_BCS:
+  case JIT_BNE:
+  case JIT_BEQ:
+  case JIT_BVC:
+  case JIT_BVS:
+  case JIT_BPL:
+  case JIT_BMI:
+  case JIT_BRK:
+  case JIT_JMP:
+  case JIT_JSR:
+  case JIT_RTI:
+  case JIT_RTS:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static unsigned jit_decode(const CPUJit *jit, uint16_t pc, CPUJitOp *ops) {
+  const uint8_t *host = jit->cpu->pages.read[pc >> 8];
+  if (!host)
+    return 0;
+
+  unsigned count = 0;
+  for (unsigned offset = pc & 0xFF; count < JIT_BLOCK_OPS;) {
+    uint8_t opcode = host[offset];
+    const OpcodeInfo *info = &cpu_opcode_table[opcode];
+    unsigned length = cpu_mode_length(info->mode);
+    if (offset + length > 0x100)
+      break;
+
+    uint16_t operand = 0;
+    if (length > 1)
+      operand = host[offset + 1];
+    if (length > 2)
+      operand |= host[offset + 2] << 8;
+    ops[count++] = (CPUJitOp){
+        .pc = (pc & 0xFF00) | offset,
+        .operand = operand,
+        .opcode = opcode,
+        .mnemonic = cpu_jit_mnemonics[opcode],
+        .mode = info->mode,
+        .length = length,
+        .cycles = info->cycles + info->page_cycles,
+    };
+    offset += length;
+    if (jit_ends_block(ops[count - 1].mnemonic) || offset == 0x100)
+      break;
+  }
+  return count;
+}
+
+// The code buffer is never writable and executable at once. The translator
+// opens the range it is about to write for writing and closes it again
+// before the code can run; on Apple hosts the buffer is mapped with MAP_JIT
+// and the switch is the calling thread's, without a system call.
+static bool cpu_jit_writable(CPUJit *jit, size_t from, size_t to, bool on) {
+#ifdef __APPLE__
+  (void)jit;
+  (void)from;
+  (void)to;
+  pthread_jit_write_protect_np(!on);
+  return true;
+#else
+  size_t host_page = sysconf(_SC_PAGESIZE);
+  from -= from % host_page;
+  if (to > JIT_CODE_SIZE)
+    to = JIT_CODE_SIZE;
+  int prot = on ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+  return mprotect(jit->code + from, to - from, prot) == 0;
+#endif
+}
+
+static void cpu_jit_flush(CPUJit *jit) {
+  for (unsigned i = 0; i < JIT_SLOTS; i++)
+    jit->slots[i].code = NULL;
+  jit->used = jit->base;
+}
+
+static const void *cpu_jit_translate(CPUJit *jit, uint16_t pc) {
+  CPUJitOp ops[JIT_BLOCK_OPS];
+  unsigned count = jit_decode(jit, pc, ops);
+  if (!count)
+    return NULL;
+  if (JIT_CODE_SIZE - jit->used < JIT_BLOCK_BYTES)
+    cpu_jit_flush(jit);
+  size_t from = jit->used, to = from + JIT_BLOCK_BYTES;
+  if (!cpu_jit_writable(jit, from, to, true))
+    return NULL;
+
+  CPUJitEmit e = {.jit = jit, .at = jit->code + jit->used};
+  uint8_t *start = e.at;
+
+  // Runs the whole block only if the budget lasts until its last
+  // instruction starts; otherwise the interpreter finishes the budget.
+  uint32_t ahead = 0;
+  for (unsigned i = 0; i + 1 < count; i++)
+    ahead += ops[i].cycles;
+  x64_rm(&e, true, 0x8D, RAX, JIT_CYCLES, ahead);
+  x64_rm(&e, true, 0x3B, RAX, JIT_CPU, OFF(deadline));
+  jit_exit_on(&e, CC_AE, pc);
+
+  for (unsigned i = 0; i < count; i++) {
+    const CPUJitOp *op = &ops[i];
+    uint16_t next = op->pc + op->length;
+    if (!jit_instruction(&e, op)) {
+      jit_terminator(&e, op, start, pc);
+      break;
+    }
+    x64_alu_ri(&e, true, ALU_ADD, JIT_CYCLES, op->cycles);
+    if (i + 1 < count)
+      ahead -= op->cycles;
+
+    if (jit_touches_memory(op)) {
+      // A handler may have raised an interrupt or moved the deadline, or a
+      // write may have changed or remapped this block's page.
+      x64_cmp8(&e, RSP, FRAME_SLOW, 0);
+      uint8_t *fast = x64_jcc(&e, CC_E);
+      x64_store8(&e, RSP, FRAME_SLOW, 0);
+      jit_check_interrupts(&e, next);
+      jit_check_deadline(&e, next, ahead);
+      jit_check_generation(&e, pc, next);
+      x64_patch(fast, e.at);
+    }
+    if (op->mnemonic == JIT_CLI || op->mnemonic == JIT_PLP)
+      jit_check_interrupts(&e, next);
+    if (i + 1 == count)
+      jit_chain(&e, next);
+  }
+
+  for (unsigned i = 0; i < e.exit_count; i++) {
+    x64_patch(e.exits[i].rel, e.at);
+    jit_store_pc(&e, e.exits[i].pc);
+    x64_patch(x64_jmp(&e), jit->leave);
+  }
+
+  jit->used = e.at - jit->code;
+  if (!cpu_jit_writable(jit, from, to, false)) {
+    // Nothing in the range may run until it is executable again.
+    cpu_jit_flush(jit);
+    return NULL;
+  }
+  cpu_watch_page(jit->cpu, jit->watcher, pc >> 8, true);
+  return start;
+}
+
+// The shared entry, enter(cpu, code), and exit.
+static void cpu_jit_emit_stubs(CPUJit *jit) {
+  static const unsigned saved[] = {RBX, RBP, R12, R13, R14, R15};
+  CPUJitEmit e = {.jit = jit, .at = jit->code};
+
+  jit->enter = (CPUJitEntry)(void *)e.at;
+  for (int i = 0; i < 6; i++)
+    x64_opcode(&e, false, 0x50 + (saved[i] & 7), 0, 0, saved[i]);
+  x64_alu_ri(&e, true, ALU_SUB, RSP, FRAME_SIZE);
+  x64_rr(&e, true, 0x89, RDI, JIT_CPU);
+  x64_store8(&e, RSP, FRAME_SLOW, 0);
+  x64_rr(&e, true, 0x89, RSI, RAX);
+  jit_reload(&e);
+  x64_rr(&e, false, 0xFF, 4, RAX);
+
+  jit->leave = e.at;
+  jit_spill(&e);
+  x64_alu_ri(&e, true, ALU_ADD, RSP, FRAME_SIZE);
+  for (int i = 5; i >= 0; i--)
+    x64_opcode(&e, false, 0x58 + (saved[i] & 7), 0, 0, saved[i]);
+  x64_byte(&e, 0xC3);
+
+  jit->base = jit->used = e.at - jit->code;
+}
+
+CPUJit *cpu_jit_create(CPU *cpu) {
+  CPUJit *jit = calloc(1, sizeof(*jit));
+  if (!jit)
+    return NULL;
+#ifdef __APPLE__
+  jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_JIT, -1, 0);
+#else
+  jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#endif
+  if (jit->code == MAP_FAILED) {
+    free(jit);
+    return NULL;
+  }
+  jit->watcher = cpu_watch_add(cpu, cpu_jit_written, jit);
+  if (jit->watcher < 0) {
+    munmap(jit->code, JIT_CODE_SIZE);
+    free(jit);
+    return NULL;
+  }
+  jit->cpu = cpu;
+  cpu_jit_writable(jit, 0, JIT_CODE_SIZE, true);
+  cpu_jit_emit_stubs(jit);
+  if (!cpu_jit_writable(jit, 0, JIT_CODE_SIZE, false)) {
+    cpu_jit_destroy(jit);
+    return NULL;
+  }
+  cpu->jit = jit;
+  return jit;
+}
+
+void cpu_jit_destroy(CPUJit *jit) {
+  if (!jit)
+    return;
+  if (jit->cpu->jit == jit)
+    jit->cpu->jit = NULL;
+  cpu_watch_remove(jit->cpu, jit->watcher);
+  munmap(jit->code, JIT_CODE_SIZE);
+  free(jit);
+}
+
+static const void *cpu_jit_lookup(CPUJit *jit, uint16_t pc) {
+  CPUJitSlot *slot = &jit->slots[pc % JIT_SLOTS];
+  uint32_t generation = jit->generation[pc >> 8];
+  if (slot->pc != pc || slot->generation != generation)
+    *slot = (CPUJitSlot){NULL, generation, pc, 0};
+  if (slot->code)
+    return slot->code;
+  if (++slot->hits < TINY6502_JIT_HOT)
+    return NULL;
+
+  slot->hits = 0;
+  slot->code = cpu_jit_translate(jit, pc);
+  return slot->code;
+}
+
+uint64_t cpu_run_jit(CPU *cpu, uint64_t cycle_budget) {
+  uint64_t consumed = cpu->cycles_left;
+  if (consumed > cycle_budget)
+    consumed = cycle_budget;
+  cpu->cycles_left -= consumed;
+
+  CPUJit *jit = cpu->jit;
+  uint64_t start = cpu->cycles;
+  cpu->deadline = start + (cycle_budget - consumed);
+
+  while (cpu->cycles < cpu->deadline) {
+    const void *code = NULL;
+    bool traced = false;
+#ifdef TINY6502_TRACE
+    traced = cpu->trace != NULL;
+#endif
+    if (!traced && !INTERRUPT_PENDING(cpu))
+      code = cpu_jit_lookup(jit, cpu->PC);
+    if (code) {
+      uint64_t before = cpu->cycles;
+      jit->enter(cpu, code);
+      // A translation that would overrun the budget returns at once.
+      if (cpu->cycles != before)
+        continue;
+    }
+    cpu_step_instruction(cpu);
+  }
+
+  return consumed + (cpu->cycles - start);
+}
+
+#else
+
+CPUJit *cpu_jit_create(CPU *cpu) {
+  (void)cpu;
+  return NULL;
+}
+
+void cpu_jit_destroy(CPUJit *jit) { (void)jit; }
+
+uint64_t cpu_run_jit(CPU *cpu, uint64_t cycle_budget) {
+  cpu->jit = NULL;
+  return cpu_run(cpu, cycle_budget);
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TINY6502_JIT_H
+#define TINY6502_JIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Dynamic recompiler for x86-64 hosts. While enabled, cpu_run counts how
+// often each address starts a straight run of code and, once it is hot,
+// translates the run, up to and including the next branch, jump, call or
+// return, into native code. A, X, Y, P and the cycle counter live in host
+// registers while translated code runs, and translations jump straight to
+// each other without returning to the dispatcher.
+//
+// Cold code, interrupt entries, traced runs and the last instructions of a
+// budget run on the interpreter. Memory accesses take the page tables'
+// direct path inline and call into the core for handler pages, so devices,
+// mappers and watchers see the same accesses as under the interpreter.
+// Cycle counts, interrupt timing and results match the interpreter exactly.
+//
+// Translations never cross a page. One is dropped on the first write to its
+// page and when the page is remapped, so self-modifying code and bank
+// switching stay correct. The native code buffer is writable or executable,
+// never both.
+
+typedef struct CPUJit CPUJit;
+
+// Creates a recompiler for cpu and enables it. Returns NULL on hosts other
+// than x86-64, if executable memory cannot be had or if the CPU has no write
+// watcher free.
+CPUJit *cpu_jit_create(CPU *cpu);
+void cpu_jit_destroy(CPUJit *jit);
+
+// Switches between translated code and the interpreter. Translations stay
+// valid while disabled.
+void cpu_jit_enable(CPUJit *jit, bool on);
+
+#endif // TINY6502_JIT_H
@@ -0,0 +1,456 @@
+#include "tiny6502_lanes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tiny6502_ops.h"
+
+// A minimal vector layer over unsigned bytes, so each kernel is written once.
+// Masks are 0xFF or 0x00 per byte.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LANES_VECTOR 32
+typedef __m256i Vec;
+#define vload(p) _mm256_load_si256((const __m256i *)(p))
+#define vstore(p, v) _mm256_store_si256((__m256i *)(p), v)
+#define vset(x) _mm256_set1_epi8((char)(x))
+#define vand _mm256_and_si256
+#define vor _mm256_or_si256
+#define vxor _mm256_xor_si256
+#define vadd _mm256_add_epi8
+#define vsub _mm256_sub_epi8
+#define veq _mm256_cmpeq_epi8
+#define vmax _mm256_max_epu8
+#define vshr1(a) vand(_mm256_srli_epi16(a, 1), vset(0x7F))
+#define vselect(m, a, b) _mm256_blendv_epi8(b, a, m)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LANES_VECTOR 16
+typedef __m128i Vec;
+#define vload(p) _mm_load_si128((const __m128i *)(p))
+#define vstore(p, v) _mm_store_si128((__m128i *)(p), v)
+#define vset(x) _mm_set1_epi8((char)(x))
+#define vand _mm_and_si128
+#define vor _mm_or_si128
+#define vxor _mm_xor_si128
+#define vadd _mm_add_epi8
+#define vsub _mm_sub_epi8
+#define veq _mm_cmpeq_epi8
+#define vmax _mm_max_epu8
+#define vshr1(a) vand(_mm_srli_epi16(a, 1), vset(0x7F))
+#define vselect(m, a, b) vor(vand(m, a), _mm_andnot_si128(m, b))
+#else
+#define LANES_VECTOR 1
+typedef uint8_t Vec;
+#define vload(p) (*(p))
+#define vstore(p, v) (*(p) = (v))
+#define vset(x) ((uint8_t)(x))
+#define vand(a, b) ((uint8_t)((a) & (b)))
+#define vor(a, b) ((uint8_t)((a) | (b)))
+#define vxor(a, b) ((uint8_t)((a) ^ (b)))
+#define vadd(a, b) ((uint8_t)((a) + (b)))
+#define vsub(a, b) ((uint8_t)((a) - (b)))
+#define veq(a, b) ((uint8_t)((a) == (b) ? 0xFF : 0))
+#define vmax(a, b) ((a) > (b) ? (a) : (b))
+#define vshr1(a) ((uint8_t)((a) >> 1))
+#define vselect(m, a, b) ((m) ? (a) : (b))
+#endif
+
+#define vnot(a) vxor(a, vset(0xFF))
+#define vshl1(a) vadd(a, a)
+// a >= b, unsigned
+#define vge(a, b) veq(vmax(a, b), a)
+
+enum { FLAG_C = 0x01, FLAG_Z = 0x02, FLAG_I = 0x04, FLAG_D = 0x08 };
+enum { FLAG_V = 0x40, FLAG_N = 0x80 };
+
+// How an opcode runs on the lanes.
+enum { LANES_SCALAR, LANES_KERNEL, LANES_BRANCH, LANES_JUMP };
+
+static const uint8_t cpu_lanes_kind[256] = {
+    [0x09] = LANES_KERNEL, [0x0A] = LANES_KERNEL, [0x18] = LANES_KERNEL,
+    [0x29] = LANES_KERNEL, [0x2A] = LANES_KERNEL, [0x38] = LANES_KERNEL,
+    [0x49] = LANES_KERNEL, [0x4A] = LANES_KERNEL, [0x4C] = LANES_JUMP,
+    [0x69] = LANES_KERNEL, [0x6A] = LANES_KERNEL, [0x78] = LANES_KERNEL,
+    [0x88] = LANES_KERNEL, [0x8A] = LANES_KERNEL, [0x98] = LANES_KERNEL,
+    [0x9A] = LANES_KERNEL, [0xA0] = LANES_KERNEL, [0xA2] = LANES_KERNEL,
+    [0xA8] = LANES_KERNEL, [0xA9] = LANES_KERNEL, [0xAA] = LANES_KERNEL,
+    [0xB8] = LANES_KERNEL, [0xBA] = LANES_KERNEL, [0xC0] = LANES_KERNEL,
+    [0xC8] = LANES_KERNEL, [0xC9] = LANES_KERNEL, [0xCA] = LANES_KERNEL,
+    [0xD8] = LANES_KERNEL, [0xE0] = LANES_KERNEL, [0xE8] = LANES_KERNEL,
+    [0xE9] = LANES_KERNEL, [0xEA] = LANES_KERNEL, [0xF8] = LANES_KERNEL,
+    [0x10] = LANES_BRANCH, [0x30] = LANES_BRANCH, [0x50] = LANES_BRANCH,
+    [0x70] = LANES_BRANCH, [0x90] = LANES_BRANCH, [0xB0] = LANES_BRANCH,
+    [0xD0] = LANES_BRANCH, [0xF0] = LANES_BRANCH,
+};
+
+bool cpu_lanes_init(CPULanes *lanes, CPU *cpus, size_t count) {
+  memset(lanes, 0, sizeof(*lanes));
+  lanes->count = count;
+  lanes->cpu = cpus;
+
+  // Rounded to 32 whatever the vector width, so every array is a whole
+  // number of aligned vectors.
+  size_t width = (count + 31) & ~(size_t)31;
+  lanes->width = width ? width : 32;
+  width = lanes->width;
+
+  lanes->PC = aligned_alloc(32, width * sizeof(uint16_t));
+  lanes->A = aligned_alloc(32, width);
+  lanes->X = aligned_alloc(32, width);
+  lanes->Y = aligned_alloc(32, width);
+  lanes->SP = aligned_alloc(32, width);
+  lanes->P = aligned_alloc(32, width);
+  lanes->mask = aligned_alloc(32, width);
+  lanes->operand = aligned_alloc(32, width);
+  lanes->cycles = aligned_alloc(32, width * sizeof(uint64_t));
+  lanes->deadline = aligned_alloc(32, width * sizeof(uint64_t));
+  if (!lanes->PC || !lanes->A || !lanes->X || !lanes->Y || !lanes->SP ||
+      !lanes->P || !lanes->mask || !lanes->operand || !lanes->cycles ||
+      !lanes->deadline) {
+    cpu_lanes_free(lanes);
+    return false;
+  }
+
+  memset(lanes->A, 0, width);
+  memset(lanes->X, 0, width);
+  memset(lanes->Y, 0, width);
+  memset(lanes->SP, 0, width);
+  memset(lanes->P, 0, width);
+  memset(lanes->mask, 0, width);
+  memset(lanes->operand, 0, width);
+  return true;
+}
+
+void cpu_lanes_free(CPULanes *lanes) {
+  free(lanes->PC);
+  free(lanes->A);
+  free(lanes->X);
+  free(lanes->Y);
+  free(lanes->SP);
+  free(lanes->P);
+  free(lanes->mask);
+  free(lanes->operand);
+  free(lanes->cycles);
+  free(lanes->deadline);
+  memset(lanes, 0, sizeof(*lanes));
+}
+
+static void cpu_lanes_store(CPULanes *lanes, size_t i) {
+  CPU *cpu = &lanes->cpu[i];
+  cpu->PC = lanes->PC[i];
+  cpu->A = lanes->A[i];
+  cpu->X = lanes->X[i];
+  cpu->Y = lanes->Y[i];
+  cpu->SP = lanes->SP[i];
+  cpu_set_flags(cpu, lanes->P[i]);
+  cpu->cycles = lanes->cycles[i];
+}
+
+static void cpu_lanes_load(CPULanes *lanes, size_t i) {
+  CPU *cpu = &lanes->cpu[i];
+  lanes->PC[i] = cpu->PC;
+  lanes->A[i] = cpu->A;
+  lanes->X[i] = cpu->X;
+  lanes->Y[i] = cpu->Y;
+  lanes->SP[i] = cpu->SP;
+  lanes->P[i] = cpu_flags(cpu);
+  lanes->cycles[i] = cpu->cycles;
+}
+
+static Vec cpu_lanes_nz(Vec p, Vec value) {
+  p = vand(p, vset(~(FLAG_N | FLAG_Z)));
+  p = vor(p, vand(value, vset(FLAG_N)));
+  return vor(p, vand(veq(value, vset(0)), vset(FLAG_Z)));
+}
+
+static Vec cpu_lanes_carry(Vec p, Vec carry) {
+  return vor(vand(p, vset(~FLAG_C)), vand(carry, vset(FLAG_C)));
+}
+
+// Runs a register-only opcode on every lane in the mask.
+static void cpu_lanes_kernel(CPULanes *lanes, uint8_t opcode) {
+  for (size_t i = 0; i < lanes->width; i += LANES_VECTOR) {
+    Vec m = vload(lanes->mask + i);
+    Vec op = vload(lanes->operand + i);
+    Vec a = vload(lanes->A + i), x = vload(lanes->X + i);
+    Vec y = vload(lanes->Y + i), sp = vload(lanes->SP + i);
+    Vec p = vload(lanes->P + i);
+    Vec na = a, nx = x, ny = y, nsp = sp, np = p;
+
+    switch (opcode) {
+    case 0xA9: // LDA #
+      na = op;
+      np = cpu_lanes_nz(p, na);
+      break;
+    case 0xA2: // LDX #
+      nx = op;
+      np = cpu_lanes_nz(p, nx);
+      break;
+    case 0xA0: // LDY #
+      ny = op;
+      np = cpu_lanes_nz(p, ny);
+      break;
+    case 0x29: // AND #
+      na = vand(a, op);
+      np = cpu_lanes_nz(p, na);
+      break;
+    case 0x09: // ORA #
+      na = vor(a, op);
+      np = cpu_lanes_nz(p, na);
+      break;
+    case 0x49: // EOR #
+      na = vxor(a, op);
+      np = cpu_lanes_nz(p, na);
+      break;
+    case 0xE9: // SBC #
+      op = vnot(op);
+      // fall through
+    case 0x69: { // ADC #
+      Vec carry_in = vand(p, vset(FLAG_C));
+      Vec sum = vadd(a, op);
+      Vec carry = vnot(vge(sum, a));
+      Vec result = vadd(sum, carry_in);
+      carry = vor(carry, vnot(vge(result, sum)));
+      Vec overflow = vand(vand(vxor(a, result), vxor(op, result)), vset(0x80));
+      na = result;
+      np = cpu_lanes_carry(cpu_lanes_nz(p, na), carry);
+      np = vor(vand(np, vset(~FLAG_V)), vshr1(overflow));
+      break;
+    }
+    case 0xC9: // CMP #
+      np = cpu_lanes_carry(cpu_lanes_nz(p, vsub(a, op)), vge(a, op));
+      break;
+    case 0xE0: // CPX #
+      np = cpu_lanes_carry(cpu_lanes_nz(p, vsub(x, op)), vge(x, op));
+      break;
+    case 0xC0: // CPY #
+      np = cpu_lanes_carry(cpu_lanes_nz(p, vsub(y, op)), vge(y, op));
+      break;
+    case 0xAA: // TAX
+      nx = a;
+      np = cpu_lanes_nz(p, nx);
+      break;
+    case 0xA8: // TAY
+      ny = a;
+      np = cpu_lanes_nz(p, ny);
+      break;
+    case 0x8A: // TXA
+      na = x;
+      np = cpu_lanes_nz(p, na);
+      break;
+    case 0x98: // TYA
+      na = y;
+      np = cpu_lanes_nz(p, na);
+      break;
+    case 0xBA: // TSX
+      nx = sp;
+      np = cpu_lanes_nz(p, nx);
+      break;
+    case 0x9A: // TXS
+      nsp = x;
+      break;
+    case 0xE8: // INX
+      nx = vadd(x, vset(1));
+      np = cpu_lanes_nz(p, nx);
+      break;
+    case 0xC8: // INY
+      ny = vadd(y, vset(1));
+      np = cpu_lanes_nz(p, ny);
+      break;
+    case 0xCA: // DEX
+      nx = vsub(x, vset(1));
+      np = cpu_lanes_nz(p, nx);
+      break;
+    case 0x88: // DEY
+      ny = vsub(y, vset(1));
+      np = cpu_lanes_nz(p, ny);
+      break;
+    case 0x0A: // ASL A
+      na = vshl1(a);
+      np = cpu_lanes_carry(cpu_lanes_nz(p, na), veq(vand(a, vset(0x80)),
+                                                     vset(0x80)));
+      break;
+    case 0x4A: // LSR A
+      na = vshr1(a);
+      np = cpu_lanes_carry(cpu_lanes_nz(p, na), veq(vand(a, vset(1)), vset(1)));
+      break;
+    case 0x2A: // ROL A
+      na = vor(vshl1(a), vand(p, vset(FLAG_C)));
+      np = cpu_lanes_carry(cpu_lanes_nz(p, na), veq(vand(a, vset(0x80)),
+                                                     vset(0x80)));
+      break;
+    case 0x6A: // ROR A
+      na = vor(vshr1(a), vand(veq(vand(p, vset(FLAG_C)), vset(FLAG_C)),
+                              vset(0x80)));
+      np = cpu_lanes_carry(cpu_lanes_nz(p, na), veq(vand(a, vset(1)), vset(1)));
+      break;
+    case 0x18: // CLC
+      np = vand(p, vset(~FLAG_C));
+      break;
+    case 0x38: // SEC
+      np = vor(p, vset(FLAG_C));
+      break;
+    case 0x78: // SEI
+      np = vor(p, vset(FLAG_I));
+      break;
+    case 0xB8: // CLV
+      np = vand(p, vset(~FLAG_V));
+      break;
+    case 0xD8: // CLD
+      np = vand(p, vset(~FLAG_D));
+      break;
+    case 0xF8: // SED
+      np = vor(p, vset(FLAG_D));
+      break;
+    default: // NOP
+      break;
+    }
+
+    vstore(lanes->A + i, vselect(m, na, a));
+    vstore(lanes->X + i, vselect(m, nx, x));
+    vstore(lanes->Y + i, vselect(m, ny, y));
+    vstore(lanes->SP + i, vselect(m, nsp, sp));
+    vstore(lanes->P + i, vselect(m, np, p));
+  }
+}
+
+// Flag tested by each branch and the value that takes it, indexed by bits 7-5
+// of the opcode.
+static const uint8_t cpu_lanes_branch_flag[8] = {
+    FLAG_N, FLAG_N, FLAG_V, FLAG_V, FLAG_C, FLAG_C, FLAG_Z, FLAG_Z};
+
+static bool cpu_lanes_active(const CPULanes *lanes, size_t i) {
+  return lanes->cycles[i] < lanes->deadline[i];
+}
+
+// Takes a pending interrupt on lane i, as cpu_dispatch does. Returns false
+// if none is pending.
+static bool cpu_lanes_interrupt(CPULanes *lanes, size_t i) {
+  CPU *cpu = &lanes->cpu[i];
+  if (!cpu->NMI && !(cpu->IRQ && !(lanes->P[i] & FLAG_I)))
+    return false;
+
+  cpu_lanes_store(lanes, i);
+  cpu_interrupt(cpu);
+  cpu->cycles += 7;
+  cpu_lanes_load(lanes, i);
+  return true;
+}
+
+// Lanes usually run from RAM or share a ROM, so the page pointer is read
+// directly and the bus is only used for pages with handlers.
+static inline uint8_t cpu_lanes_fetch(CPULanes *lanes, size_t i, uint16_t pc) {
+  const uint8_t *page = lanes->cpu[i].pages.read[pc >> 8];
+  if (page)
+    return page[pc & 0xFF];
+  return cpu_load(&lanes->cpu[i], pc);
+}
+
+// The lane furthest behind leads, which lets lanes that took different paths
+// fall back into step. Returns count once every lane has met its deadline.
+static size_t cpu_lanes_leader(CPULanes *lanes) {
+  size_t count = lanes->count;
+  bool interrupted;
+  size_t leader;
+  do {
+    leader = count;
+    interrupted = false;
+    for (size_t i = 0; i < count; i++) {
+      if (!cpu_lanes_active(lanes, i))
+        continue;
+      if (cpu_lanes_interrupt(lanes, i)) {
+        interrupted = true;
+        continue;
+      }
+      if (leader == count || lanes->cycles[i] < lanes->cycles[leader])
+        leader = i;
+    }
+  } while (interrupted);
+  return leader;
+}
+
+void cpu_lanes_run(CPULanes *lanes, uint64_t cycle_budget) {
+  size_t count = lanes->count;
+  for (size_t i = 0; i < count; i++) {
+    CPU *cpu = &lanes->cpu[i];
+    uint64_t consumed = cpu->cycles_left;
+    if (consumed > cycle_budget)
+      consumed = cycle_budget;
+    cpu->cycles_left -= consumed;
+    cpu_lanes_load(lanes, i);
+    lanes->deadline[i] = cpu->cycles + (cycle_budget - consumed);
+  }
+
+  size_t leader = cpu_lanes_leader(lanes);
+  while (leader < count) {
+    uint16_t pc = lanes->PC[leader];
+    uint8_t opcode = cpu_load(&lanes->cpu[leader], pc);
+    const OpcodeInfo *info = &cpu_opcode_table[opcode];
+    uint8_t cycles = info->cycles + info->page_cycles;
+    uint8_t kind = cpu_lanes_kind[opcode];
+
+    // Lanes sharing the leader's code page need not have the opcode checked.
+    const uint8_t *code = lanes->cpu[leader].pages.read[pc >> 8];
+
+    // Runs the step and finds the next leader in the same pass.
+    size_t next = count;
+    for (size_t i = 0; i < count; i++) {
+      if (!cpu_lanes_active(lanes, i)) {
+        lanes->mask[i] = 0;
+        continue;
+      }
+
+      bool member =
+          lanes->PC[i] == pc &&
+          ((code && lanes->cpu[i].pages.read[pc >> 8] == code) ||
+           cpu_lanes_fetch(lanes, i, pc) == opcode);
+      lanes->mask[i] = member ? 0xFF : 0;
+      if (member) {
+        if (kind == LANES_SCALAR) {
+          CPU *cpu = &lanes->cpu[i];
+          cpu_lanes_store(lanes, i);
+          cpu->PC++;
+          info->handler(cpu);
+          cpu_lanes_load(lanes, i);
+        } else if (kind == LANES_JUMP) {
+          lanes->PC[i] = cpu_lanes_fetch(lanes, i, pc + 1) |
+                         (cpu_lanes_fetch(lanes, i, pc + 2) << 8);
+        } else if (info->mode == IMM || kind == LANES_BRANCH) {
+          lanes->operand[i] = cpu_lanes_fetch(lanes, i, pc + 1);
+          lanes->PC[i] = pc + 2;
+        } else {
+          lanes->PC[i] = pc + 1;
+        }
+        lanes->cycles[i] += cycles;
+
+        // Only handlers change interrupt lines, and only the scalar opcodes
+        // (which include CLI, PLP and RTI) unmask IRQs, so other lanes need
+        // not be polled. Handlers raising lines on another lane are seen
+        // when that lane next runs a scalar opcode.
+        if (kind == LANES_SCALAR)
+          while (cpu_lanes_active(lanes, i) && cpu_lanes_interrupt(lanes, i))
+            ;
+      }
+
+      if (cpu_lanes_active(lanes, i) &&
+          (next == count || lanes->cycles[i] < lanes->cycles[next]))
+        next = i;
+    }
+
+    if (kind == LANES_KERNEL) {
+      cpu_lanes_kernel(lanes, opcode);
+    } else if (kind == LANES_BRANCH) {
+      uint8_t flag = cpu_lanes_branch_flag[opcode >> 5];
+      uint8_t when = (opcode & 0x20) ? flag : 0;
+      for (size_t i = 0; i < count; i++)
+        if (lanes->mask[i] && (lanes->P[i] & flag) == when)
+          lanes->PC[i] += (int8_t)lanes->operand[i];
+    }
+
+    leader = next;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    cpu_lanes_store(lanes, i);
+}
@@ -0,0 +1,47 @@
+#ifndef TINY6502_LANES_H
+#define TINY6502_LANES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Lockstep engine for many CPUs running the same program. While running, the
+// registers of all lanes live in separate contiguous arrays. Each step picks
+// the lane furthest behind and executes its next instruction on every lane
+// at the same PC with the same opcode. Register-only instructions (immediate
+// and implied ALU operations, transfers, flag changes) run as SSE2 or AVX2
+// kernels over all lanes at once, and branches only update the PCs. Anything
+// else runs the regular opcode handlers one lane at a time, so memory
+// accesses and page handlers behave exactly as on the scalar core.
+//
+// Each lane is an ordinary CPU, set up with cpu_init and its own memory.
+// Lanes are not traced and always charge CPU_TIMING_FAST cycles. They run to
+// the end of the budget: cpu_stop_at, breakpoints and watchpoints do not stop
+// them.
+
+typedef struct {
+  size_t count;
+  size_t width; // count rounded up to the vector width
+
+  uint16_t *PC;
+  uint8_t *A, *X, *Y, *SP, *P;
+  uint64_t *cycles, *deadline;
+
+  // Per step: 0xFF for lanes taking part, and their immediate operand.
+  uint8_t *mask, *operand;
+
+  CPU *cpu;
+} CPULanes;
+
+// cpus is an array of count initialised CPUs that must stay in place while
+// the lanes use them. Returns false if the allocation fails.
+bool cpu_lanes_init(CPULanes *lanes, CPU *cpus, size_t count);
+void cpu_lanes_free(CPULanes *lanes);
+
+// Runs every lane for at least cycle_budget cycles, with the same accounting
+// as cpu_run, and leaves the results in the lanes' CPUs.
+void cpu_lanes_run(CPULanes *lanes, uint64_t cycle_budget);
+
+#endif // TINY6502_LANES_H
@@ -0,0 +1,120 @@
+#include "tiny6502_mapper.h"
+
+#include <string.h>
+
+#define CPU_MAPPER_MAX 16
+
+static const CPUMapperType *cpu_mapper_types[CPU_MAPPER_MAX];
+static unsigned cpu_mapper_count;
+
+void cpu_mapper_switch(CPUMapper *mapper, uint16_t addr, uint32_t size,
+                       uint32_t bank) {
+  uint32_t offset = (uint64_t)bank * size % mapper->rom_size;
+  for (uint32_t done = 0; done < size;) {
+    uint32_t chunk = mapper->rom_size - offset;
+    if (chunk > size - done)
+      chunk = size - done;
+    cpu_map_rom(mapper->cpu, addr + done, chunk, mapper->rom + offset);
+    done += chunk;
+    offset = 0;
+  }
+}
+
+static void cpu_mapper_flat_reset(CPUMapper *mapper) {
+  uint32_t banks = mapper->rom_size / 0x1000;
+  for (uint32_t i = 0; i < 8; i++)
+    cpu_mapper_switch(mapper, 0x8000 + i * 0x1000, 0x1000,
+                      (banks * 8 + i - 8) % banks);
+}
+
+static void cpu_mapper_uxrom_reset(CPUMapper *mapper) {
+  cpu_mapper_switch(mapper, 0x8000, 0x4000, 0);
+  uint32_t banks = mapper->rom_size / 0x4000;
+  cpu_mapper_switch(mapper, 0xC000, 0x4000, banks ? banks - 1 : 0);
+}
+
+static void cpu_mapper_uxrom_write(CPUMapper *mapper, uint16_t addr,
+                                   uint8_t value) {
+  (void)addr;
+  mapper->regs[0] = value;
+  cpu_mapper_switch(mapper, 0x8000, 0x4000, value);
+}
+
+static void cpu_mapper_bank8_reset(CPUMapper *mapper) {
+  for (unsigned i = 0; i < 4; i++) {
+    mapper->regs[i] = i;
+    cpu_mapper_switch(mapper, 0x8000 + i * 0x2000, 0x2000, i);
+  }
+}
+
+static void cpu_mapper_bank8_write(CPUMapper *mapper, uint16_t addr,
+                                   uint8_t value) {
+  unsigned window = (addr >> 13) & 3;
+  mapper->regs[window] = value;
+  cpu_mapper_switch(mapper, 0x8000 + window * 0x2000, 0x2000, value);
+}
+
+static void cpu_mapper_bank4_reset(CPUMapper *mapper) {
+  for (unsigned i = 0; i < 8; i++) {
+    mapper->regs[i] = i;
+    cpu_mapper_switch(mapper, 0x8000 + i * 0x1000, 0x1000, i);
+  }
+}
+
+static void cpu_mapper_bank4_write(CPUMapper *mapper, uint16_t addr,
+                                   uint8_t value) {
+  unsigned window = (addr >> 12) & 7;
+  mapper->regs[window] = value;
+  cpu_mapper_switch(mapper, 0x8000 + window * 0x1000, 0x1000, value);
+}
+
+static const CPUMapperType cpu_mapper_builtin[] = {
+    {"flat", cpu_mapper_flat_reset, NULL},
+    {"uxrom", cpu_mapper_uxrom_reset, cpu_mapper_uxrom_write},
+    {"bank8", cpu_mapper_bank8_reset, cpu_mapper_bank8_write},
+    {"bank4", cpu_mapper_bank4_reset, cpu_mapper_bank4_write},
+};
+
+bool cpu_mapper_register(const CPUMapperType *type) {
+  if (cpu_mapper_count == CPU_MAPPER_MAX)
+    return false;
+  cpu_mapper_types[cpu_mapper_count++] = type;
+  return true;
+}
+
+const CPUMapperType *cpu_mapper_find(const char *name) {
+  for (unsigned i = cpu_mapper_count; i-- > 0;)
+    if (strcmp(cpu_mapper_types[i]->name, name) == 0)
+      return cpu_mapper_types[i];
+
+  size_t builtins = sizeof(cpu_mapper_builtin) / sizeof(cpu_mapper_builtin[0]);
+  for (size_t i = 0; i < builtins; i++)
+    if (strcmp(cpu_mapper_builtin[i].name, name) == 0)
+      return &cpu_mapper_builtin[i];
+  return NULL;
+}
+
+static void cpu_mapper_bus_write(CPU *cpu, void *data, uint16_t addr,
+                                 uint8_t value) {
+  (void)cpu;
+  CPUMapper *mapper = data;
+  if (mapper->type->write)
+    mapper->type->write(mapper, addr, value);
+}
+
+bool cpu_mapper_attach(CPUMapper *mapper, CPU *cpu, const char *type,
+                       const uint8_t *rom, uint32_t rom_size) {
+  const CPUMapperType *found = cpu_mapper_find(type);
+  if (!found || rom_size == 0 || rom_size % 0x1000)
+    return false;
+
+  memset(mapper, 0, sizeof(*mapper));
+  mapper->type = found;
+  mapper->cpu = cpu;
+  mapper->rom = rom;
+  mapper->rom_size = rom_size;
+
+  cpu_map_io(cpu, 0x8000, 0x8000, NULL, cpu_mapper_bus_write, mapper);
+  found->reset(mapper);
+  return true;
+}
@@ -0,0 +1,59 @@
+#ifndef TINY6502_MAPPER_H
+#define TINY6502_MAPPER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Bank-switched images larger than the address space. A mapper maps windows
+// of a ROM image into $8000-$FFFF by pointing the bus pages at them, so a
+// bank switch costs one pointer write per 256-byte page and copies nothing.
+// CPU writes into $8000-$FFFF go to the mapper type's write function.
+
+typedef struct CPUMapper CPUMapper;
+
+typedef struct {
+  const char *name;
+
+  // Sets up the power-on banks once the image is attached.
+  void (*reset)(CPUMapper *mapper);
+
+  // Called for every CPU write into $8000-$FFFF. May be NULL.
+  void (*write)(CPUMapper *mapper, uint16_t addr, uint8_t value);
+} CPUMapperType;
+
+struct CPUMapper {
+  const CPUMapperType *type;
+  CPU *cpu;
+  const uint8_t *rom;
+  uint32_t rom_size;
+
+  // Free for the mapper type, e.g. the selected bank per window.
+  uint8_t regs[8];
+  void *data;
+};
+
+// Built in: "flat" (no banking, the top 32 KiB of the image), "uxrom" (a
+// switchable 16 KiB window at $8000 with the last bank fixed at $C000),
+// "bank8" (four 8 KiB windows) and "bank4" (eight 4 KiB windows); each window
+// of the last two is switched by writing a bank number anywhere inside it.
+// Registered types are searched before the built in ones; registration fails
+// once the registry is full. The registry is not locked: register types at
+// startup, before any thread looks one up, e.g. while setting up machines
+// for cpu_batch_run. type must outlive the program.
+bool cpu_mapper_register(const CPUMapperType *type);
+const CPUMapperType *cpu_mapper_find(const char *name);
+
+// rom_size must be a non-zero multiple of 4 KiB. The image is not copied and
+// must outlive the mapping.
+bool cpu_mapper_attach(CPUMapper *mapper, CPU *cpu, const char *type,
+                       const uint8_t *rom, uint32_t rom_size);
+
+// Maps bank number bank, counted in units of size bytes from the start of the
+// image and wrapped to the image size, at addr. size is a multiple of 256; a
+// window larger than the image mirrors it.
+void cpu_mapper_switch(CPUMapper *mapper, uint16_t addr, uint32_t size,
+                       uint32_t bank);
+
+#endif // TINY6502_MAPPER_H
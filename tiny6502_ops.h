@@ -1,8 +1,9 @@
 #ifndef TINY6502_OPS_H
 #define TINY6502_OPS_H
 
+#include <stddef.h>
+
 #include "tiny6502.h"
-#include <tcl.h>
 
 typedef enum {
   ACC,
@@ -20,73 +21,715 @@ typedef enum {
   IMP,
 } AddressingMode;
 
-typedef void (*Instruction)(CPU *cpu, AddressingMode addr_mode);
-
-// Instructions
-void cpu_op_adc(CPU *cpu, AddressingMode addr);
-void cpu_op_and(CPU *cpu, AddressingMode addr);
-void cpu_op_asl(CPU *cpu, AddressingMode addr);
-void cpu_op_bcc(CPU *cpu, AddressingMode addr);
-void cpu_op_bcs(CPU *cpu, AddressingMode addr);
-void cpu_op_beq(CPU *cpu, AddressingMode addr);
-void cpu_op_bit(CPU *cpu, AddressingMode addr);
-void cpu_op_bmi(CPU *cpu, AddressingMode addr);
-void cpu_op_bne(CPU *cpu, AddressingMode addr);
-void cpu_op_bpl(CPU *cpu, AddressingMode addr);
-void cpu_op_brk(CPU *cpu, AddressingMode addr);
-void cpu_op_bvc(CPU *cpu, AddressingMode addr);
-void cpu_op_bvs(CPU *cpu, AddressingMode addr);
-void cpu_op_clc(CPU *cpu, AddressingMode addr);
-void cpu_op_cld(CPU *cpu, AddressingMode addr);
-void cpu_op_cli(CPU *cpu, AddressingMode addr);
-void cpu_op_clv(CPU *cpu, AddressingMode addr);
-void cpu_op_cmp(CPU *cpu, AddressingMode addr);
-void cpu_op_cpx(CPU *cpu, AddressingMode addr);
-void cpu_op_cpy(CPU *cpu, AddressingMode addr);
-void cpu_op_dec(CPU *cpu, AddressingMode addr);
-void cpu_op_dex(CPU *cpu, AddressingMode addr);
-void cpu_op_dey(CPU *cpu, AddressingMode addr);
-void cpu_op_eor(CPU *cpu, AddressingMode addr);
-void cpu_op_inc(CPU *cpu, AddressingMode addr);
-void cpu_op_inx(CPU *cpu, AddressingMode addr);
-void cpu_op_iny(CPU *cpu, AddressingMode addr);
-void cpu_op_jmp(CPU *cpu, AddressingMode addr);
-void cpu_op_jsr(CPU *cpu, AddressingMode addr);
-void cpu_op_lda(CPU *cpu, AddressingMode addr);
-void cpu_op_ldx(CPU *cpu, AddressingMode addr);
-void cpu_op_ldy(CPU *cpu, AddressingMode addr);
-void cpu_op_lsr(CPU *cpu, AddressingMode addr);
-void cpu_op_nop(CPU *cpu, AddressingMode addr);
-void cpu_op_ora(CPU *cpu, AddressingMode addr);
-void cpu_op_pha(CPU *cpu, AddressingMode addr);
-void cpu_op_php(CPU *cpu, AddressingMode addr);
-void cpu_op_pla(CPU *cpu, AddressingMode addr);
-void cpu_op_plp(CPU *cpu, AddressingMode addr);
-void cpu_op_rol(CPU *cpu, AddressingMode addr);
-void cpu_op_ror(CPU *cpu, AddressingMode addr);
-void cpu_op_rti(CPU *cpu, AddressingMode addr);
-void cpu_op_rts(CPU *cpu, AddressingMode addr);
-void cpu_op_sbc(CPU *cpu, AddressingMode addr);
-void cpu_op_sec(CPU *cpu, AddressingMode addr);
-void cpu_op_sed(CPU *cpu, AddressingMode addr);
-void cpu_op_sei(CPU *cpu, AddressingMode addr);
-void cpu_op_sta(CPU *cpu, AddressingMode addr);
-void cpu_op_stx(CPU *cpu, AddressingMode addr);
-void cpu_op_sty(CPU *cpu, AddressingMode addr);
-void cpu_op_tax(CPU *cpu, AddressingMode addr);
-void cpu_op_tay(CPU *cpu, AddressingMode addr);
-void cpu_op_tsx(CPU *cpu, AddressingMode addr);
-void cpu_op_txa(CPU *cpu, AddressingMode addr);
-void cpu_op_txs(CPU *cpu, AddressingMode addr);
-void cpu_op_tya(CPU *cpu, AddressingMode addr);
-
-// Illegal instructions
-void cpu_op_illegal(CPU *cpu, AddressingMode addr);
-
-// Opcode table
-extern Instruction cpu_opcodes[256];
-extern AddressingMode cpu_addressing_modes[256];
-extern uint8_t cpu_opcode_cycles[256];
-extern uint8_t cpu_opcode_page_cycles[256];
+typedef void (*Instruction)(CPU *cpu);
+
+// Opcode table, padded so each entry sits in a single cache line.
+typedef struct {
+  _Alignas(32) Instruction handler;
+  AddressingMode mode;
+  uint8_t cycles;
+  uint8_t page_cycles;
+  char const *name;
+} OpcodeInfo;
+
+extern const OpcodeInfo cpu_opcode_table[256];
+
+// Instruction length in bytes, including the opcode.
+static inline uint8_t cpu_mode_length(AddressingMode mode) {
+  switch (mode) {
+  case ACC:
+  case IMP:
+    return 1;
+  case ABS:
+  case ABSX:
+  case ABSY:
+  case IND:
+    return 3;
+  default:
+    return 2;
+  }
+}
+
+// The threaded interpreter in tiny6502_threaded.c. cpu_run() uses it when
+// built with TINY6502_THREADED.
+uint64_t cpu_run_threaded(CPU *cpu, uint64_t cycle_budget);
+
+// Runs from the CPU's block cache, see tiny6502_blocks.c. cpu_run() uses it
+// while a cache is attached.
+uint64_t cpu_run_blocks(CPU *cpu, uint64_t cycle_budget);
+
+// Runs translated code, see tiny6502_jit.c. cpu_run() uses it while a
+// recompiler is enabled.
+uint64_t cpu_run_jit(CPU *cpu, uint64_t cycle_budget);
+
+// The CPU_TIMING_CYCLE engine in tiny6502_cycle.c: one bus cycle, the rest of
+// the current instruction and then a whole one, and a run of exactly
+// cycle_budget cycles.
+void cpu_cycle_step(CPU *cpu);
+uint8_t cpu_cycle_instruction(CPU *cpu);
+uint64_t cpu_run_cycles(CPU *cpu, uint64_t cycle_budget);
+
+// Handlers for CPU_TIMING_EXACT, see tiny6502_timing.c. Each runs the opcode
+// and returns the cycles it actually took.
+extern uint8_t (*const cpu_exact_handlers[256])(CPU *cpu);
+
+// Every opcode as X(opcode, mnemonic, mode, cycles, page_cycles). page_cycles
+// is the most a page crossing can add: 1 for indexed reads, and 2 for
+// branches, which take one more cycle when taken and another when the target
+// is on a different page. Unassigned opcodes are ILL, which behaves as a two
+// cycle NOP so a run always progresses. Expanding EXEC_<mnemonic>(cpu, mode)
+// gives the opcode's body.
+#define TINY6502_OPCODES(X) \
+  X(0x00, BRK, IMP, 7, 0)  \
+  X(0x01, ORA, INDX, 6, 0) \
+  X(0x02, ILL, IMP, 2, 0)  \
+  X(0x03, ILL, IMP, 2, 0)  \
+  X(0x04, ILL, IMP, 2, 0)  \
+  X(0x05, ORA, ZP, 3, 0)   \
+  X(0x06, ASL, ZP, 5, 0)   \
+  X(0x07, ILL, IMP, 2, 0)  \
+  X(0x08, PHP, IMP, 3, 0)  \
+  X(0x09, ORA, IMM, 2, 0)  \
+  X(0x0A, ASL, ACC, 2, 0)  \
+  X(0x0B, ILL, IMP, 2, 0)  \
+  X(0x0C, ILL, IMP, 2, 0)  \
+  X(0x0D, ORA, ABS, 4, 0)  \
+  X(0x0E, ASL, ABS, 6, 0)  \
+  X(0x0F, ILL, IMP, 2, 0)  \
+  X(0x10, BPL, REL, 2, 2)  \
+  X(0x11, ORA, INDY, 5, 1) \
+  X(0x12, ILL, IMP, 2, 0)  \
+  X(0x13, ILL, IMP, 2, 0)  \
+  X(0x14, ILL, IMP, 2, 0)  \
+  X(0x15, ORA, ZPX, 4, 0)  \
+  X(0x16, ASL, ZPX, 6, 0)  \
+  X(0x17, ILL, IMP, 2, 0)  \
+  X(0x18, CLC, IMP, 2, 0)  \
+  X(0x19, ORA, ABSY, 4, 1) \
+  X(0x1A, ILL, IMP, 2, 0)  \
+  X(0x1B, ILL, IMP, 2, 0)  \
+  X(0x1C, ILL, IMP, 2, 0)  \
+  X(0x1D, ORA, ABSX, 4, 1) \
+  X(0x1E, ASL, ABSX, 7, 0) \
+  X(0x1F, ILL, IMP, 2, 0)  \
+  X(0x20, JSR, ABS, 6, 0)  \
+  X(0x21, AND, INDX, 6, 0) \
+  X(0x22, ILL, IMP, 2, 0)  \
+  X(0x23, ILL, IMP, 2, 0)  \
+  X(0x24, BIT, ZP, 3, 0)   \
+  X(0x25, AND, ZP, 3, 0)   \
+  X(0x26, ROL, ZP, 5, 0)   \
+  X(0x27, ILL, IMP, 2, 0)  \
+  X(0x28, PLP, IMP, 4, 0)  \
+  X(0x29, AND, IMM, 2, 0)  \
+  X(0x2A, ROL, ACC, 2, 0)  \
+  X(0x2B, ILL, IMP, 2, 0)  \
+  X(0x2C, BIT, ABS, 4, 0)  \
+  X(0x2D, AND, ABS, 4, 0)  \
+  X(0x2E, ROL, ABS, 6, 0)  \
+  X(0x2F, ILL, IMP, 2, 0)  \
+  X(0x30, BMI, REL, 2, 2)  \
+  X(0x31, AND, INDY, 5, 1) \
+  X(0x32, ILL, IMP, 2, 0)  \
+  X(0x33, ILL, IMP, 2, 0)  \
+  X(0x34, ILL, IMP, 2, 0)  \
+  X(0x35, AND, ZPX, 4, 0)  \
+  X(0x36, ROL, ZPX, 6, 0)  \
+  X(0x37, ILL, IMP, 2, 0)  \
+  X(0x38, SEC, IMP, 2, 0)  \
+  X(0x39, AND, ABSY, 4, 1) \
+  X(0x3A, ILL, IMP, 2, 0)  \
+  X(0x3B, ILL, IMP, 2, 0)  \
+  X(0x3C, ILL, IMP, 2, 0)  \
+  X(0x3D, AND, ABSX, 4, 1) \
+  X(0x3E, ROL, ABSX, 7, 0) \
+  X(0x3F, ILL, IMP, 2, 0)  \
+  X(0x40, RTI, IMP, 6, 0)  \
+  X(0x41, EOR, INDX, 6, 0) \
+  X(0x42, ILL, IMP, 2, 0)  \
+  X(0x43, ILL, IMP, 2, 0)  \
+  X(0x44, ILL, IMP, 2, 0)  \
+  X(0x45, EOR, ZP, 3, 0)   \
+  X(0x46, LSR, ZP, 5, 0)   \
+  X(0x47, ILL, IMP, 2, 0)  \
+  X(0x48, PHA, IMP, 3, 0)  \
+  X(0x49, EOR, IMM, 2, 0)  \
+  X(0x4A, LSR, ACC, 2, 0)  \
+  X(0x4B, ILL, IMP, 2, 0)  \
+  X(0x4C, JMP, ABS, 3, 0)  \
+  X(0x4D, EOR, ABS, 4, 0)  \
+  X(0x4E, LSR, ABS, 6, 0)  \
+  X(0x4F, ILL, IMP, 2, 0)  \
+  X(0x50, BVC, REL, 2, 2)  \
+  X(0x51, EOR, INDY, 5, 1) \
+  X(0x52, ILL, IMP, 2, 0)  \
+  X(0x53, ILL, IMP, 2, 0)  \
+  X(0x54, ILL, IMP, 2, 0)  \
+  X(0x55, EOR, ZPX, 4, 0)  \
+  X(0x56, LSR, ZPX, 6, 0)  \
+  X(0x57, ILL, IMP, 2, 0)  \
+  X(0x58, CLI, IMP, 2, 0)  \
+  X(0x59, EOR, ABSY, 4, 1) \
+  X(0x5A, ILL, IMP, 2, 0)  \
+  X(0x5B, ILL, IMP, 2, 0)  \
+  X(0x5C, ILL, IMP, 2, 0)  \
+  X(0x5D, EOR, ABSX, 4, 1) \
+  X(0x5E, LSR, ABSX, 7, 0) \
+  X(0x5F, ILL, IMP, 2, 0)  \
+  X(0x60, RTS, IMP, 6, 0)  \
+  X(0x61, ADC, INDX, 6, 0) \
+  X(0x62, ILL, IMP, 2, 0)  \
+  X(0x63, ILL, IMP, 2, 0)  \
+  X(0x64, ILL, IMP, 2, 0)  \
+  X(0x65, ADC, ZP, 3, 0)   \
+  X(0x66, ROR, ZP, 5, 0)   \
+  X(0x67, ILL, IMP, 2, 0)  \
+  X(0x68, PLA, IMP, 4, 0)  \
+  X(0x69, ADC, IMM, 2, 0)  \
+  X(0x6A, ROR, ACC, 2, 0)  \
+  X(0x6B, ILL, IMP, 2, 0)  \
+  X(0x6C, JMP, IND, 5, 0)  \
+  X(0x6D, ADC, ABS, 4, 0)  \
+  X(0x6E, ROR, ABS, 6, 0)  \
+  X(0x6F, ILL, IMP, 2, 0)  \
+  X(0x70, BVS, REL, 2, 2)  \
+  X(0x71, ADC, INDY, 5, 1) \
+  X(0x72, ILL, IMP, 2, 0)  \
+  X(0x73, ILL, IMP, 2, 0)  \
+  X(0x74, ILL, IMP, 2, 0)  \
+  X(0x75, ADC, ZPX, 4, 0)  \
+  X(0x76, ROR, ZPX, 6, 0)  \
+  X(0x77, ILL, IMP, 2, 0)  \
+  X(0x78, SEI, IMP, 2, 0)  \
+  X(0x79, ADC, ABSY, 4, 1) \
+  X(0x7A, ILL, IMP, 2, 0)  \
+  X(0x7B, ILL, IMP, 2, 0)  \
+  X(0x7C, ILL, IMP, 2, 0)  \
+  X(0x7D, ADC, ABSX, 4, 1) \
+  X(0x7E, ROR, ABSX, 7, 0) \
+  X(0x7F, ILL, IMP, 2, 0)  \
+  X(0x80, ILL, IMP, 2, 0)  \
+  X(0x81, STA, INDX, 6, 0) \
+  X(0x82, ILL, IMP, 2, 0)  \
+  X(0x83, ILL, IMP, 2, 0)  \
+  X(0x84, STY, ZP, 3, 0)   \
+  X(0x85, STA, ZP, 3, 0)   \
+  X(0x86, STX, ZP, 3, 0)   \
+  X(0x87, ILL, IMP, 2, 0)  \
+  X(0x88, DEY, IMP, 2, 0)  \
+  X(0x89, ILL, IMP, 2, 0)  \
+  X(0x8A, TXA, IMP, 2, 0)  \
+  X(0x8B, ILL, IMP, 2, 0)  \
+  X(0x8C, STY, ABS, 4, 0)  \
+  X(0x8D, STA, ABS, 4, 0)  \
+  X(0x8E, STX, ABS, 4, 0)  \
+  X(0x8F, ILL, IMP, 2, 0)  \
+  X(0x90, BCC, REL, 2, 2)  \
+  X(0x91, STA, INDY, 6, 0) \
+  X(0x92, ILL, IMP, 2, 0)  \
+  X(0x93, ILL, IMP, 2, 0)  \
+  X(0x94, STY, ZPX, 4, 0)  \
+  X(0x95, STA, ZPX, 4, 0)  \
+  X(0x96, STX, ZPY, 4, 0)  \
+  X(0x97, ILL, IMP, 2, 0)  \
+  X(0x98, TYA, IMP, 2, 0)  \
+  X(0x99, STA, ABSY, 5, 0) \
+  X(0x9A, TXS, IMP, 2, 0)  \
+  X(0x9B, ILL, IMP, 2, 0)  \
+  X(0x9C, ILL, IMP, 2, 0)  \
+  X(0x9D, STA, ABSX, 5, 0) \
+  X(0x9E, ILL, IMP, 2, 0)  \
+  X(0x9F, ILL, IMP, 2, 0)  \
+  X(0xA0, LDY, IMM, 2, 0)  \
+  X(0xA1, LDA, INDX, 6, 0) \
+  X(0xA2, LDX, IMM, 2, 0)  \
+  X(0xA3, ILL, IMP, 2, 0)  \
+  X(0xA4, LDY, ZP, 3, 0)   \
+  X(0xA5, LDA, ZP, 3, 0)   \
+  X(0xA6, LDX, ZP, 3, 0)   \
+  X(0xA7, ILL, IMP, 2, 0)  \
+  X(0xA8, TAY, IMP, 2, 0)  \
+  X(0xA9, LDA, IMM, 2, 0)  \
+  X(0xAA, TAX, IMP, 2, 0)  \
+  X(0xAB, ILL, IMP, 2, 0)  \
+  X(0xAC, LDY, ABS, 4, 0)  \
+  X(0xAD, LDA, ABS, 4, 0)  \
+  X(0xAE, LDX, ABS, 4, 0)  \
+  X(0xAF, ILL, IMP, 2, 0)  \
+  X(0xB0, BCS, REL, 2, 2)  \
+  X(0xB1, LDA, INDY, 5, 1) \
+  X(0xB2, ILL, IMP, 2, 0)  \
+  X(0xB3, ILL, IMP, 2, 0)  \
+  X(0xB4, LDY, ZPX, 4, 0)  \
+  X(0xB5, LDA, ZPX, 4, 0)  \
+  X(0xB6, LDX, ZPY, 4, 0)  \
+  X(0xB7, ILL, IMP, 2, 0)  \
+  X(0xB8, CLV, IMP, 2, 0)  \
+  X(0xB9, LDA, ABSY, 4, 1) \
+  X(0xBA, TSX, IMP, 2, 0)  \
+  X(0xBB, ILL, IMP, 2, 0)  \
+  X(0xBC, LDY, ABSX, 4, 1) \
+  X(0xBD, LDA, ABSX, 4, 1) \
+  X(0xBE, LDX, ABSY, 4, 1) \
+  X(0xBF, ILL, IMP, 2, 0)  \
+  X(0xC0, CPY, IMM, 2, 0)  \
+  X(0xC1, CMP, INDX, 6, 0) \
+  X(0xC2, ILL, IMP, 2, 0)  \
+  X(0xC3, ILL, IMP, 2, 0)  \
+  X(0xC4, CPY, ZP, 3, 0)   \
+  X(0xC5, CMP, ZP, 3, 0)   \
+  X(0xC6, DEC, ZP, 5, 0)   \
+  X(0xC7, ILL, IMP, 2, 0)  \
+  X(0xC8, INY, IMP, 2, 0)  \
+  X(0xC9, CMP, IMM, 2, 0)  \
+  X(0xCA, DEX, IMP, 2, 0)  \
+  X(0xCB, ILL, IMP, 2, 0)  \
+  X(0xCC, CPY, ABS, 4, 0)  \
+  X(0xCD, CMP, ABS, 4, 0)  \
+  X(0xCE, DEC, ABS, 6, 0)  \
+  X(0xCF, ILL, IMP, 2, 0)  \
+  X(0xD0, BNE, REL, 2, 2)  \
+  X(0xD1, CMP, INDY, 5, 1) \
+  X(0xD2, ILL, IMP, 2, 0)  \
+  X(0xD3, ILL, IMP, 2, 0)  \
+  X(0xD4, ILL, IMP, 2, 0)  \
+  X(0xD5, CMP, ZPX, 4, 0)  \
+  X(0xD6, DEC, ZPX, 6, 0)  \
+  X(0xD7, ILL, IMP, 2, 0)  \
+  X(0xD8, CLD, IMP, 2, 0)  \
+  X(0xD9, CMP, ABSY, 4, 1) \
+  X(0xDA, ILL, IMP, 2, 0)  \
+  X(0xDB, ILL, IMP, 2, 0)  \
+  X(0xDC, ILL, IMP, 2, 0)  \
+  X(0xDD, CMP, ABSX, 4, 1) \
+  X(0xDE, DEC, ABSX, 7, 0) \
+  X(0xDF, ILL, IMP, 2, 0)  \
+  X(0xE0, CPX, IMM, 2, 0)  \
+  X(0xE1, SBC, INDX, 6, 0) \
+  X(0xE2, ILL, IMP, 2, 0)  \
+  X(0xE3, ILL, IMP, 2, 0)  \
+  X(0xE4, CPX, ZP, 3, 0)   \
+  X(0xE5, SBC, ZP, 3, 0)   \
+  X(0xE6, INC, ZP, 5, 0)   \
+  X(0xE7, ILL, IMP, 2, 0)  \
+  X(0xE8, INX, IMP, 2, 0)  \
+  X(0xE9, SBC, IMM, 2, 0)  \
+  X(0xEA, NOP, IMP, 2, 0)  \
+  X(0xEB, ILL, IMP, 2, 0)  \
+  X(0xEC, CPX, ABS, 4, 0)  \
+  X(0xED, SBC, ABS, 4, 0)  \
+  X(0xEE, INC, ABS, 6, 0)  \
+  X(0xEF, ILL, IMP, 2, 0)  \
+  X(0xF0, BEQ, REL, 2, 2)  \
+  X(0xF1, SBC, INDY, 5, 1) \
+  X(0xF2, ILL, IMP, 2, 0)  \
+  X(0xF3, ILL, IMP, 2, 0)  \
+  X(0xF4, ILL, IMP, 2, 0)  \
+  X(0xF5, SBC, ZPX, 4, 0)  \
+  X(0xF6, INC, ZPX, 6, 0)  \
+  X(0xF7, ILL, IMP, 2, 0)  \
+  X(0xF8, SED, IMP, 2, 0)  \
+  X(0xF9, SBC, ABSY, 4, 1) \
+  X(0xFA, ILL, IMP, 2, 0)  \
+  X(0xFB, ILL, IMP, 2, 0)  \
+  X(0xFC, ILL, IMP, 2, 0)  \
+  X(0xFD, SBC, ABSX, 4, 1) \
+  X(0xFE, INC, ABSX, 7, 0) \
+  X(0xFF, ILL, IMP, 2, 0) 
+
+// Memory access
+
+// Slow paths for pages without a host pointer, in tiny6502.c.
+uint8_t cpu_io_read(CPU *cpu, uint16_t addr);
+void cpu_io_write(CPU *cpu, uint16_t addr, uint8_t value);
+
+static inline void cpu_copy_registers(CPU *dst, const CPU *src) {
+  dst->PC = src->PC;
+  dst->SP = src->SP;
+  dst->A = src->A;
+  dst->X = src->X;
+  dst->Y = src->Y;
+  dst->P = src->P;
+  dst->flag_n = src->flag_n;
+  dst->flag_z = src->flag_z;
+  dst->flag_v = src->flag_v;
+  dst->flag_c = src->flag_c;
+  dst->NMI = src->NMI;
+  dst->IRQ = src->IRQ;
+  dst->cycles_left = src->cycles_left;
+  dst->cycles = src->cycles;
+  dst->deadline = src->deadline;
+}
+
+// Engines may run on a copy of the registers. Before a handler runs the copy
+// is stored back to the CPU owning the page tables, which is what the handler
+// sees, and reloaded afterwards in case the handler raised an interrupt. For
+// the owner itself both copies are no-ops; they are done unconditionally
+// because comparing against the copy's address would pin it to memory.
+static inline CPU *cpu_bus_enter(CPU *cpu) {
+  CPU *owner = (CPU *)((char *)cpu->bus - offsetof(CPU, pages));
+  cpu_copy_registers(owner, cpu);
+  return owner;
+}
+
+static inline void cpu_bus_leave(CPU *cpu, CPU *owner) {
+  cpu_copy_registers(cpu, owner);
+}
+
+static inline uint8_t cpu_load(CPU *cpu, uint16_t addr) {
+  const uint8_t *page = cpu->bus->read[addr >> 8];
+  if (page)
+    return page[addr & 0xFF];
+
+  CPU *owner = cpu_bus_enter(cpu);
+  uint8_t value = cpu_io_read(owner, addr);
+  cpu_bus_leave(cpu, owner);
+  return value;
+}
+
+static inline void cpu_store(CPU *cpu, uint16_t addr, uint8_t value) {
+  uint8_t *page = cpu->bus->write[addr >> 8];
+  if (page) {
+    page[addr & 0xFF] = value;
+    return;
+  }
+
+  CPU *owner = cpu_bus_enter(cpu);
+  cpu_io_write(owner, addr, value);
+  cpu_bus_leave(cpu, owner);
+}
+
+static inline uint8_t cpu_fetch(CPU *cpu) { return cpu_load(cpu, cpu->PC++); }
+
+static inline uint16_t cpu_fetch16(CPU *cpu) {
+  uint16_t value = cpu_fetch(cpu);
+  return value | (cpu_fetch(cpu) << 8);
+}
+
+static inline void cpu_push(CPU *cpu, uint8_t value) {
+  cpu_store(cpu, 0x0100 | cpu->SP--, value);
+}
+
+static inline uint8_t cpu_pop(CPU *cpu) {
+  return cpu_load(cpu, 0x0100 | ++cpu->SP);
+}
+
+// Status register packing, see CPU.P.
+
+static inline uint8_t cpu_pack_flags(const CPU *cpu) {
+  return (cpu->P.reg & 0x3C) | (cpu->flag_n & 0x80) |
+         ((cpu->flag_v & 0x80) >> 1) | ((cpu->flag_z == 0) << 1) |
+         cpu->flag_c;
+}
+
+static inline void cpu_unpack_flags(CPU *cpu, uint8_t p) {
+  cpu->P.reg = p;
+  cpu->flag_n = p;
+  cpu->flag_z = ~p & 0x02;
+  cpu->flag_v = p << 1;
+  cpu->flag_c = p & 0x01;
+}
+
+// The interrupt lines, as cpu_set_irq() and cpu_set_nmi() drive them when no
+// replay intervenes.
+static inline void cpu_drive_irq(CPU *cpu, unsigned source, bool asserted) {
+  if (asserted)
+    cpu->irq_sources |= 1u << source;
+  else
+    cpu->irq_sources &= ~(1u << source);
+  cpu->IRQ = cpu->irq_sources != 0;
+}
+
+static inline void cpu_drive_nmi(CPU *cpu, unsigned source, bool asserted) {
+  uint8_t before = cpu->nmi_sources;
+  if (asserted)
+    cpu->nmi_sources |= 1u << source;
+  else
+    cpu->nmi_sources &= ~(1u << source);
+  if (!before && cpu->nmi_sources)
+    cpu->NMI = true;
+}
+
+// P as an interrupt entry pushes it: B clear and the unused bit set. BRK and
+// PHP push both set.
+static inline uint8_t cpu_interrupt_flags(const CPU *cpu) {
+  return (cpu_pack_flags(cpu) & 0xEF) | 0x20;
+}
+
+// Enters the pending interrupt: a latched NMI edge, which is used up, or
+// else the IRQ line, which stays as its sources hold it.
+static inline void cpu_interrupt(CPU *cpu) {
+  uint16_t vector = 0xFFFE;
+  if (cpu->NMI) {
+    cpu->NMI = 0;
+    vector = 0xFFFA;
+  }
+  cpu_push(cpu, cpu->PC >> 8);
+  cpu_push(cpu, cpu->PC & 0xFF);
+  cpu_push(cpu, cpu_interrupt_flags(cpu));
+  cpu->P.flags.I = 1;
+  cpu->PC = cpu_load(cpu, vector) | (cpu_load(cpu, vector + 1) << 8);
+}
+
+// Effective addresses. Zero page modes wrap within the zero page.
+
+static inline uint16_t cpu_address_ZP(CPU *cpu) { return cpu_fetch(cpu); }
+
+static inline uint16_t cpu_address_ZPX(CPU *cpu) {
+  return (uint8_t)(cpu_fetch(cpu) + cpu->X);
+}
+
+static inline uint16_t cpu_address_ZPY(CPU *cpu) {
+  return (uint8_t)(cpu_fetch(cpu) + cpu->Y);
+}
+
+static inline uint16_t cpu_address_ABS(CPU *cpu) { return cpu_fetch16(cpu); }
+
+static inline uint16_t cpu_address_ABSX(CPU *cpu) {
+  return cpu_fetch16(cpu) + cpu->X;
+}
+
+static inline uint16_t cpu_address_ABSY(CPU *cpu) {
+  return cpu_fetch16(cpu) + cpu->Y;
+}
+
+// The pointer's high byte is read without carrying into the next page, as
+// the NMOS 6502 does for JMP ($xxFF).
+static inline uint16_t cpu_address_IND(CPU *cpu) {
+  uint16_t ptr = cpu_fetch16(cpu);
+  uint16_t value = cpu_load(cpu, ptr);
+  return value | (cpu_load(cpu, (ptr & 0xFF00) | ((ptr + 1) & 0xFF)) << 8);
+}
+
+static inline uint16_t cpu_address_INDX(CPU *cpu) {
+  uint8_t ptr = cpu_fetch(cpu) + cpu->X;
+  uint16_t value = cpu_load(cpu, ptr);
+  return value | (cpu_load(cpu, (uint8_t)(ptr + 1)) << 8);
+}
+
+static inline uint16_t cpu_address_INDY(CPU *cpu) {
+  uint8_t ptr = cpu_fetch(cpu);
+  uint16_t value = cpu_load(cpu, ptr);
+  value |= cpu_load(cpu, (uint8_t)(ptr + 1)) << 8;
+  return value + cpu->Y;
+}
+
+// Operands of instructions that read memory.
+
+static inline uint8_t cpu_operand_IMM(CPU *cpu) { return cpu_fetch(cpu); }
+
+static inline uint8_t cpu_operand_ZP(CPU *cpu) {
+  return cpu_load(cpu, cpu_address_ZP(cpu));
+}
+
+static inline uint8_t cpu_operand_ZPX(CPU *cpu) {
+  return cpu_load(cpu, cpu_address_ZPX(cpu));
+}
+
+static inline uint8_t cpu_operand_ZPY(CPU *cpu) {
+  return cpu_load(cpu, cpu_address_ZPY(cpu));
+}
+
+static inline uint8_t cpu_operand_ABS(CPU *cpu) {
+  return cpu_load(cpu, cpu_address_ABS(cpu));
+}
+
+static inline uint8_t cpu_operand_ABSX(CPU *cpu) {
+  return cpu_load(cpu, cpu_address_ABSX(cpu));
+}
+
+static inline uint8_t cpu_operand_ABSY(CPU *cpu) {
+  return cpu_load(cpu, cpu_address_ABSY(cpu));
+}
+
+static inline uint8_t cpu_operand_INDX(CPU *cpu) {
+  return cpu_load(cpu, cpu_address_INDX(cpu));
+}
+
+static inline uint8_t cpu_operand_INDY(CPU *cpu) {
+  return cpu_load(cpu, cpu_address_INDY(cpu));
+}
+
+// Operations
+
+static inline void cpu_set_nz(CPU *cpu, uint8_t value) {
+  cpu->flag_n = value;
+  cpu->flag_z = value;
+}
+
+// Decimal mode is not implemented; ADC and SBC always work in binary.
+static inline void cpu_adc(CPU *cpu, uint8_t value) {
+  uint16_t result = cpu->A + value + cpu->flag_c;
+  cpu->flag_c = result >> 8;
+  cpu->flag_v = (cpu->A ^ result) & (value ^ result);
+  cpu->A = result;
+  cpu_set_nz(cpu, cpu->A);
+}
+
+static inline void cpu_sbc(CPU *cpu, uint8_t value) { cpu_adc(cpu, ~value); }
+
+static inline void cpu_compare(CPU *cpu, uint8_t reg, uint8_t value) {
+  cpu->flag_c = reg >= value;
+  cpu_set_nz(cpu, reg - value);
+}
+
+static inline void cpu_bit(CPU *cpu, uint8_t value) {
+  cpu->flag_z = cpu->A & value;
+  cpu->flag_n = value;
+  cpu->flag_v = value << 1;
+}
+
+static inline uint8_t cpu_asl(CPU *cpu, uint8_t value) {
+  cpu->flag_c = value >> 7;
+  value <<= 1;
+  cpu_set_nz(cpu, value);
+  return value;
+}
+
+static inline uint8_t cpu_lsr(CPU *cpu, uint8_t value) {
+  cpu->flag_c = value & 1;
+  value >>= 1;
+  cpu_set_nz(cpu, value);
+  return value;
+}
+
+static inline uint8_t cpu_rol(CPU *cpu, uint8_t value) {
+  uint8_t result = (value << 1) | cpu->flag_c;
+  cpu->flag_c = value >> 7;
+  cpu_set_nz(cpu, result);
+  return result;
+}
+
+static inline uint8_t cpu_ror(CPU *cpu, uint8_t value) {
+  uint8_t result = (value >> 1) | (cpu->flag_c << 7);
+  cpu->flag_c = value & 1;
+  cpu_set_nz(cpu, result);
+  return result;
+}
+
+static inline uint8_t cpu_inc(CPU *cpu, uint8_t value) {
+  cpu_set_nz(cpu, ++value);
+  return value;
+}
+
+static inline uint8_t cpu_dec(CPU *cpu, uint8_t value) {
+  cpu_set_nz(cpu, --value);
+  return value;
+}
+
+static inline void cpu_rmw(CPU *cpu, uint16_t addr,
+                           uint8_t (*op)(CPU *, uint8_t)) {
+  cpu_store(cpu, addr, op(cpu, cpu_load(cpu, addr)));
+}
+
+static inline void cpu_branch(CPU *cpu, bool taken) {
+  int8_t offset = cpu_fetch(cpu);
+  if (taken)
+    cpu->PC += offset;
+}
+
+static inline void cpu_brk(CPU *cpu) {
+  cpu->PC++;
+  cpu_push(cpu, cpu->PC >> 8);
+  cpu_push(cpu, cpu->PC & 0xFF);
+  cpu_push(cpu, cpu_pack_flags(cpu) | 0x30);
+  cpu->P.flags.I = 1;
+  cpu->PC = cpu_load(cpu, 0xFFFE) | (cpu_load(cpu, 0xFFFF) << 8);
+}
+
+static inline void cpu_jsr(CPU *cpu) {
+  uint16_t target = cpu_fetch16(cpu);
+  cpu->PC--;
+  cpu_push(cpu, cpu->PC >> 8);
+  cpu_push(cpu, cpu->PC & 0xFF);
+  cpu->PC = target;
+}
+
+static inline void cpu_rts(CPU *cpu) {
+  cpu->PC = cpu_pop(cpu);
+  cpu->PC |= cpu_pop(cpu) << 8;
+  cpu->PC++;
+}
+
+static inline void cpu_rti(CPU *cpu) {
+  cpu_unpack_flags(cpu, cpu_pop(cpu) & 0xCF);
+  cpu->PC = cpu_pop(cpu);
+  cpu->PC |= cpu_pop(cpu) << 8;
+}
+
+// Opcode bodies, specialised on the addressing mode at expansion time.
+
+// Where the bodies below get their operands and how they branch. An engine
+// that decodes operands ahead of time, or that counts page crossings,
+// redefines these before expanding the bodies.
+#define CPU_ADDRESS(cpu, mode) cpu_address_##mode(cpu)
+#define CPU_OPERAND(cpu, mode) cpu_operand_##mode(cpu)
+#define CPU_BRANCH(cpu, taken) cpu_branch(cpu, taken)
+
+#define CPU_RMW_ACC(cpu, op) ((cpu)->A = op(cpu, (cpu)->A))
+#define CPU_RMW_ZP(cpu, op) cpu_rmw(cpu, CPU_ADDRESS(cpu, ZP), op)
+#define CPU_RMW_ZPX(cpu, op) cpu_rmw(cpu, CPU_ADDRESS(cpu, ZPX), op)
+#define CPU_RMW_ABS(cpu, op) cpu_rmw(cpu, CPU_ADDRESS(cpu, ABS), op)
+#define CPU_RMW_ABSX(cpu, op) cpu_rmw(cpu, CPU_ADDRESS(cpu, ABSX), op)
+
+#define CPU_LOAD(cpu, reg, value) cpu_set_nz(cpu, (cpu)->reg = (value))
+
+#define EXEC_ADC(cpu, mode) cpu_adc(cpu, CPU_OPERAND(cpu, mode))
+#define EXEC_AND(cpu, mode) CPU_LOAD(cpu, A, (cpu)->A & CPU_OPERAND(cpu, mode))
+#define EXEC_ASL(cpu, mode) CPU_RMW_##mode(cpu, cpu_asl)
+#define EXEC_BCC(cpu, mode) CPU_BRANCH(cpu, !(cpu)->flag_c)
+#define EXEC_BCS(cpu, mode) CPU_BRANCH(cpu, (cpu)->flag_c)
+#define EXEC_BEQ(cpu, mode) CPU_BRANCH(cpu, !(cpu)->flag_z)
+#define EXEC_BIT(cpu, mode) cpu_bit(cpu, CPU_OPERAND(cpu, mode))
+#define EXEC_BMI(cpu, mode) CPU_BRANCH(cpu, (cpu)->flag_n >> 7)
+#define EXEC_BNE(cpu, mode) CPU_BRANCH(cpu, (cpu)->flag_z != 0)
+#define EXEC_BPL(cpu, mode) CPU_BRANCH(cpu, !((cpu)->flag_n >> 7))
+#define EXEC_BRK(cpu, mode) cpu_brk(cpu)
+#define EXEC_BVC(cpu, mode) CPU_BRANCH(cpu, !((cpu)->flag_v >> 7))
+#define EXEC_BVS(cpu, mode) CPU_BRANCH(cpu, (cpu)->flag_v >> 7)
+#define EXEC_CLC(cpu, mode) ((cpu)->flag_c = 0)
+#define EXEC_CLD(cpu, mode) ((cpu)->P.flags.D = 0)
+#define EXEC_CLI(cpu, mode) ((cpu)->P.flags.I = 0)
+#define EXEC_CLV(cpu, mode) ((cpu)->flag_v = 0)
+#define EXEC_CMP(cpu, mode) cpu_compare(cpu, (cpu)->A, CPU_OPERAND(cpu, mode))
+#define EXEC_CPX(cpu, mode) cpu_compare(cpu, (cpu)->X, CPU_OPERAND(cpu, mode))
+#define EXEC_CPY(cpu, mode) cpu_compare(cpu, (cpu)->Y, CPU_OPERAND(cpu, mode))
+#define EXEC_DEC(cpu, mode) CPU_RMW_##mode(cpu, cpu_dec)
+#define EXEC_DEX(cpu, mode) CPU_LOAD(cpu, X, (cpu)->X - 1)
+#define EXEC_DEY(cpu, mode) CPU_LOAD(cpu, Y, (cpu)->Y - 1)
+#define EXEC_EOR(cpu, mode) CPU_LOAD(cpu, A, (cpu)->A ^ CPU_OPERAND(cpu, mode))
+#define EXEC_INC(cpu, mode) CPU_RMW_##mode(cpu, cpu_inc)
+#define EXEC_INX(cpu, mode) CPU_LOAD(cpu, X, (cpu)->X + 1)
+#define EXEC_INY(cpu, mode) CPU_LOAD(cpu, Y, (cpu)->Y + 1)
+#define EXEC_JMP(cpu, mode) ((cpu)->PC = CPU_ADDRESS(cpu, mode))
+#define EXEC_JSR(cpu, mode) cpu_jsr(cpu)
+#define EXEC_LDA(cpu, mode) CPU_LOAD(cpu, A, CPU_OPERAND(cpu, mode))
+#define EXEC_LDX(cpu, mode) CPU_LOAD(cpu, X, CPU_OPERAND(cpu, mode))
+#define EXEC_LDY(cpu, mode) CPU_LOAD(cpu, Y, CPU_OPERAND(cpu, mode))
+#define EXEC_LSR(cpu, mode) CPU_RMW_##mode(cpu, cpu_lsr)
+#define EXEC_NOP(cpu, mode) ((void)(cpu))
+#define EXEC_ORA(cpu, mode) CPU_LOAD(cpu, A, (cpu)->A | CPU_OPERAND(cpu, mode))
+#define EXEC_PHA(cpu, mode) cpu_push(cpu, (cpu)->A)
+#define EXEC_PHP(cpu, mode) cpu_push(cpu, cpu_pack_flags(cpu) | 0x30)
+#define EXEC_PLA(cpu, mode) CPU_LOAD(cpu, A, cpu_pop(cpu))
+#define EXEC_PLP(cpu, mode) cpu_unpack_flags(cpu, cpu_pop(cpu) & 0xCF)
+#define EXEC_ROL(cpu, mode) CPU_RMW_##mode(cpu, cpu_rol)
+#define EXEC_ROR(cpu, mode) CPU_RMW_##mode(cpu, cpu_ror)
+#define EXEC_RTI(cpu, mode) cpu_rti(cpu)
+#define EXEC_RTS(cpu, mode) cpu_rts(cpu)
+#define EXEC_SBC(cpu, mode) cpu_sbc(cpu, CPU_OPERAND(cpu, mode))
+#define EXEC_SEC(cpu, mode) ((cpu)->flag_c = 1)
+#define EXEC_SED(cpu, mode) ((cpu)->P.flags.D = 1)
+#define EXEC_SEI(cpu, mode) ((cpu)->P.flags.I = 1)
+#define EXEC_STA(cpu, mode) cpu_store(cpu, CPU_ADDRESS(cpu, mode), (cpu)->A)
+#define EXEC_STX(cpu, mode) cpu_store(cpu, CPU_ADDRESS(cpu, mode), (cpu)->X)
+#define EXEC_STY(cpu, mode) cpu_store(cpu, CPU_ADDRESS(cpu, mode), (cpu)->Y)
+#define EXEC_TAX(cpu, mode) CPU_LOAD(cpu, X, (cpu)->A)
+#define EXEC_TAY(cpu, mode) CPU_LOAD(cpu, Y, (cpu)->A)
+#define EXEC_TSX(cpu, mode) CPU_LOAD(cpu, X, (cpu)->SP)
+#define EXEC_TXA(cpu, mode) CPU_LOAD(cpu, A, (cpu)->X)
+#define EXEC_TXS(cpu, mode) ((cpu)->SP = (cpu)->X)
+#define EXEC_TYA(cpu, mode) CPU_LOAD(cpu, A, (cpu)->Y)
+#define EXEC_ILL(cpu, mode) ((void)(cpu))
 
 #endif // TINY6502_OPS_H
@@ -0,0 +1,130 @@
+#include "tiny6502_profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tiny6502_ops.h"
+
+#define CPU_PROFILE_INDEX (2 * CPU_PROFILE_NODES)
+
+void cpu_profile_init(CPUProfile *profile) {
+  memset(profile, 0, sizeof(*profile));
+  profile->node_count = 1;
+}
+
+void cpu_profile_attach(CPU *cpu, CPUProfile *profile) {
+  if (profile && profile->node_count == 1 && !profile->nodes[0].cycles)
+    profile->nodes[0].addr = cpu->PC;
+  cpu->profile = profile;
+}
+
+static unsigned cpu_profile_hash(uint32_t parent, uint16_t addr) {
+  return ((parent << 16 | addr) * 2654435761u) >> 18 & (CPU_PROFILE_INDEX - 1);
+}
+
+void cpu_profile_call(CPUProfile *profile, uint16_t addr) {
+  if (profile->lost) {
+    profile->lost++;
+    return;
+  }
+
+  uint32_t parent = profile->node;
+  unsigned slot = cpu_profile_hash(parent, addr);
+  for (;; slot = (slot + 1) & (CPU_PROFILE_INDEX - 1)) {
+    unsigned n = profile->index[slot];
+    if (!n)
+      break;
+    const CPUProfileNode *node = &profile->nodes[n - 1];
+    if (node->parent == parent && node->addr == addr) {
+      profile->node = n - 1;
+      return;
+    }
+  }
+
+  if (profile->node_count == CPU_PROFILE_NODES) {
+    profile->lost = 1;
+    return;
+  }
+  uint32_t n = profile->node_count++;
+  profile->nodes[n] = (CPUProfileNode){parent, addr, 0};
+  profile->index[slot] = n + 1;
+  profile->node = n;
+}
+
+typedef struct {
+  uint64_t cycles;
+  uint32_t index;
+} CPUProfileRank;
+
+static int cpu_profile_compare(const void *a, const void *b) {
+  const CPUProfileRank *x = a, *y = b;
+  if (x->cycles != y->cycles)
+    return x->cycles < y->cycles ? 1 : -1;
+  return x->index < y->index ? -1 : 1;
+}
+
+// The entries that ran, most cycles first.
+static uint32_t cpu_profile_sort(const CPUProfileEntry *entries,
+                                 uint32_t count, CPUProfileRank *order) {
+  uint32_t used = 0;
+  for (uint32_t i = 0; i < count; i++)
+    if (entries[i].count)
+      order[used++] = (CPUProfileRank){entries[i].cycles, i};
+  qsort(order, used, sizeof(*order), cpu_profile_compare);
+  return used;
+}
+
+static double cpu_profile_share(uint64_t cycles, uint64_t total) {
+  return total ? 100.0 * cycles / total : 0;
+}
+
+void cpu_profile_print(const CPUProfile *profile, FILE *out, unsigned top) {
+  CPUProfileRank *order = malloc(0x10000 * sizeof(*order));
+  if (!order)
+    return;
+
+  uint64_t total = 0;
+  for (unsigned i = 0; i < 0x100; i++)
+    total += profile->opcode[i].cycles;
+
+  uint32_t used = cpu_profile_sort(profile->pc, 0x10000, order);
+  if (top && top < used)
+    used = top;
+  fprintf(out, "%14s %7s %14s  address\n", "cycles", "share", "count");
+  for (uint32_t i = 0; i < used; i++) {
+    const CPUProfileEntry *entry = &profile->pc[order[i].index];
+    fprintf(out, "%14llu %6.2f%% %14llu  $%04X %s\n",
+            (unsigned long long)entry->cycles,
+            cpu_profile_share(entry->cycles, total),
+            (unsigned long long)entry->count, order[i].index,
+            cpu_opcode_table[entry->opcode].name);
+  }
+
+  used = cpu_profile_sort(profile->opcode, 0x100, order);
+  fprintf(out, "\n%14s %7s %14s  opcode\n", "cycles", "share", "count");
+  for (uint32_t i = 0; i < used; i++) {
+    const CPUProfileEntry *entry = &profile->opcode[order[i].index];
+    fprintf(out, "%14llu %6.2f%% %14llu  $%02X %s\n",
+            (unsigned long long)entry->cycles,
+            cpu_profile_share(entry->cycles, total),
+            (unsigned long long)entry->count, order[i].index,
+            cpu_opcode_table[order[i].index].name);
+  }
+  free(order);
+}
+
+static void cpu_profile_fold_chain(const CPUProfile *profile, uint32_t n,
+                                   FILE *out) {
+  if (n)
+    cpu_profile_fold_chain(profile, profile->nodes[n].parent, out);
+  fprintf(out, n ? ";$%04X" : "$%04X", profile->nodes[n].addr);
+}
+
+void cpu_profile_fold(const CPUProfile *profile, FILE *out) {
+  for (uint32_t n = 0; n < profile->node_count; n++) {
+    if (!profile->nodes[n].cycles)
+      continue;
+    cpu_profile_fold_chain(profile, n, out);
+    fprintf(out, " %llu\n", (unsigned long long)profile->nodes[n].cycles);
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef TINY6502_PROFILE_H
+#define TINY6502_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tiny6502.h"
+
+// Execution profiles. Like tracing, profiling is compiled in only when
+// TINY6502_PROFILE is defined; without it the dispatch loop contains no
+// profiling code at all.
+//
+// While a profile is attached, every instruction is counted with the cycles
+// it took against its address and its opcode, and the cycles go to the call
+// chain it ran in. Chains follow JSR and RTS, with interrupt entries, BRK
+// and RTI treated as calls and returns. cpu_run runs on the table
+// interpreter, or under CPU_TIMING_CYCLE on the cycle engine, while a profile
+// is attached: the threaded interpreter, the block cache and the recompiler
+// are bypassed. Lanes are not profiled.
+
+#define CPU_PROFILE_NODES 4096
+
+typedef struct {
+  uint64_t count;
+  uint64_t cycles;
+  uint8_t opcode; // the last opcode run at the address
+} CPUProfileEntry;
+
+// A call chain: the chain of parent, then a call to addr. Node 0 is the
+// chain profiling started in.
+typedef struct {
+  uint32_t parent;
+  uint16_t addr;
+  uint64_t cycles;
+} CPUProfileNode;
+
+typedef struct CPUProfile {
+  CPUProfileEntry pc[0x10000];
+  CPUProfileEntry opcode[0x100];
+
+  CPUProfileNode nodes[CPU_PROFILE_NODES];
+  uint32_t node_count;
+
+  // The chain running now, and calls made since the nodes ran out, which
+  // returns undo before leaving it.
+  uint32_t node;
+  uint32_t lost;
+
+  // Open addressing over nodes by (parent, addr); 0 is free, n is node n - 1.
+  uint16_t index[2 * CPU_PROFILE_NODES];
+} CPUProfile;
+
+void cpu_profile_init(CPUProfile *profile);
+
+// Attaches profile to cpu, or detaches with NULL. The root chain is named
+// after the PC when the profile is first attached.
+void cpu_profile_attach(CPU *cpu, CPUProfile *profile);
+
+// A flat profile: the top addresses by cycles, 0 for all of them, then
+// every opcode run, both with their share of the cycles instructions took.
+void cpu_profile_print(const CPUProfile *profile, FILE *out, unsigned top);
+
+// One line per call chain, with frames named by their entry address and
+// separated by semicolons, then the cycles spent in the chain itself: the
+// folded format flame graph tools read.
+void cpu_profile_fold(const CPUProfile *profile, FILE *out);
+
+void cpu_profile_call(CPUProfile *profile, uint16_t addr);
+
+static inline void cpu_profile_return(CPUProfile *profile) {
+  if (profile->lost)
+    profile->lost--;
+  else
+    profile->node = profile->nodes[profile->node].parent;
+}
+
+static inline void cpu_profile_record(CPUProfile *profile, const CPU *cpu,
+                                      uint16_t pc, uint8_t opcode,
+                                      uint8_t cycles) {
+  CPUProfileEntry *entry = &profile->pc[pc];
+  entry->count++;
+  entry->cycles += cycles;
+  entry->opcode = opcode;
+  profile->opcode[opcode].count++;
+  profile->opcode[opcode].cycles += cycles;
+  profile->nodes[profile->node].cycles += cycles;
+
+  switch (opcode) {
+  case 0x00: // BRK
+  case 0x20: // JSR
+    cpu_profile_call(profile, cpu->PC);
+    break;
+  case 0x40: // RTI
+  case 0x60: // RTS
+    cpu_profile_return(profile);
+    break;
+  }
+}
+
+// An interrupt entry, charged to the chain it interrupts, which then calls
+// the handler.
+static inline void cpu_profile_interrupt(CPUProfile *profile, const CPU *cpu,
+                                         uint8_t cycles) {
+  profile->nodes[profile->node].cycles += cycles;
+  cpu_profile_call(profile, cpu->PC);
+}
+
+#endif // TINY6502_PROFILE_H
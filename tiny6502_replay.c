@@ -0,0 +1,234 @@
+#include "tiny6502_replay.h"
+
+#include "tiny6502_debug.h"
+#include "tiny6502_ops.h"
+
+// Each record starts with a tag: the kind in the low two bits, and for a line
+// change whether it asserts, the source and whether it was made inside a
+// handler. Accesses follow with the address, low byte first, and the value;
+// line changes made outside handlers with the cycles since the last one, in
+// 7-bit groups, low first.
+enum {
+  REPLAY_READ,
+  REPLAY_WRITE,
+  REPLAY_IRQ,
+  REPLAY_NMI,
+};
+
+#define REPLAY_KIND 0x03
+#define REPLAY_ASSERTED 0x04
+#define REPLAY_SOURCE_SHIFT 3
+#define REPLAY_INSIDE 0x40
+
+static bool cpu_replay_is_line(uint8_t tag) {
+  return (tag & REPLAY_KIND) >= REPLAY_IRQ;
+}
+
+static bool cpu_replay_is_timed(uint8_t tag) {
+  return cpu_replay_is_line(tag) && !(tag & REPLAY_INSIDE);
+}
+
+static void cpu_replay_attach(CPUReplay *replay, CPU *cpu, FILE *log) {
+  *replay = (CPUReplay){.cpu = cpu, .log = log, .cycle = cpu->cycles};
+  cpu->replay = replay;
+}
+
+void cpu_replay_record(CPUReplay *replay, CPU *cpu, FILE *log) {
+  cpu_replay_attach(replay, cpu, log);
+  replay->recording = true;
+}
+
+// Reads the next record, or ends playback at the end of the log.
+static void cpu_replay_next(CPUReplay *replay) {
+  FILE *log = replay->log;
+  int tag = getc(log);
+  replay->has_next = false;
+  if (tag == EOF) {
+    replay->playing = false;
+    return;
+  }
+  replay->tag = tag;
+
+  if (!cpu_replay_is_line(tag)) {
+    int low = getc(log), high = getc(log), value = getc(log);
+    if (value == EOF) {
+      replay->playing = false;
+      return;
+    }
+    replay->addr = low | high << 8;
+    replay->value = value;
+  } else if (!(tag & REPLAY_INSIDE)) {
+    uint64_t delta = 0;
+    int byte, shift = 0;
+    do {
+      if ((byte = getc(log)) == EOF || shift > 63) {
+        replay->playing = false;
+        return;
+      }
+      delta |= (uint64_t)(byte & 0x7F) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    replay->cycle += delta;
+    replay->at = replay->cycle;
+  }
+  replay->has_next = true;
+}
+
+void cpu_replay_play(CPUReplay *replay, CPU *cpu, FILE *log) {
+  cpu_replay_attach(replay, cpu, log);
+  replay->playing = true;
+  cpu_replay_next(replay);
+}
+
+void cpu_replay_stop(CPUReplay *replay) {
+  if (replay->recording)
+    fflush(replay->log);
+  if (replay->cpu->replay == replay)
+    replay->cpu->replay = NULL;
+  replay->recording = replay->playing = false;
+}
+
+static void cpu_replay_diverge(CPUReplay *replay, CPU *cpu) {
+  replay->diverged = true;
+  replay->playing = false;
+  cpu_stop_at(cpu, cpu->cycles);
+}
+
+static void cpu_replay_apply(CPUReplay *replay) {
+  uint8_t tag = replay->tag;
+  unsigned source = tag >> REPLAY_SOURCE_SHIFT & 0x07;
+  bool asserted = tag & REPLAY_ASSERTED;
+  if ((tag & REPLAY_KIND) == REPLAY_NMI)
+    cpu_drive_nmi(replay->cpu, source, asserted);
+  else
+    cpu_drive_irq(replay->cpu, source, asserted);
+  cpu_replay_next(replay);
+}
+
+// Makes the line changes due by now outside handlers.
+static void cpu_replay_due(CPUReplay *replay) {
+  CPU *cpu = replay->cpu;
+  while (replay->playing && replay->has_next &&
+         cpu_replay_is_timed(replay->tag) && replay->at <= cpu->cycles) {
+    if (replay->at < cpu->cycles) {
+      cpu_replay_diverge(replay, cpu);
+      return;
+    }
+    cpu_replay_apply(replay);
+  }
+}
+
+// Makes the line changes made inside the handler for this access, then checks
+// the access is the one recorded. Returns false if playback is over.
+static bool cpu_replay_expect(CPUReplay *replay, CPU *cpu, uint8_t kind,
+                              uint16_t addr) {
+  while (replay->playing && replay->has_next &&
+         cpu_replay_is_line(replay->tag) && (replay->tag & REPLAY_INSIDE))
+    cpu_replay_apply(replay);
+  if (!replay->playing)
+    return false;
+  if (replay->tag != kind || replay->addr != addr) {
+    cpu_replay_diverge(replay, cpu);
+    return false;
+  }
+  return true;
+}
+
+// Moves past an access. A line change outside handlers coming next is made
+// at its cycle, so the run must stop there.
+static void cpu_replay_advance(CPUReplay *replay, CPU *cpu) {
+  cpu_replay_next(replay);
+  if (replay->playing && replay->has_next && cpu_replay_is_timed(replay->tag))
+    cpu_stop_at(cpu, replay->at);
+}
+
+static void cpu_replay_log_access(CPUReplay *replay, uint8_t kind,
+                                  uint16_t addr, uint8_t value) {
+  uint8_t record[4] = {kind, addr & 0xFF, addr >> 8, value};
+  fwrite(record, 1, sizeof(record), replay->log);
+}
+
+uint8_t cpu_replay_read(CPUReplay *replay, CPU *cpu, uint16_t addr) {
+  const CPUPageHandler *handler = &cpu->pages.handler[addr >> 8];
+  if (!handler->read)
+    return 0xFF;
+
+  // Only the outermost access is an input: what a handler reads on its
+  // own account is part of the value it returns.
+  if (replay->playing && !replay->depth &&
+      cpu_replay_expect(replay, cpu, REPLAY_READ, addr)) {
+    uint8_t value = replay->value;
+    cpu_replay_advance(replay, cpu);
+    return value;
+  }
+
+  replay->depth++;
+  uint8_t value = handler->read(cpu, handler->read_data, addr);
+  replay->depth--;
+  if (replay->recording && !replay->depth)
+    cpu_replay_log_access(replay, REPLAY_READ, addr, value);
+  return value;
+}
+
+void cpu_replay_write(CPUReplay *replay, CPU *cpu, uint16_t addr,
+                      uint8_t value) {
+  const CPUPageHandler *handler = &cpu->pages.handler[addr >> 8];
+  if (!handler->write)
+    return;
+
+  if (replay->playing && !replay->depth &&
+      cpu_replay_expect(replay, cpu, REPLAY_WRITE, addr)) {
+    if (replay->value != value)
+      cpu_replay_diverge(replay, cpu);
+    else
+      cpu_replay_advance(replay, cpu);
+  }
+
+  replay->depth++;
+  handler->write(cpu, handler->write_data, addr, value);
+  replay->depth--;
+  if (replay->recording && !replay->depth)
+    cpu_replay_log_access(replay, REPLAY_WRITE, addr, value);
+}
+
+bool cpu_replay_line(CPUReplay *replay, bool nmi, unsigned source,
+                     bool asserted) {
+  if (replay->playing)
+    return false;
+  if (!replay->recording)
+    return true;
+
+  uint8_t tag = (nmi ? REPLAY_NMI : REPLAY_IRQ) |
+                (asserted ? REPLAY_ASSERTED : 0) |
+                source << REPLAY_SOURCE_SHIFT;
+  if (replay->depth) {
+    putc(tag | REPLAY_INSIDE, replay->log);
+    return true;
+  }
+
+  putc(tag, replay->log);
+  uint64_t delta = replay->cpu->cycles - replay->cycle;
+  replay->cycle = replay->cpu->cycles;
+  do {
+    putc((delta & 0x7F) | (delta > 0x7F ? 0x80 : 0), replay->log);
+    delta >>= 7;
+  } while (delta);
+  return true;
+}
+
+uint64_t cpu_replay_run(CPUReplay *replay, uint64_t cycle_budget) {
+  CPU *cpu = replay->cpu;
+  uint64_t consumed = 0;
+  for (;;) {
+    cpu_replay_due(replay);
+    if (consumed >= cycle_budget || replay->diverged)
+      return consumed;
+    uint64_t budget = cycle_budget - consumed;
+    if (replay->playing && replay->has_next &&
+        cpu_replay_is_timed(replay->tag) && replay->at - cpu->cycles < budget)
+      budget = replay->at - cpu->cycles;
+    consumed += cpu_run(cpu, budget);
+    if (cpu_debug_stopped(cpu))
+      return consumed;
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef TINY6502_REPLAY_H
+#define TINY6502_REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tiny6502.h"
+
+// Deterministic record and replay of a machine's inputs. While recording,
+// every cpu_set_irq() and cpu_set_nmi() call and every access to a page
+// mapped to handlers is appended to a log. Playing the log back into the
+// same machine, started from the state the recording started from (see
+// tiny6502_state.h), repeats the run exactly without the devices: reads from
+// handler pages return the recorded values, and the recorded interrupt line
+// changes are made at the same points.
+//
+// A line change made from inside a handler is replayed at the same access.
+// One made anywhere else, such as from a scheduler event or by the host
+// between runs, is replayed at the cycle it was made at: cpu_replay_run
+// stops there, so playback runs on cpu_run at full speed in between. Changes
+// from write watchers count as made outside handlers, which is only exact
+// under CPU_TIMING_CYCLE.
+//
+// During playback the machine must have the same pages mapped to handlers
+// as when it was recorded. Write handlers are still called, so output
+// devices keep working, but read handlers are not, and interrupt line
+// changes from the host or from devices are ignored. If the machine does
+// something the log does not expect, playback stops and reports it; once
+// the log runs out the machine carries on live.
+//
+// The log is a byte stream, about four bytes per I/O access and one to four
+// per line change.
+
+typedef struct CPUReplay {
+  CPU *cpu;
+  FILE *log;
+  bool recording, playing;
+
+  // Set when playback met an access or cycle the log did not expect.
+  bool diverged;
+
+  // How deep in handler calls the machine is, and the cycle of the last
+  // line change made outside them.
+  unsigned depth;
+  uint64_t cycle;
+
+  // Playback: the next record, if any is left.
+  bool has_next;
+  uint8_t tag;
+  uint16_t addr;
+  uint8_t value;
+  uint64_t at;
+} CPUReplay;
+
+// Attaches replay to cpu and appends its inputs to log, opened for writing,
+// until cpu_replay_stop.
+void cpu_replay_record(CPUReplay *replay, CPU *cpu, FILE *log);
+
+// Attaches replay to cpu to play back log, opened for reading.
+void cpu_replay_play(CPUReplay *replay, CPU *cpu, FILE *log);
+
+// Detaches replay. A recording's log is flushed but left open.
+void cpu_replay_stop(CPUReplay *replay);
+
+// cpu_run for a machine being played back, which it must be run with so
+// that line changes are made at their cycles. It returns early, at the
+// instruction that diverged, if playback stops matching the log, or at a
+// breakpoint or watchpoint. While recording, or once the log has run out, it
+// is cpu_run.
+uint64_t cpu_replay_run(CPUReplay *replay, uint64_t cycle_budget);
+
+// Called by the core.
+uint8_t cpu_replay_read(CPUReplay *replay, CPU *cpu, uint16_t addr);
+void cpu_replay_write(CPUReplay *replay, CPU *cpu, uint16_t addr,
+                      uint8_t value);
+bool cpu_replay_line(CPUReplay *replay, bool nmi, unsigned source,
+                     bool asserted);
+
+#endif // TINY6502_REPLAY_H
@@ -0,0 +1,229 @@
+#include "tiny6502_rewind.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tiny6502_debug.h"
+
+typedef struct {
+  uint16_t PC;
+  uint8_t SP;
+  uint8_t A, X, Y, P;
+  bool NMI, IRQ;
+  uint8_t irq_sources, nmi_sources;
+  uint8_t cycles_left;
+  uint64_t cycles;
+  CPUCycleState cycle;
+
+  // The first page saved after the keyframe.
+  uint64_t page;
+} CPURewindFrame;
+
+typedef struct {
+  uint8_t *host;
+  uint8_t page;
+  uint8_t data[0x100];
+} CPURewindPage;
+
+struct CPURewind {
+  CPU *cpu;
+  int watcher;
+  uint64_t interval;
+
+  // The cycle the next keyframe falls due at.
+  uint64_t next;
+
+  // Keyframes and saved pages are numbered from the start and kept in rings
+  // indexed by number modulo capacity.
+  CPURewindFrame *frames;
+  unsigned frame_capacity;
+  uint64_t frame_first, frame_end;
+
+  CPURewindPage *pages;
+  unsigned page_capacity;
+  uint64_t page_end;
+};
+
+static CPURewindFrame *cpu_rewind_frame(const CPURewind *rewind,
+                                        uint64_t frame) {
+  return &rewind->frames[frame % rewind->frame_capacity];
+}
+
+static void cpu_rewind_watch(CPURewind *rewind, bool on) {
+  CPU *cpu = rewind->cpu;
+  for (unsigned page = 0; page < 0x100; page++)
+    cpu_watch_page(cpu, rewind->watcher, page, on && cpu->pages.ram[page]);
+}
+
+static void cpu_rewind_written(CPU *cpu, void *data, uint16_t addr,
+                               uint8_t value) {
+  (void)value;
+  CPURewind *rewind = data;
+  unsigned page = addr >> 8;
+  uint8_t *host = cpu->pages.ram[page];
+  cpu_watch_page(cpu, rewind->watcher, page, false);
+  if (!host)
+    return;
+
+  // Make room by dropping the oldest keyframe. The newest never goes: it
+  // saves each page at most once.
+  while (rewind->frame_end - rewind->frame_first > 1 &&
+         rewind->page_end -
+                 cpu_rewind_frame(rewind, rewind->frame_first)->page >=
+             rewind->page_capacity)
+    rewind->frame_first++;
+
+  CPURewindPage *saved =
+      &rewind->pages[rewind->page_end++ % rewind->page_capacity];
+  saved->host = host;
+  saved->page = page;
+  memcpy(saved->data, host, 0x100);
+}
+
+static void cpu_rewind_keyframe(CPURewind *rewind) {
+  const CPU *cpu = rewind->cpu;
+  if (rewind->frame_end - rewind->frame_first == rewind->frame_capacity)
+    rewind->frame_first++;
+
+  CPURewindFrame *frame = cpu_rewind_frame(rewind, rewind->frame_end++);
+  frame->PC = cpu->PC;
+  frame->SP = cpu->SP;
+  frame->A = cpu->A;
+  frame->X = cpu->X;
+  frame->Y = cpu->Y;
+  frame->P = cpu_flags(cpu);
+  frame->NMI = cpu->NMI;
+  frame->IRQ = cpu->IRQ;
+  frame->irq_sources = cpu->irq_sources;
+  frame->nmi_sources = cpu->nmi_sources;
+  frame->cycles_left = cpu->cycles_left;
+  frame->cycles = cpu->cycles;
+  frame->cycle = cpu->cycle;
+  frame->page = rewind->page_end;
+
+  rewind->next = cpu->cycles + rewind->interval;
+  cpu_rewind_watch(rewind, true);
+}
+
+// Returns the machine to a keyframe and drops everything after it.
+static void cpu_rewind_restore(CPURewind *rewind, uint64_t number) {
+  CPU *cpu = rewind->cpu;
+  const CPURewindFrame *frame = cpu_rewind_frame(rewind, number);
+
+  // Stop watching first, so that putting pages back does not save them.
+  cpu_rewind_watch(rewind, false);
+  while (rewind->page_end > frame->page) {
+    const CPURewindPage *saved =
+        &rewind->pages[--rewind->page_end % rewind->page_capacity];
+    cpu_watch_touch(cpu, saved->page << 8, 0x100);
+    memcpy(saved->host, saved->data, 0x100);
+  }
+  rewind->frame_end = number + 1;
+
+  cpu->PC = frame->PC;
+  cpu->SP = frame->SP;
+  cpu->A = frame->A;
+  cpu->X = frame->X;
+  cpu->Y = frame->Y;
+  cpu_set_flags(cpu, frame->P);
+  cpu->NMI = frame->NMI;
+  cpu->IRQ = frame->IRQ;
+  cpu->irq_sources = frame->irq_sources;
+  cpu->nmi_sources = frame->nmi_sources;
+  cpu->cycles_left = frame->cycles_left;
+  cpu->cycles = frame->cycles;
+  cpu->cycle = frame->cycle;
+
+  rewind->next = frame->cycles + rewind->interval;
+  cpu_rewind_watch(rewind, true);
+}
+
+CPURewind *cpu_rewind_create(CPU *cpu, uint64_t interval, unsigned frames,
+                             unsigned pages) {
+  CPURewind *rewind = calloc(1, sizeof(*rewind));
+  if (!rewind)
+    return NULL;
+  rewind->cpu = cpu;
+  rewind->interval = interval ? interval : 1;
+  rewind->frame_capacity = frames ? frames : 1;
+  rewind->page_capacity = pages < 0x100 ? 0x100 : pages;
+  rewind->frames = calloc(rewind->frame_capacity, sizeof(CPURewindFrame));
+  rewind->pages = calloc(rewind->page_capacity, sizeof(CPURewindPage));
+  rewind->watcher = cpu_watch_add(cpu, cpu_rewind_written, rewind);
+  if (!rewind->frames || !rewind->pages || rewind->watcher < 0) {
+    if (rewind->watcher >= 0)
+      cpu_watch_remove(cpu, rewind->watcher);
+    free(rewind->frames);
+    free(rewind->pages);
+    free(rewind);
+    return NULL;
+  }
+
+  cpu_rewind_keyframe(rewind);
+  return rewind;
+}
+
+void cpu_rewind_destroy(CPURewind *rewind) {
+  if (!rewind)
+    return;
+  cpu_watch_remove(rewind->cpu, rewind->watcher);
+  free(rewind->frames);
+  free(rewind->pages);
+  free(rewind);
+}
+
+void cpu_rewind_mark(CPURewind *rewind) {
+  if (rewind->cpu->cycles >= rewind->next)
+    cpu_rewind_keyframe(rewind);
+}
+
+uint64_t cpu_rewind_run(CPURewind *rewind, uint64_t cycle_budget) {
+  CPU *cpu = rewind->cpu;
+  uint64_t consumed = 0;
+  for (;;) {
+    cpu_rewind_mark(rewind);
+    if (consumed >= cycle_budget)
+      return consumed;
+    uint64_t budget = cycle_budget - consumed;
+    if (rewind->next - cpu->cycles < budget)
+      budget = rewind->next - cpu->cycles;
+    consumed += cpu_run(cpu, budget);
+    if (cpu_debug_stopped(cpu))
+      return consumed;
+  }
+}
+
+uint64_t cpu_rewind_oldest(const CPURewind *rewind) {
+  return cpu_rewind_frame(rewind, rewind->frame_first)->cycles;
+}
+
+bool cpu_rewind_to(CPURewind *rewind, uint64_t cycle) {
+  CPU *cpu = rewind->cpu;
+  if (cycle > cpu->cycles || cycle < cpu_rewind_oldest(rewind))
+    return false;
+
+  uint64_t number = rewind->frame_end - 1;
+  while (cpu_rewind_frame(rewind, number)->cycles > cycle)
+    number--;
+  cpu_rewind_restore(rewind, number);
+
+  // Instructions run whole, so find the last one to start at or before the
+  // target by stepping, then go back and run to it.
+  if (cpu->timing != CPU_TIMING_CYCLE && cpu->cycles < cycle) {
+    uint64_t boundary = cpu->cycles;
+    while (cpu->cycles <= cycle) {
+      boundary = cpu->cycles;
+      cpu_step_instruction(cpu);
+    }
+    cpu_rewind_restore(rewind, number);
+    cycle = boundary;
+  }
+  if (cpu->cycles < cycle)
+    cpu_rewind_run(rewind, cycle - cpu->cycles);
+  return true;
+}
+
+bool cpu_rewind_step_back(CPURewind *rewind) {
+  uint64_t cycles = rewind->cpu->cycles;
+  return cycles && cpu_rewind_to(rewind, cycles - 1);
+}
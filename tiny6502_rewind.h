@@ -0,0 +1,51 @@
+#ifndef TINY6502_REWIND_H
+#define TINY6502_REWIND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Rewinding a running machine. Every interval cycles a keyframe saves the
+// registers, and between keyframes the first write to each RAM page saves the
+// page's old contents, as a snapshot does (see tiny6502_snapshot.h). Going
+// back puts the saved pages back, newest first, to recover the memory of the
+// nearest keyframe before the target, then runs forward from it to the
+// target. The machine must run the same way again, so device state, page
+// mappings and writes made through host pointers are not tracked, as with
+// snapshots and save states.
+//
+// Keyframes and saved pages live in fixed rings. When either is full the
+// oldest keyframe is dropped, so memory stays bounded and the window reaches
+// back as far as the rings allow. Saved pages cost 256 bytes each, and a
+// rewind uses one of the CPU's write watchers.
+
+typedef struct CPURewind CPURewind;
+
+// Starts keeping history for cpu with a keyframe every interval cycles, at
+// most frames keyframes and at most pages saved pages, which is raised to
+// one interval's worth of 256 if lower. Returns NULL if the CPU has no
+// watcher free or memory runs out.
+CPURewind *cpu_rewind_create(CPU *cpu, uint64_t interval, unsigned frames,
+                             unsigned pages);
+void cpu_rewind_destroy(CPURewind *rewind);
+
+// cpu_run, taking keyframes as they fall due; like cpu_run it stops at
+// breakpoints and watchpoints. Hosts driving the CPU some other way call
+// cpu_rewind_mark between runs instead; cycles run without either stretch
+// the interval.
+uint64_t cpu_rewind_run(CPURewind *rewind, uint64_t cycle_budget);
+void cpu_rewind_mark(CPURewind *rewind);
+
+// The earliest cycle the machine can go back to.
+uint64_t cpu_rewind_oldest(const CPURewind *rewind);
+
+// Takes the machine back to cycle, or under timings other than
+// CPU_TIMING_CYCLE to the last instruction boundary at or before it. History
+// after that point is dropped. Returns false if cycle is outside the window.
+bool cpu_rewind_to(CPURewind *rewind, uint64_t cycle);
+
+// Goes back one instruction, or one cycle under CPU_TIMING_CYCLE.
+bool cpu_rewind_step_back(CPURewind *rewind);
+
+#endif // TINY6502_REWIND_H
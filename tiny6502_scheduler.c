@@ -0,0 +1,83 @@
+#include "tiny6502_scheduler.h"
+
+#include <stddef.h>
+
+#include "tiny6502_debug.h"
+
+static void cpu_scheduler_update(CPUScheduler *scheduler) {
+  uint64_t next = CPU_SCHEDULER_IDLE;
+  for (int i = 0; i < CPU_SCHEDULER_EVENTS; i++)
+    if (scheduler->events[i].cycle < next)
+      next = scheduler->events[i].cycle;
+  scheduler->next = next;
+}
+
+void cpu_scheduler_init(CPUScheduler *scheduler, CPU *cpu) {
+  scheduler->cpu = cpu;
+  for (int i = 0; i < CPU_SCHEDULER_EVENTS; i++)
+    scheduler->events[i] = (CPUEvent){NULL, NULL, CPU_SCHEDULER_IDLE};
+  scheduler->next = CPU_SCHEDULER_IDLE;
+}
+
+int cpu_scheduler_add(CPUScheduler *scheduler, CPUEventHandler handler,
+                      void *data) {
+  for (int event = 0; event < CPU_SCHEDULER_EVENTS; event++) {
+    if (!scheduler->events[event].handler) {
+      scheduler->events[event] =
+          (CPUEvent){handler, data, CPU_SCHEDULER_IDLE};
+      return event;
+    }
+  }
+  return -1;
+}
+
+void cpu_scheduler_remove(CPUScheduler *scheduler, int event) {
+  scheduler->events[event] = (CPUEvent){NULL, NULL, CPU_SCHEDULER_IDLE};
+  cpu_scheduler_update(scheduler);
+}
+
+void cpu_scheduler_at(CPUScheduler *scheduler, int event, uint64_t cycle) {
+  scheduler->events[event].cycle = cycle;
+  cpu_scheduler_update(scheduler);
+  // Scheduled from a bus handler, the event may come before the end of the
+  // run in progress.
+  cpu_stop_at(scheduler->cpu, cycle);
+}
+
+void cpu_scheduler_cancel(CPUScheduler *scheduler, int event) {
+  scheduler->events[event].cycle = CPU_SCHEDULER_IDLE;
+  cpu_scheduler_update(scheduler);
+}
+
+// Calls the handlers of the events that are due, earliest first. Handlers
+// may schedule events that are due at once, so the earliest is looked up
+// again after each.
+static void cpu_scheduler_dispatch(CPUScheduler *scheduler) {
+  CPU *cpu = scheduler->cpu;
+  while (scheduler->next <= cpu->cycles) {
+    CPUEvent *event = scheduler->events;
+    while (event->cycle != scheduler->next)
+      event++;
+    uint64_t cycle = event->cycle;
+    event->cycle = CPU_SCHEDULER_IDLE;
+    cpu_scheduler_update(scheduler);
+    event->handler(cpu, event->data, cycle);
+  }
+}
+
+uint64_t cpu_scheduler_run(CPUScheduler *scheduler, uint64_t cycle_budget) {
+  CPU *cpu = scheduler->cpu;
+  uint64_t consumed = 0;
+  for (;;) {
+    cpu_scheduler_dispatch(scheduler);
+    if (consumed >= cycle_budget)
+      return consumed;
+
+    uint64_t slice = cycle_budget - consumed;
+    if (scheduler->next - cpu->cycles < slice)
+      slice = scheduler->next - cpu->cycles;
+    consumed += cpu_run(cpu, slice);
+    if (cpu_debug_stopped(cpu))
+      return consumed;
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef TINY6502_SCHEDULER_H
+#define TINY6502_SCHEDULER_H
+
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Event scheduler for devices timed against the CPU, such as timers, serial
+// ports and video counters. Each device owns an event and sets the cycle at
+// which it next needs attention. cpu_scheduler_run runs the CPU with cpu_run,
+// uninterrupted, up to the earliest pending event, calls the handlers of the
+// events that are due and carries on, so the cost per cycle is that of
+// cpu_run alone while nothing is due.
+//
+// An event is due once CPU.cycles reaches its cycle, and is dispatched at the
+// next instruction boundary (or, under CPU_TIMING_CYCLE, the next cycle).
+// Handlers may raise IRQ or NMI, which the CPU takes before its next
+// instruction, and reschedule any event. A bus handler that schedules an
+// event during a run stops the run early if the event comes first.
+
+#define CPU_SCHEDULER_EVENTS 16
+
+// Never: the cycle of an event that is not scheduled.
+#define CPU_SCHEDULER_IDLE UINT64_MAX
+
+// Called when an event is due, with the cycle it was scheduled for. The event
+// is idle again by then; a periodic device schedules its next event from
+// cycle rather than CPU.cycles so that late dispatches do not drift.
+typedef void (*CPUEventHandler)(CPU *cpu, void *data, uint64_t cycle);
+
+typedef struct {
+  CPUEventHandler handler;
+  void *data;
+  uint64_t cycle;
+} CPUEvent;
+
+typedef struct {
+  CPU *cpu;
+
+  // The earliest cycle among the events.
+  uint64_t next;
+
+  CPUEvent events[CPU_SCHEDULER_EVENTS];
+} CPUScheduler;
+
+void cpu_scheduler_init(CPUScheduler *scheduler, CPU *cpu);
+
+// Adds an idle event. Returns its number, or -1 if all are taken.
+int cpu_scheduler_add(CPUScheduler *scheduler, CPUEventHandler handler,
+                      void *data);
+
+// Releases the event's number.
+void cpu_scheduler_remove(CPUScheduler *scheduler, int event);
+
+// Schedules the event for cycle, replacing any cycle it had. A cycle already
+// past is due at once.
+void cpu_scheduler_at(CPUScheduler *scheduler, int event, uint64_t cycle);
+
+void cpu_scheduler_cancel(CPUScheduler *scheduler, int event);
+
+// Runs the CPU for at least cycle_budget cycles, dispatching events as they
+// fall due, and returns the cycles consumed, counted as cpu_run counts them.
+// Events due when the budget runs out are dispatched before it returns. A
+// breakpoint or watchpoint (see tiny6502_debug.h) ends it early, with the
+// reason in cpu->debug->stop.
+uint64_t cpu_scheduler_run(CPUScheduler *scheduler, uint64_t cycle_budget);
+
+#endif // TINY6502_SCHEDULER_H
@@ -0,0 +1,79 @@
+#include "tiny6502_snapshot.h"
+
+#include <string.h>
+
+static void cpu_snapshot_written(CPU *cpu, void *data, uint16_t addr,
+                                 uint8_t value) {
+  (void)value;
+  CPUSnapshot *snapshot = data;
+  unsigned page = addr >> 8;
+  if (!snapshot->host[page])
+    return;
+
+  memcpy(snapshot->saved[page], snapshot->host[page], 0x100);
+  snapshot->dirty[snapshot->dirty_count++] = page;
+  cpu_watch_page(cpu, snapshot->watcher, page, false);
+}
+
+bool cpu_snapshot_take(CPUSnapshot *snapshot, CPU *cpu) {
+  snapshot->watcher = cpu_watch_add(cpu, cpu_snapshot_written, snapshot);
+  if (snapshot->watcher < 0) {
+    snapshot->cpu = NULL;
+    return false;
+  }
+
+  snapshot->PC = cpu->PC;
+  snapshot->SP = cpu->SP;
+  snapshot->A = cpu->A;
+  snapshot->X = cpu->X;
+  snapshot->Y = cpu->Y;
+  snapshot->P = cpu_flags(cpu);
+  snapshot->NMI = cpu->NMI;
+  snapshot->IRQ = cpu->IRQ;
+  snapshot->irq_sources = cpu->irq_sources;
+  snapshot->nmi_sources = cpu->nmi_sources;
+  snapshot->cycles_left = cpu->cycles_left;
+  snapshot->cycles = cpu->cycles;
+  snapshot->cycle = cpu->cycle;
+
+  snapshot->cpu = cpu;
+  snapshot->dirty_count = 0;
+  for (unsigned page = 0; page < 0x100; page++) {
+    snapshot->host[page] = cpu->pages.ram[page];
+    if (snapshot->host[page])
+      cpu_watch_page(cpu, snapshot->watcher, page, true);
+  }
+  return true;
+}
+
+void cpu_snapshot_restore(CPUSnapshot *snapshot) {
+  CPU *cpu = snapshot->cpu;
+  for (unsigned i = 0; i < snapshot->dirty_count; i++) {
+    unsigned page = snapshot->dirty[i];
+    cpu_watch_touch(cpu, page << 8, 0x100);
+    memcpy(snapshot->host[page], snapshot->saved[page], 0x100);
+    cpu_watch_page(cpu, snapshot->watcher, page, true);
+  }
+  snapshot->dirty_count = 0;
+
+  cpu->PC = snapshot->PC;
+  cpu->SP = snapshot->SP;
+  cpu->A = snapshot->A;
+  cpu->X = snapshot->X;
+  cpu->Y = snapshot->Y;
+  cpu_set_flags(cpu, snapshot->P);
+  cpu->NMI = snapshot->NMI;
+  cpu->IRQ = snapshot->IRQ;
+  cpu->irq_sources = snapshot->irq_sources;
+  cpu->nmi_sources = snapshot->nmi_sources;
+  cpu->cycles_left = snapshot->cycles_left;
+  cpu->cycles = snapshot->cycles;
+  cpu->cycle = snapshot->cycle;
+}
+
+void cpu_snapshot_release(CPUSnapshot *snapshot) {
+  if (!snapshot->cpu)
+    return;
+  cpu_watch_remove(snapshot->cpu, snapshot->watcher);
+  snapshot->cpu = NULL;
+}
@@ -0,0 +1,54 @@
+#ifndef TINY6502_SNAPSHOT_H
+#define TINY6502_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tiny6502.h"
+
+// Copy-on-write checkpoints of the registers and RAM. Taking a snapshot copies
+// no memory: every page mapped as RAM is watched, and the first write to a
+// page saves its old contents before the page goes back to direct access.
+// Restoring copies back only the pages written since, so rewinding after a
+// short run costs a few 256-byte copies.
+//
+// Each snapshot tracking a CPU uses one of its write watchers. Page mappings,
+// device state and writes made through host pointers rather than the CPU are
+// not tracked.
+
+typedef struct CPUSnapshot {
+  uint16_t PC;
+  uint8_t SP;
+  uint8_t A, X, Y, P;
+  bool NMI, IRQ;
+  uint8_t irq_sources, nmi_sources;
+  uint8_t cycles_left;
+  uint64_t cycles;
+  CPUCycleState cycle;
+
+  CPU *cpu;
+  int watcher;
+
+  // Host memory of each tracked page, NULL for pages that were not RAM when
+  // the snapshot was taken.
+  uint8_t *host[0x100];
+
+  // Pages written since the snapshot was taken or last restored, in the
+  // order they were first written, and their original contents.
+  uint8_t dirty[0x100];
+  uint16_t dirty_count;
+  uint8_t saved[0x100][0x100];
+} CPUSnapshot;
+
+// Takes a snapshot of cpu. A snapshot that is still tracking must be released
+// before it is taken again. Returns false if the CPU has no watcher free.
+bool cpu_snapshot_take(CPUSnapshot *snapshot, CPU *cpu);
+
+// Returns the CPU to the snapshot. Tracking continues, so a snapshot can be
+// restored any number of times.
+void cpu_snapshot_restore(CPUSnapshot *snapshot);
+
+// Stops tracking and gives the pages back their direct mapping.
+void cpu_snapshot_release(CPUSnapshot *snapshot);
+
+#endif // TINY6502_SNAPSHOT_H
@@ -0,0 +1,200 @@
+#include "tiny6502_state.h"
+
+#include <string.h>
+
+enum { PAGE_ZERO, PAGE_RAW, PAGE_RUNS };
+
+// Either a file or a memory buffer; ok drops to false on the first short read
+// or write and stays there.
+typedef struct {
+  FILE *file;
+  uint8_t *out;
+  const uint8_t *in;
+  size_t size;
+  size_t pos;
+  bool ok;
+} CPUStateStream;
+
+static void cpu_state_put(CPUStateStream *s, const void *data, size_t size) {
+  if (!s->ok)
+    return;
+  if (s->file) {
+    s->ok = fwrite(data, 1, size, s->file) == size;
+  } else if (size > s->size - s->pos) {
+    s->ok = false;
+    return;
+  } else {
+    memcpy(s->out + s->pos, data, size);
+  }
+  s->pos += size;
+}
+
+static void cpu_state_put8(CPUStateStream *s, uint8_t value) {
+  cpu_state_put(s, &value, 1);
+}
+
+static void cpu_state_put16(CPUStateStream *s, uint16_t value) {
+  uint8_t bytes[2] = {value & 0xFF, value >> 8};
+  cpu_state_put(s, bytes, 2);
+}
+
+static void cpu_state_put64(CPUStateStream *s, uint64_t value) {
+  uint8_t bytes[8];
+  for (int i = 0; i < 8; i++)
+    bytes[i] = value >> (8 * i);
+  cpu_state_put(s, bytes, 8);
+}
+
+static void cpu_state_get(CPUStateStream *s, void *data, size_t size) {
+  if (!s->ok)
+    return;
+  if (s->file) {
+    s->ok = fread(data, 1, size, s->file) == size;
+  } else if (size > s->size - s->pos) {
+    s->ok = false;
+    return;
+  } else {
+    memcpy(data, s->in + s->pos, size);
+  }
+  s->pos += size;
+}
+
+static uint8_t cpu_state_get8(CPUStateStream *s) {
+  uint8_t value = 0;
+  cpu_state_get(s, &value, 1);
+  return value;
+}
+
+static uint16_t cpu_state_get16(CPUStateStream *s) {
+  uint8_t bytes[2] = {0};
+  cpu_state_get(s, bytes, 2);
+  return bytes[0] | (bytes[1] << 8);
+}
+
+static uint64_t cpu_state_get64(CPUStateStream *s) {
+  uint8_t bytes[8] = {0};
+  cpu_state_get(s, bytes, 8);
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++)
+    value |= (uint64_t)bytes[i] << (8 * i);
+  return value;
+}
+
+static unsigned cpu_state_runs(const uint8_t *page) {
+  unsigned runs = 1;
+  for (unsigned i = 1; i < 0x100; i++)
+    runs += page[i] != page[i - 1];
+  return runs;
+}
+
+static void cpu_state_put_page(CPUStateStream *s, const uint8_t *page) {
+  unsigned runs = cpu_state_runs(page);
+  if (runs == 1 && page[0] == 0) {
+    cpu_state_put8(s, PAGE_ZERO);
+  } else if (runs * 2 < 0x100) {
+    cpu_state_put8(s, PAGE_RUNS);
+    for (unsigned i = 0; i < 0x100;) {
+      unsigned length = 1;
+      while (i + length < 0x100 && page[i + length] == page[i])
+        length++;
+      cpu_state_put8(s, length - 1);
+      cpu_state_put8(s, page[i]);
+      i += length;
+    }
+  } else {
+    cpu_state_put8(s, PAGE_RAW);
+    cpu_state_put(s, page, 0x100);
+  }
+}
+
+static bool cpu_state_get_page(CPUStateStream *s, uint8_t *page) {
+  switch (cpu_state_get8(s)) {
+  case PAGE_ZERO:
+    memset(page, 0, 0x100);
+    return s->ok;
+  case PAGE_RAW:
+    cpu_state_get(s, page, 0x100);
+    return s->ok;
+  case PAGE_RUNS:
+    for (unsigned i = 0; i < 0x100 && s->ok;) {
+      unsigned length = cpu_state_get8(s) + 1;
+      uint8_t value = cpu_state_get8(s);
+      if (length > 0x100 - i)
+        return false;
+      memset(page + i, value, length);
+      i += length;
+    }
+    return s->ok;
+  default:
+    return false;
+  }
+}
+
+static size_t cpu_state_write(const CPU *cpu, CPUStateStream *s) {
+  cpu_state_put(s, "T65S", 4);
+  cpu_state_put16(s, CPU_STATE_VERSION);
+  cpu_state_put16(s, cpu->PC);
+  cpu_state_put8(s, cpu->SP);
+  cpu_state_put8(s, cpu->A);
+  cpu_state_put8(s, cpu->X);
+  cpu_state_put8(s, cpu->Y);
+  cpu_state_put8(s, cpu_flags(cpu));
+  cpu_state_put8(s, cpu->NMI | (cpu->IRQ << 1));
+  cpu_state_put8(s, cpu->cycles_left);
+  cpu_state_put8(s, cpu->irq_sources);
+  cpu_state_put8(s, cpu->nmi_sources);
+  cpu_state_put64(s, cpu->cycles);
+
+  for (unsigned page = 0; page < 0x100; page++)
+    cpu_state_put_page(s, *cpu->memory + (page << 8));
+  return s->ok ? s->pos : 0;
+}
+
+static bool cpu_state_read(CPU *cpu, CPUStateStream *s) {
+  char magic[4] = {0};
+  cpu_state_get(s, magic, 4);
+  uint16_t version = cpu_state_get16(s);
+  if (!s->ok || memcmp(magic, "T65S", 4) || version != CPU_STATE_VERSION)
+    return false;
+
+  cpu->PC = cpu_state_get16(s);
+  cpu->SP = cpu_state_get8(s);
+  cpu->A = cpu_state_get8(s);
+  cpu->X = cpu_state_get8(s);
+  cpu->Y = cpu_state_get8(s);
+  cpu_set_flags(cpu, cpu_state_get8(s));
+  uint8_t lines = cpu_state_get8(s);
+  cpu->NMI = lines & 1;
+  cpu->IRQ = (lines >> 1) & 1;
+  cpu->cycles_left = cpu_state_get8(s);
+  cpu->irq_sources = cpu_state_get8(s);
+  cpu->nmi_sources = cpu_state_get8(s);
+  cpu->cycles = cpu_state_get64(s);
+  cpu->cycle = (CPUCycleState){0};
+
+  cpu_watch_touch(cpu, 0, 0x10000);
+  for (unsigned page = 0; page < 0x100; page++)
+    if (!cpu_state_get_page(s, *cpu->memory + (page << 8)))
+      return false;
+  return s->ok;
+}
+
+size_t cpu_state_save(const CPU *cpu, FILE *out) {
+  CPUStateStream s = {.file = out, .ok = true};
+  return cpu_state_write(cpu, &s);
+}
+
+size_t cpu_state_save_buffer(const CPU *cpu, void *buffer, size_t size) {
+  CPUStateStream s = {.out = buffer, .size = size, .ok = true};
+  return cpu_state_write(cpu, &s);
+}
+
+bool cpu_state_load(CPU *cpu, FILE *in) {
+  CPUStateStream s = {.file = in, .ok = true};
+  return cpu_state_read(cpu, &s);
+}
+
+bool cpu_state_load_buffer(CPU *cpu, const void *buffer, size_t size) {
+  CPUStateStream s = {.in = buffer, .size = size, .ok = true};
+  return cpu_state_read(cpu, &s);
+}
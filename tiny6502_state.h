@@ -0,0 +1,58 @@
+#ifndef TINY6502_STATE_H
+#define TINY6502_STATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tiny6502.h"
+
+// Save states. All multi-byte values are little endian and no struct is
+// written as is, so states move freely between compilers and hosts.
+//
+//   offset  size  field
+//        0     4  magic "T65S"
+//        4     2  format version, currently 2
+//        6     2  PC
+//        8     1  SP
+//        9     1  A
+//       10     1  X
+//       11     1  Y
+//       12     1  P as the status register byte (C is bit 0, N bit 7)
+//       13     1  interrupt lines: bit 0 NMI, bit 1 IRQ
+//       14     1  cycles_left
+//       15     1  sources holding IRQ
+//       16     1  sources holding NMI
+//       17     8  cycles
+//       25        the 256 pages of the CPU's Memory, in order
+//
+// Each page starts with a tag byte:
+//   0  the page is all zero; nothing follows
+//   1  256 raw bytes follow
+//   2  runs follow as (length - 1, value) byte pairs covering 256 bytes
+//
+// Under CPU_TIMING_CYCLE, save between instructions: progress through an
+// instruction is not part of a state, and loading one starts the CPU at an
+// instruction boundary.
+//
+// Readers accept only their own version and reject the rest. The buffer
+// loader parses in place, so a state file can be mapped with mmap and loaded
+// straight from the mapping.
+
+#define CPU_STATE_VERSION 2
+
+// Upper bound on the size of a state.
+#define CPU_STATE_MAX_SIZE (25 + 0x100 * (1 + 0x100))
+
+// Return the number of bytes written, or 0 on a write error or when the
+// buffer is too small.
+size_t cpu_state_save(const CPU *cpu, FILE *out);
+size_t cpu_state_save_buffer(const CPU *cpu, void *buffer, size_t size);
+
+// Restore registers, cycle counters and memory. On failure the CPU may be
+// partially loaded.
+bool cpu_state_load(CPU *cpu, FILE *in);
+bool cpu_state_load_buffer(CPU *cpu, const void *buffer, size_t size);
+
+#endif // TINY6502_STATE_H
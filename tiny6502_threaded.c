@@ -0,0 +1,112 @@
+#include "tiny6502.h"
+#include "tiny6502_ops.h"
+#include "tiny6502_trace.h"
+
+// Threaded-code interpreter. Opcode bodies are expanded inline from
+// TINY6502_OPCODES, so the core runs the same semantics as the table
+// handlers but with one indirect jump per opcode body instead of a shared
+// indirect call. Compilers without labels-as-values, or builds with
+// TINY6502_NO_COMPUTED_GOTO, get a switch over the same bodies.
+
+#if defined(__GNUC__) && !defined(TINY6502_NO_COMPUTED_GOTO)
+#define TINY6502_COMPUTED_GOTO
+#endif
+
+// Records the instruction just fetched, so the opcode is read from the bus
+// once.
+#ifdef TINY6502_TRACE
+#define TRACE(c, opcode)                                                       \
+  if ((c)->trace)                                                              \
+  cpu_trace_record((c)->trace, c, (uint16_t)((c)->PC - 1), opcode)
+#else
+#define TRACE(c, opcode) ((void)0)
+#endif
+
+// Every helper is inlined into the engine: passing the register copy below to
+// an out-of-line call would force it into memory.
+#ifdef __GNUC__
+#define FLATTEN __attribute__((flatten))
+#else
+#define FLATTEN
+#endif
+
+#define INTERRUPT_PENDING(c) ((c)->NMI || ((c)->IRQ && !(c)->P.flags.I))
+
+FLATTEN uint64_t cpu_run_threaded(CPU *cpu, uint64_t cycle_budget) {
+  uint64_t consumed = cpu->cycles_left;
+  if (consumed > cycle_budget)
+    consumed = cycle_budget;
+  cpu->cycles_left -= consumed;
+  if (consumed >= cycle_budget)
+    return consumed;
+
+  // The registers live in this copy for the whole run. Its address never
+  // leaves the function, so the compiler is free to keep them in host
+  // registers. They are stored back on exit and around bus handlers, which
+  // are always given the real CPU.
+  CPU regs;
+  CPU *const c = &regs;
+  cpu_copy_registers(c, cpu);
+  c->bus = cpu->bus;
+  c->trace = cpu->trace;
+  uint64_t start = c->cycles;
+  c->deadline = start + (cycle_budget - consumed);
+  uint8_t opcode;
+
+#ifdef TINY6502_COMPUTED_GOTO
+#define LABEL(code, op, mode, base, page) [code] = &&op_##code,
+  static const void *const labels[256] = {TINY6502_OPCODES(LABEL)};
+#undef LABEL
+
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    if (c->cycles >= c->deadline)                                              \
+      goto done;                                                               \
+    if (INTERRUPT_PENDING(c))                                                  \
+      goto interrupt;                                                          \
+    opcode = cpu_fetch(c);                                                     \
+    TRACE(c, opcode);                                                          \
+    goto *labels[opcode];                                                      \
+  } while (0)
+
+  DISPATCH();
+
+interrupt:
+  cpu_interrupt(c);
+  c->cycles += 7;
+  DISPATCH();
+
+#define BODY(code, op, mode, base, page)                                       \
+  op_##code : EXEC_##op(c, mode);                                              \
+  c->cycles += base + page;                                                    \
+  DISPATCH();
+  TINY6502_OPCODES(BODY)
+#undef BODY
+#undef DISPATCH
+
+done:
+#else
+  while (c->cycles < c->deadline) {
+    if (INTERRUPT_PENDING(c)) {
+      cpu_interrupt(c);
+      c->cycles += 7;
+      continue;
+    }
+
+    opcode = cpu_fetch(c);
+    TRACE(c, opcode);
+    switch (opcode) {
+#define BODY(code, op, mode, base, page)                                       \
+  case code:                                                                   \
+    EXEC_##op(c, mode);                                                        \
+    c->cycles += base + page;                                                  \
+    break;
+      TINY6502_OPCODES(BODY)
+#undef BODY
+    }
+  }
+#endif
+
+  cpu_copy_registers(cpu, c);
+  return consumed + (cpu->cycles - start);
+}
@@ -0,0 +1,72 @@
+#include "tiny6502.h"
+#include "tiny6502_ops.h"
+
+// Handlers for CPU_TIMING_EXACT. The opcode bodies are expanded with operand
+// fetches and branches that add the cycles they actually cost to a local
+// count, instead of the table's worst case.
+
+static inline bool cpu_exact_crossed(uint16_t base, uint16_t addr) {
+  return (base ^ addr) >> 8;
+}
+
+static inline uint8_t cpu_exact_operand_ABSX(CPU *cpu, uint8_t *extra) {
+  uint16_t base = cpu_fetch16(cpu);
+  uint16_t addr = base + cpu->X;
+  *extra = cpu_exact_crossed(base, addr);
+  return cpu_load(cpu, addr);
+}
+
+static inline uint8_t cpu_exact_operand_ABSY(CPU *cpu, uint8_t *extra) {
+  uint16_t base = cpu_fetch16(cpu);
+  uint16_t addr = base + cpu->Y;
+  *extra = cpu_exact_crossed(base, addr);
+  return cpu_load(cpu, addr);
+}
+
+static inline uint8_t cpu_exact_operand_INDY(CPU *cpu, uint8_t *extra) {
+  uint8_t ptr = cpu_fetch(cpu);
+  uint16_t base = cpu_load(cpu, ptr);
+  base |= cpu_load(cpu, (uint8_t)(ptr + 1)) << 8;
+  uint16_t addr = base + cpu->Y;
+  *extra = cpu_exact_crossed(base, addr);
+  return cpu_load(cpu, addr);
+}
+
+// A taken branch costs one cycle, and one more if the target is on another
+// page than the next instruction.
+static inline void cpu_exact_branch(CPU *cpu, bool taken, uint8_t *extra) {
+  int8_t offset = cpu_fetch(cpu);
+  if (!taken)
+    return;
+  uint16_t target = cpu->PC + offset;
+  *extra = 1 + cpu_exact_crossed(cpu->PC, target);
+  cpu->PC = target;
+}
+
+#define EXACT_OPERAND_IMM(cpu) cpu_operand_IMM(cpu)
+#define EXACT_OPERAND_ZP(cpu) cpu_operand_ZP(cpu)
+#define EXACT_OPERAND_ZPX(cpu) cpu_operand_ZPX(cpu)
+#define EXACT_OPERAND_ZPY(cpu) cpu_operand_ZPY(cpu)
+#define EXACT_OPERAND_ABS(cpu) cpu_operand_ABS(cpu)
+#define EXACT_OPERAND_ABSX(cpu) cpu_exact_operand_ABSX(cpu, &extra)
+#define EXACT_OPERAND_ABSY(cpu) cpu_exact_operand_ABSY(cpu, &extra)
+#define EXACT_OPERAND_INDX(cpu) cpu_operand_INDX(cpu)
+#define EXACT_OPERAND_INDY(cpu) cpu_exact_operand_INDY(cpu, &extra)
+
+#undef CPU_OPERAND
+#undef CPU_BRANCH
+#define CPU_OPERAND(cpu, mode) EXACT_OPERAND_##mode(cpu)
+#define CPU_BRANCH(cpu, taken) cpu_exact_branch(cpu, taken, &extra)
+
+#define HANDLER(code, mn, mode, cycles, page_cycles)                           \
+  static uint8_t cpu_exact_op_##code(CPU *cpu) {                               \
+    uint8_t extra = 0;                                                         \
+    EXEC_##mn(cpu, mode);                                                      \
+    return cycles + extra;                                                     \
+  }
+TINY6502_OPCODES(HANDLER)
+#undef HANDLER
+
+#define ENTRY(code, mn, mode, cycles, page_cycles) [code] = cpu_exact_op_##code,
+uint8_t (*const cpu_exact_handlers[256])(CPU *cpu) = {TINY6502_OPCODES(ENTRY)};
+#undef ENTRY
@@ -0,0 +1,55 @@
+#include "tiny6502_trace.h"
+
+#include "tiny6502_ops.h"
+
+void cpu_trace_init(CPUTrace *trace, CPUTraceEntry *buffer,
+                    uint32_t capacity) {
+  trace->entries = buffer;
+  trace->mask = capacity - 1;
+  trace->count = 0;
+  trace->text = NULL;
+}
+
+void cpu_trace_attach(CPU *cpu, CPUTrace *trace) { cpu->trace = trace; }
+
+size_t cpu_trace_size(const CPUTrace *trace) {
+  uint64_t capacity = (uint64_t)trace->mask + 1;
+  return trace->count < capacity ? trace->count : capacity;
+}
+
+static size_t cpu_trace_first(const CPUTrace *trace) {
+  return (trace->count - cpu_trace_size(trace)) & trace->mask;
+}
+
+size_t cpu_trace_save(const CPUTrace *trace, FILE *out) {
+  size_t size = cpu_trace_size(trace);
+  size_t first = cpu_trace_first(trace);
+  size_t head = trace->mask + 1 - first;
+  if (head > size)
+    head = size;
+
+  size_t written =
+      fwrite(trace->entries + first, sizeof(CPUTraceEntry), head, out);
+  written += fwrite(trace->entries, sizeof(CPUTraceEntry), size - head, out);
+  return written;
+}
+
+void cpu_trace_print_entry(const CPUTraceEntry *entry, FILE *out) {
+  fprintf(out, "%10llu $%04X %-9s A:%02X X:%02X Y:%02X SP:%02X P:%02X\n",
+          (unsigned long long)entry->cycle, entry->PC,
+          cpu_opcode_table[entry->opcode].name, entry->A, entry->X, entry->Y,
+          entry->SP, entry->P);
+}
+
+void cpu_trace_print(const CPUTrace *trace, FILE *out) {
+  size_t size = cpu_trace_size(trace);
+  size_t first = cpu_trace_first(trace);
+  for (size_t i = 0; i < size; i++)
+    cpu_trace_print_entry(&trace->entries[(first + i) & trace->mask], out);
+}
+
+void cpu_trace_decode(FILE *in, FILE *out) {
+  CPUTraceEntry entry;
+  while (fread(&entry, sizeof(entry), 1, in) == 1)
+    cpu_trace_print_entry(&entry, out);
+}
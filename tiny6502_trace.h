@@ -0,0 +1,58 @@
+#ifndef TINY6502_TRACE_H
+#define TINY6502_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tiny6502.h"
+
+// Instruction tracing is compiled in only when TINY6502_TRACE is defined.
+// Without it the dispatch loop contains no trace code at all and the
+// functions below are still available for decoding saved traces.
+
+typedef struct {
+  uint64_t cycle;
+  uint16_t PC;
+  uint8_t opcode;
+  uint8_t A, X, Y, SP, P;
+} CPUTraceEntry;
+
+typedef struct CPUTrace {
+  CPUTraceEntry *entries;
+  uint32_t mask;
+  uint64_t count;
+
+  // When set, entries are decoded straight to this stream instead of being
+  // stored in the ring.
+  FILE *text;
+} CPUTrace;
+
+// capacity must be a power of two; the ring keeps the newest entries.
+void cpu_trace_init(CPUTrace *trace, CPUTraceEntry *buffer, uint32_t capacity);
+void cpu_trace_attach(CPU *cpu, CPUTrace *trace);
+
+// Number of entries currently held by the ring.
+size_t cpu_trace_size(const CPUTrace *trace);
+
+// Writes the ring, oldest entry first, as raw CPUTraceEntry records.
+size_t cpu_trace_save(const CPUTrace *trace, FILE *out);
+
+// Decodes the ring, or a stream written by cpu_trace_save(), as text.
+void cpu_trace_print(const CPUTrace *trace, FILE *out);
+void cpu_trace_decode(FILE *in, FILE *out);
+
+void cpu_trace_print_entry(const CPUTraceEntry *entry, FILE *out);
+
+static inline void cpu_trace_record(CPUTrace *trace, CPU *cpu, uint16_t pc,
+                                    uint8_t opcode) {
+  CPUTraceEntry entry = {cpu->cycles, pc,     opcode, cpu->A,
+                         cpu->X,      cpu->Y, cpu->SP, cpu_flags(cpu)};
+  if (trace->text) {
+    cpu_trace_print_entry(&entry, trace->text);
+    return;
+  }
+  trace->entries[trace->count++ & trace->mask] = entry;
+}
+
+#endif // TINY6502_TRACE_H